@@ -1,9 +1,15 @@
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <esp_attr.h>
 #include <esp_log.h>
+#include <freertos/queue.h>
 
 #include "toggle.h"
+#include "encoder.h"
+#include "touch.h"
 #include "button.h"
 #include "port.h"
 
@@ -12,24 +18,113 @@ typedef enum {
         button_timer_mode_idle = 0,
         button_timer_mode_long_press,
         button_timer_mode_repeat_window,
+        // Held through boot, waiting to be reported by the timer task.
+        button_timer_mode_boot_hold,
+        // Held past every long press tier; quarantined as stuck on expiry.
+        button_timer_mode_stuck,
 } button_timer_mode_t;
 
+typedef struct {
+        button_subscriber_fn callback;
+        void* context;
+        button_event_mask_t event_mask;
+        uint8_t priority;
+} button_subscriber_t;
+
+typedef struct {
+        button_event_mask_t event_mask;
+        // Runs in the GPIO interrupt on the leading edge instead of on events.
+        bool leading_edge;
+        button_reflex_t reflex;
+} button_reflex_binding_t;
+
+// Adaptive repeat window. Gaps between a release and the next press are
+// counted in BUTTON_GAP_BUCKETS buckets spanning 0..adaptive_repeat_max_timeout.
+// The learned window replaces repeat_press_timeout after BUTTON_GAP_MIN_SAMPLES
+// gaps; at BUTTON_GAP_MAX_SAMPLES all counts are halved, so recent presses
+// outweigh old ones.
+#define BUTTON_GAP_BUCKETS 16
+#define BUTTON_GAP_MIN_SAMPLES 8
+#define BUTTON_GAP_MAX_SAMPLES 64
+
+// Locking protocol:
+// - buttons_lock only guards claiming and releasing a pool slot.
+// - lock guards active, busy, dispatch_busy, queued and the subscriber table.
+//   It is a spinlock and no FreeRTOS call is made while holding it. It is
+//   never reinitialised, as other tasks may spin on it while the slot is reset.
+// - press_count, timer_mode and the event timer are only touched from the
+//   timer task (toggle, fault and event timer callbacks, which it runs one at
+//   a time) while the button is active, and by create/destroy while it is not.
+//   busy counts those callbacks and dispatch_busy the deliveries running in
+//   the dispatcher, so destroy can wait for them to finish.
+//   The gap histogram belongs to the timer task the same way.
+// - repeat_timeout is atomic: learned by the timer task, read and seeded by
+//   any task.
 typedef struct _button {
+        // First, so button_reset can clear everything after it.
+        portMUX_TYPE lock;
+
         gpio_num_t gpio_num;
         button_config_t config;
         button_callback_fn callback;
         void* context;
+        // Set for encoders, whose second channel is claimed as well.
+        bool encoder;
+        gpio_num_t encoder_gpio_b;
+        // Set for touch pads, which are sampled instead of interrupting.
+        bool touch;
+
+        bool active;
+        uint16_t busy;
+        uint16_t dispatch_busy;
+        // Events in the dispatch queue or being delivered from it.
+        uint16_t queued;
+
+        // Sorted by descending priority. subscriber_mask is the union of the
+        // masks in the table so dispatch can skip the table entirely.
+        button_subscriber_t subscribers[BUTTON_MAX_SUBSCRIBERS];
+        uint8_t subscriber_count;
+        button_event_mask_t subscriber_mask;
+
+        // Reflex actions, guarded by lock like the subscribers. reflex_mask is
+        // the union of their event masks; edge_reflexes counts the leading
+        // edge ones, so the interrupt skips the table without locking.
+        button_reflex_binding_t reflexes[BUTTON_MAX_REFLEXES];
+        uint8_t reflex_count;
+        button_event_mask_t reflex_mask;
+        atomic_uint_least8_t edge_reflexes;
 
         uint16_t press_count;
+        // The first press of the current sequence was already reported as a
+        // speculative single press.
+        bool single_press_reported;
+        // Long press tiers configured and reached during the current hold.
+        uint8_t hold_tier_count;
+        uint8_t hold_tier;
+        // The current hold started before boot; its release is no press.
+        bool boot_hold;
         TimerHandle_t event_timer;
         button_timer_mode_t timer_mode;
+
+        // Repeat window in use, in milliseconds.
+        atomic_uint_least16_t repeat_timeout;
+        // Set between a release that opened a repeat window and the next
+        // press, whose gap is then counted.
+        bool gap_pending;
+        TickType_t released_at;
+        uint8_t gap_samples;
+        uint8_t gap_histogram[BUTTON_GAP_BUCKETS];
 } button_t;
 
-static SemaphoreHandle_t buttons_lock = NULL;
-static button_t *registered_buttons[GPIO_NUM_MAX];
-static button_t button_pool[GPIO_NUM_MAX];
+static SemaphoreHandle_t _Atomic buttons_lock;
+static button_t button_pool[GPIO_NUM_MAX] = {
+        [0 ... GPIO_NUM_MAX - 1] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+};
 static StaticTimer_t button_timer_buffers[GPIO_NUM_MAX];
 static bool button_claimed[GPIO_NUM_MAX];
+// Bumped whenever a slot is activated, so queued events of a destroyed button
+// are not delivered to its successor. Guarded by the slot lock.
+static uint32_t button_generations[GPIO_NUM_MAX];
 static TickType_t button_ms_to_ticks(uint16_t duration_ms) {
         if (!duration_ms)
                 return 0;
@@ -39,6 +134,307 @@ static TickType_t button_ms_to_ticks(uint16_t duration_ms) {
 }
 static const char *TAG = "button";
 
+// Debounced pressed state, one bit per GPIO. Readers never lock: the words
+// are read between two loads of pressed_sequence, which writers make odd while
+// they update. Writers (the timer task and create/destroy) serialize on
+// pressed_lock.
+#define BUTTON_PRESSED_WORDS ((GPIO_NUM_MAX + 31) / 32)
+_Static_assert(GPIO_NUM_MAX <= 64, "the pressed mask holds 64 GPIOs");
+
+static portMUX_TYPE pressed_lock = portMUX_INITIALIZER_UNLOCKED;
+static atomic_uint_least32_t pressed_sequence;
+static atomic_uint_least32_t pressed_words[BUTTON_PRESSED_WORDS];
+
+// Pins latched by button_boot_capture and not claimed by a button yet, in the
+// layout of pressed_words. boot_levels and boot_capture_us are written before
+// the pins are published and never change afterwards.
+static atomic_uint_least32_t boot_pending[BUTTON_PRESSED_WORDS];
+static uint64_t boot_levels;
+static uint32_t boot_capture_us;
+
+// Event dispatcher. Events of normal and high priority buttons are queued per
+// class; dispatch_pending counts queued events, so button_dispatcher_run wakes
+// once per event and always takes from the high queue first.
+typedef struct {
+        gpio_num_t gpio_num;
+        button_event_t event;
+        int32_t value;
+        uint32_t generation;
+        uint32_t detected_us;
+} button_dispatch_item_t;
+
+static QueueHandle_t dispatch_queues[button_priority_critical];
+static SemaphoreHandle_t dispatch_pending;
+static atomic_bool dispatcher_enabled;
+static TaskHandle_t _Atomic dispatcher_task;
+
+static portMUX_TYPE dispatch_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static button_priority_stats_t dispatch_stats[BUTTON_PRIORITY_CLASSES];
+
+static void button_set_pressed(gpio_num_t gpio_num, bool pressed) {
+        const size_t word = (size_t) gpio_num / 32;
+        const uint32_t bit = 1u << ((size_t) gpio_num % 32);
+
+        portENTER_CRITICAL(&pressed_lock);
+        const uint32_t current = atomic_load_explicit(&pressed_words[word], memory_order_relaxed);
+        if (((current & bit) != 0) != pressed) {
+                atomic_fetch_add_explicit(&pressed_sequence, 1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_release);
+                atomic_store_explicit(&pressed_words[word], current ^ bit, memory_order_relaxed);
+                atomic_fetch_add_explicit(&pressed_sequence, 1, memory_order_release);
+        }
+        portEXIT_CRITICAL(&pressed_lock);
+}
+
+// Marks a timer task callback as in flight. Returns false when the button is
+// not (or no longer) registered.
+static bool button_enter(button_t *button) {
+        portENTER_CRITICAL(&button->lock);
+        const bool active = button->active;
+        if (active)
+                button->busy++;
+        portEXIT_CRITICAL(&button->lock);
+
+        return active;
+}
+
+// button_enter for a queued event: only while the slot still holds the
+// button that produced it.
+static bool button_enter_generation(button_t *button, uint32_t generation) {
+        portENTER_CRITICAL(&button->lock);
+        const bool active = button->active && button_generations[(size_t) button->gpio_num] == generation;
+        if (active)
+                button->dispatch_busy++;
+        portEXIT_CRITICAL(&button->lock);
+
+        return active;
+}
+
+static uint32_t button_generation(button_t *button) {
+        portENTER_CRITICAL(&button->lock);
+        const uint32_t generation = button_generations[(size_t) button->gpio_num];
+        portEXIT_CRITICAL(&button->lock);
+
+        return generation;
+}
+
+// Whether the button activated at generation is still registered, i.e. no
+// callback dispatched since has destroyed it.
+static bool button_alive(button_t *button, uint32_t generation) {
+        portENTER_CRITICAL(&button->lock);
+        const bool alive = button->active && button_generations[(size_t) button->gpio_num] == generation;
+        portEXIT_CRITICAL(&button->lock);
+
+        return alive;
+}
+
+static void button_activate(button_t *button) {
+        portENTER_CRITICAL(&button->lock);
+        button_generations[(size_t) button->gpio_num]++;
+        button->active = true;
+        portEXIT_CRITICAL(&button->lock);
+}
+
+static void button_leave(button_t *button) {
+        portENTER_CRITICAL(&button->lock);
+        // Zero when the callback destroyed its own button.
+        if (button->busy)
+                button->busy--;
+        portEXIT_CRITICAL(&button->lock);
+}
+
+static void button_leave_generation(button_t *button) {
+        portENTER_CRITICAL(&button->lock);
+        if (button->dispatch_busy)
+                button->dispatch_busy--;
+        // Zero when the delivery destroyed its own button.
+        if (button->queued)
+                button->queued--;
+        portEXIT_CRITICAL(&button->lock);
+}
+
+static void button_deliver(button_t *button, button_event_t event, int32_t value, uint32_t detected_us) {
+        const uint32_t latency_us = my_time_us_from_isr() - detected_us;
+
+        portENTER_CRITICAL(&dispatch_stats_lock);
+        button_priority_stats_t *stats = &dispatch_stats[button->config.priority];
+        stats->delivered++;
+        stats->total_latency_us += latency_us;
+        if (latency_us > stats->max_latency_us)
+                stats->max_latency_us = latency_us;
+        portEXIT_CRITICAL(&dispatch_stats_lock);
+
+        button->callback(event, button->context);
+
+        const button_event_mask_t bit = BUTTON_EVENT_MASK(event);
+
+        // Copy the matching listeners so they can (un)subscribe from within
+        // their callback without holding the lock.
+        button_subscriber_t matched[BUTTON_MAX_SUBSCRIBERS];
+        size_t count = 0;
+
+        portENTER_CRITICAL(&button->lock);
+        if (button->subscriber_mask & bit) {
+                for (size_t i = 0; i < button->subscriber_count; i++) {
+                        if (button->subscribers[i].event_mask & bit) {
+                                matched[count++] = button->subscribers[i];
+                        }
+                }
+        }
+        portEXIT_CRITICAL(&button->lock);
+
+        if (!count)
+                return;
+
+        const button_event_info_t info = {
+                .gpio_num = button->gpio_num,
+                .event = event,
+                .value = value,
+        };
+
+        for (size_t i = 0; i < count; i++) {
+                matched[i].callback(&info, matched[i].context);
+        }
+}
+
+// Runs from the timer task, or from the GPIO interrupt when higher_task_woken
+// is set.
+static void IRAM_ATTR button_reflex_run(const button_reflex_t *reflex, BaseType_t *higher_task_woken) {
+        switch (reflex->action) {
+        case button_reflex_output_high:
+                my_gpio_write_from_isr(reflex->output, true);
+                break;
+        case button_reflex_output_low:
+                my_gpio_write_from_isr(reflex->output, false);
+                break;
+        case button_reflex_output_toggle:
+                my_gpio_toggle_from_isr(reflex->output);
+                break;
+        case button_reflex_give_semaphore:
+                if (higher_task_woken) {
+                        xSemaphoreGiveFromISR(reflex->semaphore, higher_task_woken);
+                } else {
+                        xSemaphoreGive(reflex->semaphore);
+                }
+                break;
+        case button_reflex_notify_task:
+                if (higher_task_woken) {
+                        xTaskNotifyFromISR(reflex->task, reflex->notify_bits, eSetBits, higher_task_woken);
+                } else {
+                        xTaskNotify(reflex->task, reflex->notify_bits, eSetBits);
+                }
+                break;
+        }
+}
+
+static void button_reflexes_run(button_t *button, button_event_t event) {
+        const button_event_mask_t bit = BUTTON_EVENT_MASK(event);
+
+        // Copied like the subscribers, so binding never races a running action.
+        button_reflex_t matched[BUTTON_MAX_REFLEXES];
+        size_t count = 0;
+
+        portENTER_CRITICAL(&button->lock);
+        if (button->reflex_mask & bit) {
+                for (size_t i = 0; i < button->reflex_count; i++) {
+                        if (button->reflexes[i].event_mask & bit) {
+                                matched[count++] = button->reflexes[i].reflex;
+                        }
+                }
+        }
+        portEXIT_CRITICAL(&button->lock);
+
+        for (size_t i = 0; i < count; i++) {
+                button_reflex_run(&matched[i], NULL);
+        }
+}
+
+// Toggle edge callback: runs the leading edge reflexes in the GPIO interrupt.
+static void IRAM_ATTR button_edge_isr(void *context) {
+        button_t *button = (button_t*) context;
+        if (!atomic_load_explicit(&button->edge_reflexes, memory_order_relaxed))
+                return;
+
+        // Only an edge that starts a press: the pin is at the pressed level
+        // while the debounced state is still released.
+        const size_t index = (size_t) button->gpio_num;
+        const bool high = my_gpio_read_from_isr(button->gpio_num) == 1;
+        const uint32_t pressed = atomic_load_explicit(&pressed_words[index / 32], memory_order_relaxed);
+        if (high != (button->config.active_level == button_active_high) || (pressed & (1u << (index % 32))))
+                return;
+
+        button_reflex_t matched[BUTTON_MAX_REFLEXES];
+        size_t count = 0;
+
+        portENTER_CRITICAL_ISR(&button->lock);
+        if (button->active) {
+                for (size_t i = 0; i < button->reflex_count; i++) {
+                        if (button->reflexes[i].leading_edge) {
+                                matched[count++] = button->reflexes[i].reflex;
+                        }
+                }
+        }
+        portEXIT_CRITICAL_ISR(&button->lock);
+
+        BaseType_t higher_task_woken = pdFALSE;
+        for (size_t i = 0; i < count; i++) {
+                button_reflex_run(&matched[i], &higher_task_woken);
+        }
+
+        if (higher_task_woken == pdTRUE) {
+                portYIELD_FROM_ISR();
+        }
+}
+
+static void button_dispatch(button_t *button, button_event_t event, int32_t value) {
+        const uint32_t detected_us = my_time_us_from_isr();
+        const button_priority_t priority = button->config.priority;
+
+        // Reflexes do not wait for the dispatcher or any callback.
+        button_reflexes_run(button, event);
+
+        if (priority != button_priority_critical
+            && atomic_load_explicit(&dispatcher_enabled, memory_order_acquire)) {
+                // Counted before sending: the dispatcher may deliver, and
+                // uncount, it right away.
+                portENTER_CRITICAL(&button->lock);
+                button->queued++;
+                const uint32_t generation = button_generations[(size_t) button->gpio_num];
+                portEXIT_CRITICAL(&button->lock);
+
+                const button_dispatch_item_t item = {
+                        .gpio_num = button->gpio_num,
+                        .event = event,
+                        .value = value,
+                        .generation = generation,
+                        .detected_us = detected_us,
+                };
+                if (xQueueSendToBack(dispatch_queues[priority], &item, 0) == pdTRUE) {
+                        xSemaphoreGive(dispatch_pending);
+                        return;
+                }
+
+                // Late beats lost: deliver it from here, unless that would
+                // overtake events of this button still waiting in the queue.
+                portENTER_CRITICAL(&button->lock);
+                const bool overtakes = --button->queued > 0;
+                portEXIT_CRITICAL(&button->lock);
+
+                portENTER_CRITICAL(&dispatch_stats_lock);
+                if (overtakes) {
+                        dispatch_stats[priority].dropped++;
+                } else {
+                        dispatch_stats[priority].overflows++;
+                }
+                portEXIT_CRITICAL(&dispatch_stats_lock);
+
+                if (overtakes)
+                        return;
+        }
+
+        button_deliver(button, event, value, detected_us);
+}
+
 static void button_fire_event(button_t *button) {
         if (!button->press_count)
                 return;
@@ -51,24 +447,177 @@ static void button_fire_event(button_t *button) {
         default: event = button_event_tripple_press; break;
         }
 
-        button->callback(event, button->context);
+        const uint16_t press_count = button->press_count;
+        const bool reported = button->single_press_reported;
         button->press_count = 0;
+        button->single_press_reported = false;
+        if (press_count == 1 && reported)
+                return;
+
+        button_dispatch(button, event, press_count);
 }
 
-static void button_toggle_callback(bool high, void *context) {
-        if (!context)
+// Hold threshold of a 1-based long press tier, in milliseconds from the press.
+static uint16_t button_hold_time(const button_t *button, uint8_t tier) {
+        return tier <= 1 ? button->config.long_press_time : button->config.long_press_tier_times[tier - 2];
+}
+
+static button_event_t button_long_press_event(uint8_t tier) {
+        return tier <= 1 ? button_event_long_press : (button_event_t) (button_event_long_press_2 + tier - 2);
+}
+
+// Time the rest of the hold, held_ms so far, against stuck_press_seconds.
+static void button_stuck_watch(button_t *button, uint32_t held_ms) {
+        if (!button->config.stuck_press_seconds || !button->event_timer || button->touch)
                 return;
 
-        button_t *button = (button_t*) context;
-        const bool pressed = (high == (button->config.active_level == button_active_high));
+        // In 64 bits: pdMS_TO_TICKS overflows past 4294 s at 1 kHz, well
+        // within the range of stuck_press_seconds.
+        const uint32_t stuck_ms = (uint32_t) button->config.stuck_press_seconds * 1000;
+        uint64_t ticks = held_ms < stuck_ms ? (uint64_t) (stuck_ms - held_ms) * configTICK_RATE_HZ / 1000 : 0;
+        if (ticks > portMAX_DELAY - 1)
+                ticks = portMAX_DELAY - 1;
+        button->timer_mode = button_timer_mode_stuck;
+        xTimerChangePeriod(button->event_timer, ticks ? (TickType_t) ticks : 1, 0);
+}
+
+static void button_hold_tier_reached(button_t *button) {
+        button->press_count = 0;
+        const uint8_t tier = ++button->hold_tier;
+
+        if (tier < button->hold_tier_count) {
+                // One deadline chain: re-arm for the next threshold.
+                const uint16_t remaining = button_hold_time(button, tier + 1) - button_hold_time(button, tier);
+                xTimerChangePeriod(button->event_timer, button_ms_to_ticks(remaining), 0);
+        } else {
+                button->timer_mode = button_timer_mode_idle;
+                button_stuck_watch(button, button_hold_time(button, tier));
+        }
+
+        if (!button->config.long_press_report_on_release)
+                button_dispatch(button, button_long_press_event(tier), tier);
+}
+
+// The button was held through boot: report it, catch up on the long press
+// tiers that passed since the capture and continue the chain from there.
+static void button_boot_hold_report(button_t *button) {
+        const uint32_t held_ms = (my_time_us_from_isr() - boot_capture_us) / 1000;
+
+        uint8_t tier = 0;
+        while (tier < button->hold_tier_count && button_hold_time(button, tier + 1) <= held_ms)
+                tier++;
+
+        // Settled before any callback runs, since one may destroy the button.
+        button->hold_tier = tier;
+        if (tier < button->hold_tier_count) {
+                button->timer_mode = button_timer_mode_long_press;
+                const uint32_t remaining = button_hold_time(button, tier + 1) - held_ms;
+                xTimerChangePeriod(button->event_timer, button_ms_to_ticks((uint16_t) remaining), 0);
+        } else {
+                button->timer_mode = button_timer_mode_idle;
+                button_stuck_watch(button, held_ms);
+        }
+
+        const bool report_tiers = !button->config.long_press_report_on_release;
+        const uint32_t generation = button_generation(button);
+        button_dispatch(button, button_event_held_since_boot, (int32_t) held_ms);
+        for (uint8_t reported = 1; report_tiers && reported <= tier; reported++) {
+                if (!button_alive(button, generation))
+                        break;
+                button_dispatch(button, button_long_press_event(reported), reported);
+        }
+}
+
+static void button_hold_released(button_t *button) {
+        if ((button->timer_mode == button_timer_mode_long_press
+             || button->timer_mode == button_timer_mode_boot_hold
+             || button->timer_mode == button_timer_mode_stuck)
+            && xTimerIsTimerActive(button->event_timer)) {
+                xTimerStop(button->event_timer, 0);
+        }
+        button->timer_mode = button_timer_mode_idle;
+
+        const uint8_t tier = button->hold_tier;
+        button->hold_tier = 0;
+
+        if (button->config.long_press_report_on_release && tier)
+                button_dispatch(button, button_long_press_event(tier), tier);
+}
+
+static bool button_adaptive(const button_t *button) {
+        return button->config.adaptive_repeat_percentile && button->config.max_repeat_presses > 1;
+}
+
+static uint16_t button_clamp_repeat_timeout(const button_t *button, uint32_t timeout_ms) {
+        if (timeout_ms < button->config.adaptive_repeat_min_timeout)
+                return button->config.adaptive_repeat_min_timeout;
+        if (timeout_ms > button->config.adaptive_repeat_max_timeout)
+                return button->config.adaptive_repeat_max_timeout;
+        return (uint16_t) timeout_ms;
+}
+
+// Count the gap of a press that followed a repeat window and, with enough
+// gaps counted, move the window to the configured percentile of them. A press
+// shortly after the window closed counts too, so the window can grow again
+// after it shrank too far.
+static void button_learn_gap(button_t *button) {
+        button->gap_pending = false;
+
+        const uint32_t gap_ms = pdTICKS_TO_MS(xTaskGetTickCount() - button->released_at);
+        const uint32_t span = (uint32_t) button->config.adaptive_repeat_max_timeout + 1;
+        if (gap_ms >= span)
+                return;
+
+        button->gap_histogram[gap_ms * BUTTON_GAP_BUCKETS / span]++;
+        if (++button->gap_samples >= BUTTON_GAP_MAX_SAMPLES) {
+                button->gap_samples = 0;
+                for (size_t i = 0; i < BUTTON_GAP_BUCKETS; i++) {
+                        button->gap_histogram[i] /= 2;
+                        button->gap_samples += button->gap_histogram[i];
+                }
+        }
+
+        if (button->gap_samples < BUTTON_GAP_MIN_SAMPLES)
+                return;
+
+        const uint32_t target = ((uint32_t) button->gap_samples * button->config.adaptive_repeat_percentile + 99) / 100;
+        uint32_t seen = 0;
+        size_t bucket = 0;
+        while (bucket < BUTTON_GAP_BUCKETS - 1) {
+                seen += button->gap_histogram[bucket];
+                if (seen >= target)
+                        break;
+                bucket++;
+        }
+
+        // Upper edge of the bucket, so the gaps counted in it fit the window.
+        const uint32_t window = (uint32_t) (bucket + 1) * span / BUTTON_GAP_BUCKETS;
+        atomic_store_explicit(&button->repeat_timeout, button_clamp_repeat_timeout(button, window),
+                              memory_order_relaxed);
+}
+
+static bool button_level_pressed(const button_t *button, bool high) {
+        return high == (button->config.active_level == button_active_high);
+}
+
+static void button_handle_level(button_t *button, bool high) {
+        const bool pressed = button_level_pressed(button, high);
 
         if (pressed) {
+                if (button->gap_pending)
+                        button_learn_gap(button);
+
                 if (button->press_count < button->config.max_repeat_presses) {
                         button->press_count++;
                 } else {
                         button->press_count = button->config.max_repeat_presses;
                 }
 
+                if (button->single_press_reported && button->press_count > 1) {
+                        button->single_press_reported = false;
+                        button_dispatch(button, button_event_single_press_revoked, 1);
+                }
+
                 if (button->event_timer && button->timer_mode == button_timer_mode_repeat_window) {
                         if (xTimerIsTimerActive(button->event_timer)) {
                                 xTimerStop(button->event_timer, 0);
@@ -78,24 +627,40 @@ static void button_toggle_callback(bool high, void *context) {
 
                 if (button->event_timer && button->config.long_press_time && button->press_count == 1) {
                         button->timer_mode = button_timer_mode_long_press;
+                        button->hold_tier = 0;
                         TickType_t ticks = button_ms_to_ticks(button->config.long_press_time);
                         if (ticks) {
                                 xTimerChangePeriod(button->event_timer, ticks, 0);
                         }
                 }
+
+                // Nothing else times this press; watch it for a stuck contact.
+                if (button->timer_mode == button_timer_mode_idle)
+                        button_stuck_watch(button, 0);
         } else {
+                if (button->timer_mode == button_timer_mode_boot_hold)
+                        button_boot_hold_report(button);
+
+                if (button->hold_tier || button->boot_hold) {
+                        button->boot_hold = false;
+                        button_hold_released(button);
+                        return;
+                }
+
                 if (!button->press_count)
                         return;
 
-                if (button->event_timer && button->timer_mode == button_timer_mode_long_press
+                if (button->event_timer
+                    && (button->timer_mode == button_timer_mode_long_press
+                        || button->timer_mode == button_timer_mode_stuck)
                     && xTimerIsTimerActive(button->event_timer)) {
                         xTimerStop(button->event_timer, 0);
                         button->timer_mode = button_timer_mode_idle;
                 }
 
                 const bool reached_limit = button->press_count >= button->config.max_repeat_presses;
-                const bool repeat_disabled = (!button->config.repeat_press_timeout
-                                               || button->config.max_repeat_presses <= 1);
+                const uint16_t repeat_timeout = atomic_load_explicit(&button->repeat_timeout, memory_order_relaxed);
+                const bool repeat_disabled = (!repeat_timeout || button->config.max_repeat_presses <= 1);
 
                 if (reached_limit || repeat_disabled || !button->event_timer) {
                         if (button->event_timer && xTimerIsTimerActive(button->event_timer)) {
@@ -104,7 +669,7 @@ static void button_toggle_callback(bool high, void *context) {
                         button->timer_mode = button_timer_mode_idle;
                         button_fire_event(button);
                 } else {
-                        TickType_t ticks = button_ms_to_ticks(button->config.repeat_press_timeout);
+                        TickType_t ticks = button_ms_to_ticks(repeat_timeout);
                         if (!ticks) {
                                 if (button->event_timer && xTimerIsTimerActive(button->event_timer)) {
                                         xTimerStop(button->event_timer, 0);
@@ -114,75 +679,231 @@ static void button_toggle_callback(bool high, void *context) {
                         } else {
                                 button->timer_mode = button_timer_mode_repeat_window;
                                 xTimerChangePeriod(button->event_timer, ticks, 0);
+
+                                if (button_adaptive(button)) {
+                                        button->gap_pending = true;
+                                        button->released_at = xTaskGetTickCount();
+                                }
+
+                                if (button->config.speculative_single_press && button->press_count == 1) {
+                                        button->single_press_reported = true;
+                                        button_dispatch(button, button_event_single_press, 1);
+                                }
                         }
                 }
         }
 }
 
+static void button_toggle_callback(bool high, void *context) {
+        button_t *button = (button_t*) context;
+        if (!button || !button_enter(button))
+                return;
+
+        // Before dispatching, so callbacks see the new state.
+        button_set_pressed(button->gpio_num, button_level_pressed(button, high));
+        button_handle_level(button, high);
+        button_leave(button);
+}
+
+static void button_touch_callback(bool touched, void *context) {
+        button_t *button = (button_t*) context;
+        if (!button || !button_enter(button))
+                return;
+
+        // Touch buttons are created active high, so touched is the level.
+        button_set_pressed(button->gpio_num, touched);
+        button_handle_level(button, touched);
+        button_leave(button);
+}
+
 static void button_event_timer_callback(TimerHandle_t timer) {
         button_t *button = (button_t*) pvTimerGetTimerID(timer);
-        if (!button)
+        if (!button || !button_enter(button))
                 return;
 
         switch (button->timer_mode) {
         case button_timer_mode_long_press:
-                button->timer_mode = button_timer_mode_idle;
-                button->callback(button_event_long_press, button->context);
-                button->press_count = 0;
+                button_hold_tier_reached(button);
                 break;
         case button_timer_mode_repeat_window:
                 button->timer_mode = button_timer_mode_idle;
                 button_fire_event(button);
                 break;
+        case button_timer_mode_boot_hold:
+                button_boot_hold_report(button);
+                break;
+        case button_timer_mode_stuck:
+                // The fault callback resets the button once it is reported.
+                button->timer_mode = button_timer_mode_idle;
+                toggle_quarantine(button->gpio_num, toggle_fault_stuck);
+                break;
         default:
                 break;
         }
+
+        button_leave(button);
+}
+
+static button_fault_t button_fault_from_toggle(toggle_fault_t fault) {
+        switch (fault) {
+        case toggle_fault_storm: return button_fault_interrupt_storm;
+        case toggle_fault_stuck: return button_fault_stuck;
+        case toggle_fault_unstable: return button_fault_unstable;
+        default: return button_fault_none;
+        }
+}
+
+static void button_toggle_fault_callback(toggle_fault_t fault, void *context) {
+        button_t *button = (button_t*) context;
+        if (!button || !button_enter(button))
+                return;
+
+        // Whatever was in progress is void; start from scratch after recovery.
+        if (button->event_timer && xTimerIsTimerActive(button->event_timer)) {
+                xTimerStop(button->event_timer, 0);
+        }
+        button->timer_mode = button_timer_mode_idle;
+        button->press_count = 0;
+        button->single_press_reported = false;
+        button->gap_pending = false;
+        button->hold_tier = 0;
+        button->boot_hold = false;
+        button_set_pressed(button->gpio_num, false);
+
+        if (fault == toggle_fault_none) {
+                button_dispatch(button, button_event_fault_cleared, button_fault_none);
+        } else {
+                button_dispatch(button, button_event_fault, button_fault_from_toggle(fault));
+        }
+
+        button_leave(button);
+}
+
+static void button_encoder_callback(int32_t steps, void *context) {
+        button_t *button = (button_t*) context;
+        if (!button || !button_enter(button))
+                return;
+
+        button_dispatch(button, button_event_rotate, steps);
+        button_leave(button);
 }
 
 static void button_reset(button_t *button) {
         if (!button)
                 return;
 
+        const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        const bool timer_task = self == xTimerGetTimerDaemonTaskHandle();
+
+        // The timer task cannot wait for room in its own command queue.
         if (button->event_timer) {
-                xTimerStop(button->event_timer, 0);
-                xTimerDelete(button->event_timer, 0);
+                const TickType_t block = timer_task ? 0 : portMAX_DELAY;
+                if (xTimerStop(button->event_timer, block) != pdPASS
+                    || xTimerDelete(button->event_timer, block) != pdPASS)
+                        ESP_LOGE(TAG, "Failed to delete event timer of GPIO %d", (int) button->gpio_num);
                 button->event_timer = NULL;
         }
 
-        button->timer_mode = button_timer_mode_idle;
-        button->press_count = 0;
-        memset(button, 0, sizeof(*button));
+        // Wait for callbacks still running in the timer task or dispatcher.
+        // Each of them only counts in its own field, busy or dispatch_busy,
+        // while it runs a callback of this button; when that callback is us,
+        // it does not touch the button after returning to us. A callback
+        // destroying another button still waits for that button's callbacks
+        // in the other task.
+        const bool dispatcher = self == atomic_load(&dispatcher_task);
+        for (;;) {
+                portENTER_CRITICAL(&button->lock);
+                if ((timer_task || !button->busy) && (dispatcher || !button->dispatch_busy))
+                        break;
+                portEXIT_CRITICAL(&button->lock);
+                vTaskDelay(1);
+        }
+
+        // Cleared under the lock, so subscribe and the like, which may be
+        // waiting for it, find the button inactive rather than half reset.
+        memset((char *) button + offsetof(button_t, gpio_num), 0,
+               sizeof(*button) - offsetof(button_t, gpio_num));
+        portEXIT_CRITICAL(&button->lock);
 }
 
-static int buttons_init() {
-        if (!buttons_lock) {
-                buttons_lock = xSemaphoreCreateMutex();
-                if (!buttons_lock) {
-                        ESP_LOGE(TAG, "Failed to create button lock");
+
+
+// Take the boot capture of the pin, if there is one. Only the first button
+// created on the pin after the capture gets it.
+static bool button_boot_claim(gpio_num_t gpio_num, bool *high) {
+        const uint32_t bit = 1u << ((size_t) gpio_num % 32);
+        const uint32_t pending = atomic_fetch_and_explicit(&boot_pending[(size_t) gpio_num / 32], ~bit,
+                                                           memory_order_acquire);
+        if (!(pending & bit))
+                return false;
+
+        *high = (boot_levels >> (uint32_t) gpio_num) & 1u;
+        return true;
+}
+
+// Number of long press tiers in the configuration, or -1 if the thresholds are
+// not ascending.
+static int button_hold_tier_count(const button_config_t *config) {
+        if (!config->long_press_time)
+                return config->long_press_tier_times[0] ? -1 : 0;
+
+        int count = 1;
+        uint16_t previous = config->long_press_time;
+        for (size_t i = 0; i < BUTTON_MAX_HOLD_TIERS - 1 && config->long_press_tier_times[i]; i++) {
+                if (config->long_press_tier_times[i] <= previous)
                         return -1;
-                }
+
+                previous = config->long_press_tier_times[i];
+                count++;
+        }
+
+        return count;
+}
+
+// Tasks creating their first buttons at the same time may each create a
+// mutex; one is published, the others are deleted again.
+static int buttons_init() {
+        if (atomic_load_explicit(&buttons_lock, memory_order_acquire))
+                return 0;
+
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        if (!lock) {
+                ESP_LOGE(TAG, "Failed to create button lock");
+                return -1;
         }
 
+        SemaphoreHandle_t expected = NULL;
+        if (!atomic_compare_exchange_strong_explicit(&buttons_lock, &expected, lock,
+                                                     memory_order_acq_rel, memory_order_acquire))
+                vSemaphoreDelete(lock);
+
         return 0;
 }
 
-// Check if the button with the given GPIO already exists
-int button_create(const gpio_num_t gpio_num,
-                  button_config_t config,
-                  button_callback_fn callback,
-                  void* context)
+// Creates a button fed by the GPIO, or by the touch pad on it when touch is
+// set.
+static int button_create_input(const gpio_num_t gpio_num,
+                               button_config_t config,
+                               const button_touch_config_t *touch,
+                               button_callback_fn callback,
+                               void* context)
 {
         if (!GPIO_IS_VALID_GPIO(gpio_num)) {
                 ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
                 return -5;
         }
 
+        if (touch && my_touch_channel(gpio_num) < 0) {
+                ESP_LOGE(TAG, "GPIO %d has no touch channel", (int) gpio_num);
+                return -5;
+        }
+
         if (!callback) {
                 ESP_LOGE(TAG, "Callback must not be NULL for GPIO %d", (int) gpio_num);
                 return -6;
         }
 
-        if (!buttons_lock && buttons_init() != 0) {
+        if (buttons_init() != 0) {
                 return -7;
         }
 
@@ -190,6 +911,28 @@ int button_create(const gpio_num_t gpio_num,
         if (!normalized.max_repeat_presses) {
                 normalized.max_repeat_presses = 1;
         }
+        if (touch) {
+                normalized.active_level = button_active_high;
+        }
+
+        const int hold_tier_count = button_hold_tier_count(&normalized);
+        if (hold_tier_count < 0) {
+                ESP_LOGE(TAG, "Long press tiers must be ascending for GPIO %d", (int) gpio_num);
+                return -3;
+        }
+
+        if ((unsigned) normalized.priority >= BUTTON_PRIORITY_CLASSES) {
+                ESP_LOGE(TAG, "Unknown priority %d for GPIO %d", (int) normalized.priority, (int) gpio_num);
+                return -3;
+        }
+
+        if (normalized.adaptive_repeat_percentile
+            && (normalized.adaptive_repeat_percentile > 100
+                || !normalized.adaptive_repeat_max_timeout
+                || normalized.adaptive_repeat_min_timeout > normalized.adaptive_repeat_max_timeout)) {
+                ESP_LOGE(TAG, "Invalid adaptive repeat window for GPIO %d", (int) gpio_num);
+                return -3;
+        }
 
         const size_t index = (size_t) gpio_num;
         button_t *button = &button_pool[index];
@@ -208,13 +951,26 @@ int button_create(const gpio_num_t gpio_num,
         button->config = normalized;
         button->callback = callback;
         button->context = context;
+        button->touch = touch != NULL;
+        button->hold_tier_count = (uint8_t) hold_tier_count;
         button->timer_mode = button_timer_mode_idle;
+        atomic_store(&button->repeat_timeout, button_adaptive(button)
+                     ? button_clamp_repeat_timeout(button, normalized.repeat_press_timeout)
+                     : normalized.repeat_press_timeout);
 
-        const bool needs_timer = (normalized.long_press_time > 0)
-                || (normalized.max_repeat_presses > 1 && normalized.repeat_press_timeout > 0);
+        bool boot_high = false;
+        const bool boot_held = !touch
+                && button_boot_claim(gpio_num, &boot_high)
+                && button_level_pressed(button, boot_high);
+
+        const bool needs_timer = boot_held
+                || (normalized.long_press_time > 0)
+                || (normalized.stuck_press_seconds > 0 && !touch)
+                || (normalized.max_repeat_presses > 1
+                    && (normalized.repeat_press_timeout > 0 || normalized.adaptive_repeat_percentile));
 
         int result = -4;
-        bool toggle_ready = false;
+        bool input_ready = false;
 
         if (needs_timer) {
                 button->event_timer = xTimerCreateStatic(
@@ -232,70 +988,667 @@ int button_create(const gpio_num_t gpio_num,
                 }
         }
 
-        result = toggle_create(gpio_num, button_toggle_callback, button);
-        if (result) {
-                result = (result == -1) ? -1 : -4;
-                goto fail;
-        }
-        toggle_ready = true;
+        bool pressed = false;
 
-        if (normalized.active_level == button_active_low) {
-                my_gpio_pullup(button->gpio_num);
+        if (touch) {
+                touch_config_t touch_config = touch_config_default();
+                touch_config.touch_threshold_permille = touch->touch_threshold_permille;
+                touch_config.release_threshold_permille = touch->release_threshold_permille;
+                touch_config.baseline_shift = touch->baseline_shift;
+                touch_config.confirm_samples = touch->confirm_samples;
+
+                result = touch_create(gpio_num, &touch_config, button_touch_callback, button);
+                if (result) {
+                        result = (result == -1) ? -1 : -4;
+                        goto fail;
+                }
+                input_ready = true;
         } else {
-                my_gpio_pulldown(button->gpio_num);
+                toggle_config_t toggle_config = toggle_config_default();
+                toggle_config.debounce_ms = normalized.debounce_time;
+                toggle_config.glitch_filter_ns = normalized.glitch_filter_ns;
+                toggle_config.mask_during_debounce = normalized.mask_interrupt_while_debouncing;
+                toggle_config.storm_edge_limit = normalized.storm_edge_limit;
+                toggle_config.storm_window_ms = normalized.storm_window;
+                toggle_config.storm_recheck_ms = normalized.storm_recheck_time;
+                toggle_config.unstable_window_ms = normalized.unstable_window;
+                toggle_config.fault_callback = button_toggle_fault_callback;
+                toggle_config.edge_callback = button_edge_isr;
+
+                result = toggle_create_with_config(gpio_num, &toggle_config, button_toggle_callback, button);
+                if (result) {
+                        result = (result == -1) ? -1 : -4;
+                        goto fail;
+                }
+                input_ready = true;
+
+                if (normalized.active_level == button_active_low) {
+                        my_gpio_pullup(button->gpio_num);
+                } else {
+                        my_gpio_pulldown(button->gpio_num);
+                }
+
+                toggle_sync_state(button->gpio_num);
+                pressed = button_level_pressed(button, toggle_is_high(button->gpio_num));
         }
+        button_set_pressed(button->gpio_num, pressed);
 
-        toggle_sync_state(button->gpio_num);
+        // Still held since boot: the timer task reports it, in order with the
+        // events that follow.
+        if (boot_held && pressed) {
+                button->boot_hold = true;
+                button->timer_mode = button_timer_mode_boot_hold;
+        }
 
+        // Under the registry lock, like the deactivation in button_destroy, so
+        // a concurrent destroy cannot reset the slot before the timer is armed.
         xSemaphoreTake(buttons_lock, portMAX_DELAY);
-        registered_buttons[index] = button;
-        button_claimed[index] = true;
+        button_activate(button);
+        if (button->boot_hold)
+                xTimerChangePeriod(button->event_timer, 1, 0);
         xSemaphoreGive(buttons_lock);
 
         return 0;
 
 fail:
-        if (toggle_ready) {
+        if (input_ready && touch) {
+                touch_delete(button->gpio_num);
+        } else if (input_ready) {
                 toggle_delete(button->gpio_num);
         }
 
         button_reset(button);
 
         xSemaphoreTake(buttons_lock, portMAX_DELAY);
-        registered_buttons[index] = NULL;
         button_claimed[index] = false;
         xSemaphoreGive(buttons_lock);
 
         return result;
 }
 
+int button_create(const gpio_num_t gpio_num,
+                  button_config_t config,
+                  button_callback_fn callback,
+                  void* context)
+{
+        return button_create_input(gpio_num, config, NULL, callback, context);
+}
+
+int button_touch_create(const gpio_num_t gpio_num,
+                        button_config_t config,
+                        button_touch_config_t touch,
+                        button_callback_fn callback,
+                        void* context)
+{
+        return button_create_input(gpio_num, config, &touch, callback, context);
+}
+
+int button_encoder_create(const gpio_num_t gpio_a,
+                          const gpio_num_t gpio_b,
+                          button_encoder_config_t config,
+                          button_callback_fn callback,
+                          void* context)
+{
+        if (!GPIO_IS_VALID_GPIO(gpio_a) || !GPIO_IS_VALID_GPIO(gpio_b) || gpio_a == gpio_b) {
+                ESP_LOGE(TAG, "Invalid encoder GPIO numbers: %d, %d", (int) gpio_a, (int) gpio_b);
+                return -5;
+        }
+
+        if (!callback) {
+                ESP_LOGE(TAG, "Callback must not be NULL for GPIO %d", (int) gpio_a);
+                return -6;
+        }
+
+        if (buttons_init() != 0) {
+                return -7;
+        }
+
+        const size_t index = (size_t) gpio_a;
+        const size_t index_b = (size_t) gpio_b;
+        button_t *button = &button_pool[index];
+
+        xSemaphoreTake(buttons_lock, portMAX_DELAY);
+        if (button_claimed[index] || button_claimed[index_b]) {
+                xSemaphoreGive(buttons_lock);
+                return -1;
+        }
+        button_claimed[index] = true;
+        button_claimed[index_b] = true;
+        xSemaphoreGive(buttons_lock);
+
+        button_reset(button);
+
+        button->gpio_num = gpio_a;
+        button->config = button_config_default(config.active_level);
+        button->callback = callback;
+        button->context = context;
+        button->encoder = true;
+        button->encoder_gpio_b = gpio_b;
+
+        encoder_config_t encoder_config = encoder_config_default();
+        encoder_config.pull = (config.active_level == button_active_low) ? encoder_pull_up : encoder_pull_down;
+        encoder_config.transitions_per_step = config.transitions_per_step;
+        encoder_config.report_interval_ms = config.report_interval;
+        encoder_config.acceleration_threshold = config.acceleration_threshold;
+        encoder_config.acceleration_max = config.acceleration_max;
+
+        int result = encoder_create(gpio_a, gpio_b, &encoder_config, button_encoder_callback, button);
+        if (result) {
+                result = (result == -1) ? -1 : -4;
+
+                button_reset(button);
+
+                xSemaphoreTake(buttons_lock, portMAX_DELAY);
+                button_claimed[index] = false;
+                button_claimed[index_b] = false;
+                xSemaphoreGive(buttons_lock);
+
+                return result;
+        }
+
+        button_activate(button);
+
+        return 0;
+}
+
 void button_destroy(const gpio_num_t gpio_num) {
         if (!GPIO_IS_VALID_GPIO(gpio_num)) {
                 ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
                 return;
         }
 
-        if (!buttons_lock && buttons_init() != 0) {
+        if (buttons_init() != 0) {
                 return;
         }
 
-        button_t *button = NULL;
         const size_t index = (size_t) gpio_num;
+        button_t *button = &button_pool[index];
 
+        // Deactivating under the registry lock makes exactly one concurrent
+        // destroy proceed; the slot stays claimed until it is reset.
         xSemaphoreTake(buttons_lock, portMAX_DELAY);
+        portENTER_CRITICAL(&button->lock);
+        const bool active = button->active;
+        button->active = false;
+        portEXIT_CRITICAL(&button->lock);
+        xSemaphoreGive(buttons_lock);
 
-        button = registered_buttons[index];
-        if (!button) {
-                xSemaphoreGive(buttons_lock);
+        if (!active)
                 return;
-        }
 
-        registered_buttons[index] = NULL;
+        const bool encoder = button->encoder;
+        const gpio_num_t encoder_gpio_b = button->encoder_gpio_b;
 
-        toggle_delete(button->gpio_num);
+        if (encoder) {
+                encoder_delete(gpio_num);
+        } else if (button->touch) {
+                touch_delete(gpio_num);
+        } else {
+                toggle_delete(gpio_num);
+        }
         button_reset(button);
+        button_set_pressed(gpio_num, false);
 
+        xSemaphoreTake(buttons_lock, portMAX_DELAY);
         button_claimed[index] = false;
+        if (encoder)
+                button_claimed[(size_t) encoder_gpio_b] = false;
+        xSemaphoreGive(buttons_lock);
+}
+
+uint64_t button_get_pressed_mask(uint32_t *generation) {
+        uint64_t mask;
+        uint32_t sequence;
+
+        for (;;) {
+                sequence = atomic_load_explicit(&pressed_sequence, memory_order_acquire);
+                if (sequence & 1)
+                        continue;
+
+                mask = 0;
+                for (size_t i = 0; i < BUTTON_PRESSED_WORDS; i++) {
+                        mask |= (uint64_t) atomic_load_explicit(&pressed_words[i], memory_order_relaxed) << (32 * i);
+                }
+
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit(&pressed_sequence, memory_order_relaxed) == sequence)
+                        break;
+        }
+
+        if (generation)
+                *generation = sequence / 2;
+
+        return mask;
+}
+
+bool button_is_pressed(const gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return false;
+
+        const uint32_t word = atomic_load_explicit(&pressed_words[(size_t) gpio_num / 32], memory_order_acquire);
+        return (word >> ((size_t) gpio_num % 32)) & 1u;
+}
+
+int32_t button_encoder_get_position(const gpio_num_t gpio_a) {
+        return encoder_get_position(gpio_a);
+}
+
+int32_t button_encoder_get_velocity(const gpio_num_t gpio_a) {
+        return encoder_get_velocity(gpio_a);
+}
+
+
+button_fault_t button_get_fault(const gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return button_fault_none;
+
+        return button_fault_from_toggle(toggle_get_fault(gpio_num));
+}
+
+int button_get_capture_stats(const gpio_num_t gpio_num, button_capture_stats_t *stats, bool reset) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return -1;
+
+        toggle_capture_stats_t capture;
+        if (toggle_get_capture_stats(gpio_num, &capture, reset))
+                return -1;
+
+        if (stats) {
+                *stats = (button_capture_stats_t) {
+                        .captured = capture.captured,
+                        .captured_during_flash = capture.captured_during_flash,
+                        .overflows = capture.overflows,
+                        .max_latency_us = capture.max_latency_us,
+                        .max_flash_latency_us = capture.max_flash_latency_us,
+                };
+        }
+
+        return 0;
+}
+
+int button_boot_capture(uint64_t active_low_mask, uint64_t active_high_mask) {
+        const uint64_t mask = active_low_mask | active_high_mask;
+        if (active_low_mask & active_high_mask) {
+                ESP_LOGE(TAG, "Boot capture pins cannot be both active low and high");
+                return -5;
+        }
+        for (uint64_t pending = mask; pending; pending &= pending - 1) {
+                const gpio_num_t gpio_num = (gpio_num_t) __builtin_ctzll(pending);
+                if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                        ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                        return -5;
+                }
+        }
+
+        boot_levels = my_gpio_boot_latch(active_low_mask, active_high_mask);
+        boot_capture_us = my_time_us_from_isr();
+        for (size_t i = 0; i < BUTTON_PRESSED_WORDS; i++)
+                atomic_store_explicit(&boot_pending[i], (uint32_t) (mask >> (32 * i)), memory_order_release);
+
+        return 0;
+}
+
+int button_touch_get_counts(const gpio_num_t gpio_num, uint32_t *raw, uint32_t *baseline) {
+        return touch_get_counts(gpio_num, raw, baseline);
+}
+
+int button_get_learned_repeat_timeout(const gpio_num_t gpio_num, uint16_t *timeout_ms) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return -1;
+
+        button_t *button = &button_pool[(size_t) gpio_num];
+
+        portENTER_CRITICAL(&button->lock);
+        const bool active = button->active;
+        const uint16_t timeout = atomic_load_explicit(&button->repeat_timeout, memory_order_relaxed);
+        portEXIT_CRITICAL(&button->lock);
+
+        if (!active)
+                return -1;
+        if (timeout_ms)
+                *timeout_ms = timeout;
+        return 0;
+}
+
+int button_set_learned_repeat_timeout(const gpio_num_t gpio_num, uint16_t timeout_ms) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return -1;
+
+        button_t *button = &button_pool[(size_t) gpio_num];
+        int result = -1;
+
+        portENTER_CRITICAL(&button->lock);
+        if (button->active) {
+                result = -3;
+                if (button_adaptive(button)) {
+                        atomic_store_explicit(&button->repeat_timeout, button_clamp_repeat_timeout(button, timeout_ms),
+                                              memory_order_relaxed);
+                        result = 0;
+                }
+        }
+        portEXIT_CRITICAL(&button->lock);
+
+        return result;
+}
+
+static void button_subscribers_update_mask(button_t *button) {
+        button_event_mask_t mask = 0;
+        for (size_t i = 0; i < button->subscriber_count; i++) {
+                mask |= button->subscribers[i].event_mask;
+        }
+        button->subscriber_mask = mask;
+}
+
+static bool button_subscribers_remove(button_t *button, button_subscriber_fn callback, void* context) {
+        for (size_t i = 0; i < button->subscriber_count; i++) {
+                if (button->subscribers[i].callback == callback && button->subscribers[i].context == context) {
+                        memmove(&button->subscribers[i], &button->subscribers[i + 1],
+                                (button->subscriber_count - i - 1) * sizeof(button->subscribers[0]));
+                        button->subscriber_count--;
+                        return true;
+                }
+        }
+
+        return false;
+}
 
+int button_subscribe(const gpio_num_t gpio_num,
+                     button_event_mask_t event_mask,
+                     uint8_t priority,
+                     button_subscriber_fn callback,
+                     void* context)
+{
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return -5;
+        }
+
+        if (!callback) {
+                ESP_LOGE(TAG, "Subscriber callback must not be NULL for GPIO %d", (int) gpio_num);
+                return -6;
+        }
+
+        if (!event_mask)
+                return -3;
+
+        button_t *button = &button_pool[(size_t) gpio_num];
+
+        portENTER_CRITICAL(&button->lock);
+
+        if (!button->active) {
+                portEXIT_CRITICAL(&button->lock);
+                return -1;
+        }
+
+        button_subscribers_remove(button, callback, context);
+
+        if (button->subscriber_count >= BUTTON_MAX_SUBSCRIBERS) {
+                button_subscribers_update_mask(button);
+                portEXIT_CRITICAL(&button->lock);
+                ESP_LOGE(TAG, "No free subscriber slot for button on GPIO %d", (int) gpio_num);
+                return -2;
+        }
+
+        size_t position = button->subscriber_count;
+        while (position > 0 && button->subscribers[position - 1].priority < priority) {
+                button->subscribers[position] = button->subscribers[position - 1];
+                position--;
+        }
+
+        button->subscribers[position] = (button_subscriber_t) {
+                .callback = callback,
+                .context = context,
+                .event_mask = event_mask,
+                .priority = priority,
+        };
+        button->subscriber_count++;
+        button_subscribers_update_mask(button);
+
+        portEXIT_CRITICAL(&button->lock);
+
+        return 0;
+}
+
+int button_unsubscribe(const gpio_num_t gpio_num,
+                       button_subscriber_fn callback,
+                       void* context)
+{
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return -5;
+        }
+
+        int result = -1;
+        button_t *button = &button_pool[(size_t) gpio_num];
+
+        portENTER_CRITICAL(&button->lock);
+        if (button->active && button_subscribers_remove(button, callback, context)) {
+                button_subscribers_update_mask(button);
+                result = 0;
+        }
+        portEXIT_CRITICAL(&button->lock);
+
+        return result;
+}
+
+
+int button_dispatcher_enable(void) {
+        if (atomic_load_explicit(&dispatcher_enabled, memory_order_acquire))
+                return 0;
+
+        if (buttons_init() != 0)
+                return -1;
+
+        int result = 0;
+        xSemaphoreTake(buttons_lock, portMAX_DELAY);
+        if (!atomic_load_explicit(&dispatcher_enabled, memory_order_relaxed)) {
+                const UBaseType_t pending = BUTTON_DISPATCH_QUEUE_LENGTH * button_priority_critical;
+                dispatch_queues[button_priority_normal] = xQueueCreate(BUTTON_DISPATCH_QUEUE_LENGTH, sizeof(button_dispatch_item_t));
+                dispatch_queues[button_priority_high] = xQueueCreate(BUTTON_DISPATCH_QUEUE_LENGTH, sizeof(button_dispatch_item_t));
+                dispatch_pending = xSemaphoreCreateCounting(pending, 0);
+
+                if (dispatch_queues[button_priority_normal] && dispatch_queues[button_priority_high] && dispatch_pending) {
+                        atomic_store_explicit(&dispatcher_enabled, true, memory_order_release);
+                } else {
+                        ESP_LOGE(TAG, "Failed to create event dispatcher queues");
+                        for (size_t i = 0; i < button_priority_critical; i++) {
+                                if (dispatch_queues[i])
+                                        vQueueDelete(dispatch_queues[i]);
+                                dispatch_queues[i] = NULL;
+                        }
+                        if (dispatch_pending)
+                                vSemaphoreDelete(dispatch_pending);
+                        dispatch_pending = NULL;
+                        result = -1;
+                }
+        }
         xSemaphoreGive(buttons_lock);
+
+        return result;
+}
+
+int button_dispatcher_run(TickType_t ticks_to_wait) {
+        if (!atomic_load_explicit(&dispatcher_enabled, memory_order_acquire))
+                return -1;
+
+        atomic_store(&dispatcher_task, xTaskGetCurrentTaskHandle());
+
+        int delivered = 0;
+        TickType_t wait = ticks_to_wait;
+        while (xSemaphoreTake(dispatch_pending, wait) == pdTRUE) {
+                wait = 0;
+
+                button_dispatch_item_t item;
+                if (xQueueReceive(dispatch_queues[button_priority_high], &item, 0) != pdTRUE
+                    && xQueueReceive(dispatch_queues[button_priority_normal], &item, 0) != pdTRUE)
+                        continue;
+
+                button_t *button = &button_pool[(size_t) item.gpio_num];
+                if (!button_enter_generation(button, item.generation))
+                        continue;
+
+                button_deliver(button, item.event, item.value, item.detected_us);
+                button_leave_generation(button);
+                delivered++;
+        }
+
+        return delivered;
+}
+
+static void button_dispatcher_task(void *arg) {
+        (void) arg;
+
+        for (;;)
+                button_dispatcher_run(portMAX_DELAY);
+}
+
+int button_dispatcher_start(UBaseType_t task_priority, uint32_t stack_depth) {
+        if (button_dispatcher_enable() != 0)
+                return -1;
+
+        if (atomic_load(&dispatcher_task))
+                return 0;
+
+        TaskHandle_t task = NULL;
+        if (xTaskCreate(button_dispatcher_task, "button dispatch", stack_depth, NULL, task_priority, &task) != pdPASS) {
+                ESP_LOGE(TAG, "Failed to create event dispatcher task");
+                return -2;
+        }
+        atomic_store(&dispatcher_task, task);
+
+        return 0;
+}
+
+int button_get_priority_stats(button_priority_t priority, button_priority_stats_t *stats, bool reset) {
+        if ((unsigned) priority >= BUTTON_PRIORITY_CLASSES)
+                return -1;
+
+        portENTER_CRITICAL(&dispatch_stats_lock);
+        if (stats)
+                *stats = dispatch_stats[priority];
+        if (reset)
+                memset(&dispatch_stats[priority], 0, sizeof(dispatch_stats[priority]));
+        portEXIT_CRITICAL(&dispatch_stats_lock);
+
+        return 0;
+}
+
+
+static bool button_reflex_valid(gpio_num_t gpio_num, const button_reflex_t *reflex) {
+        switch (reflex->action) {
+        case button_reflex_output_high:
+        case button_reflex_output_low:
+        case button_reflex_output_toggle:
+                return GPIO_IS_VALID_OUTPUT_GPIO(reflex->output) && reflex->output != gpio_num;
+        case button_reflex_give_semaphore:
+                return reflex->semaphore != NULL;
+        case button_reflex_notify_task:
+                return reflex->task != NULL;
+        default:
+                return false;
+        }
+}
+
+static bool button_reflex_is_output(const button_reflex_t *reflex) {
+        return reflex->action == button_reflex_output_high
+                || reflex->action == button_reflex_output_low
+                || reflex->action == button_reflex_output_toggle;
+}
+
+// Checks the button can take another reflex. Called with the button lock held.
+static int button_reflex_slot_check(const button_t *button, bool leading_edge) {
+        if (!button->active)
+                return -1;
+        if (leading_edge && (button->encoder || button->touch))
+                return -4;
+        if (button->reflex_count >= BUTTON_MAX_REFLEXES)
+                return -2;
+
+        return 0;
+}
+
+static int button_reflex_add(const gpio_num_t gpio_num,
+                             button_event_mask_t event_mask,
+                             bool leading_edge,
+                             const button_reflex_t *reflex)
+{
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return -5;
+        }
+
+        if (!leading_edge && !event_mask)
+                return -3;
+
+        if (!button_reflex_valid(gpio_num, reflex)) {
+                ESP_LOGE(TAG, "Invalid reflex action %d for GPIO %d", (int) reflex->action, (int) gpio_num);
+                return -3;
+        }
+
+        button_t *button = &button_pool[(size_t) gpio_num];
+
+        // Checked before the output is configured, and again once it is,
+        // since no driver call is made while holding the lock.
+        portENTER_CRITICAL(&button->lock);
+        int result = button_reflex_slot_check(button, leading_edge);
+        portEXIT_CRITICAL(&button->lock);
+
+        if (!result && button_reflex_is_output(reflex))
+                my_gpio_output(reflex->output);
+
+        if (!result) {
+                portENTER_CRITICAL(&button->lock);
+                result = button_reflex_slot_check(button, leading_edge);
+                if (!result) {
+                        button->reflexes[button->reflex_count++] = (button_reflex_binding_t) {
+                                .event_mask = leading_edge ? 0 : event_mask,
+                                .leading_edge = leading_edge,
+                                .reflex = *reflex,
+                        };
+                        button->reflex_mask |= event_mask;
+                        if (leading_edge)
+                                atomic_fetch_add_explicit(&button->edge_reflexes, 1, memory_order_relaxed);
+                }
+                portEXIT_CRITICAL(&button->lock);
+        }
+
+        if (result == -2) {
+                ESP_LOGE(TAG, "No free reflex slot for button on GPIO %d", (int) gpio_num);
+        } else if (result == -4) {
+                ESP_LOGE(TAG, "Button on GPIO %d has no GPIO interrupt for a leading edge reflex", (int) gpio_num);
+        }
+
+        return result;
+}
+
+int button_reflex_bind(const gpio_num_t gpio_num,
+                       button_event_mask_t event_mask,
+                       button_reflex_t reflex)
+{
+        return button_reflex_add(gpio_num, event_mask, false, &reflex);
+}
+
+int button_reflex_bind_edge(const gpio_num_t gpio_num, button_reflex_t reflex) {
+        return button_reflex_add(gpio_num, 0, true, &reflex);
+}
+
+int button_reflex_clear(const gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return -5;
+        }
+
+        int result = -1;
+        button_t *button = &button_pool[(size_t) gpio_num];
+
+        portENTER_CRITICAL(&button->lock);
+        if (button->active) {
+                button->reflex_count = 0;
+                button->reflex_mask = 0;
+                atomic_store_explicit(&button->edge_reflexes, 0, memory_order_relaxed);
+                result = 0;
+        }
+        portEXIT_CRITICAL(&button->lock);
+
+        return result;
 }
@@ -4,13 +4,37 @@
 #pragma once
 
 #include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef enum {
         button_active_low = 0,
         button_active_high = 1,
 } button_active_level_t;
 
+// Number of long press tiers, including the one of long_press_time.
+#define BUTTON_MAX_HOLD_TIERS 4
+
+// Delivery class of the events of a button. Only matters once the event
+// dispatcher is enabled; until then every event is delivered from the timer
+// task as it is detected.
+typedef enum {
+        // Queued, delivered by the dispatcher after all pending high events.
+        button_priority_normal = 0,
+        // Queued, delivered by the dispatcher ahead of every normal event.
+        button_priority_high,
+        // Never queued: delivered from the timer task as soon as it is detected.
+        button_priority_critical,
+} button_priority_t;
+
+#define BUTTON_PRIORITY_CLASSES 3
+
 typedef struct {
         button_active_level_t active_level;
 
@@ -18,6 +42,55 @@ typedef struct {
         uint16_t long_press_time;
         uint16_t repeat_press_timeout;
         uint16_t max_repeat_presses;
+        // Report a single press as soon as the button is released instead of
+        // after repeat_press_timeout. When another press follows within the
+        // window, button_event_single_press_revoked is emitted on that press
+        // and the multi-press event follows as usual.
+        bool speculative_single_press;
+        // Learn the repeat window from the gaps between a release and the
+        // next press: the window becomes the adaptive_repeat_percentile of
+        // the observed gaps, within adaptive_repeat_min_timeout and
+        // adaptive_repeat_max_timeout. 0 keeps repeat_press_timeout fixed;
+        // repeat_press_timeout is used until enough gaps were observed.
+        uint8_t adaptive_repeat_percentile;
+        uint16_t adaptive_repeat_min_timeout;
+        uint16_t adaptive_repeat_max_timeout;
+
+        // Further hold thresholds after long_press_time, measured from the press
+        // and in ascending order; 0 ends the list. Reaching tier n emits
+        // button_event_long_press_n with n as the event value.
+        uint16_t long_press_tier_times[BUTTON_MAX_HOLD_TIERS - 1];
+        // Emit only the highest long press tier reached, when the button is
+        // released, instead of each tier as its threshold passes.
+        bool long_press_report_on_release;
+
+        // Time in milliseconds the level has to be stable before it is
+        // reported, and width in nanoseconds of the glitches to remove with the
+        // hardware glitch filter of the target (0 disables it). The part of
+        // the window the filter covers is not repeated in software; with a
+        // debounce_time of 0 the filter alone debounces, or the default window
+        // is used where the target has none. Touch pads ignore both.
+        uint16_t debounce_time;
+        uint32_t glitch_filter_ns;
+        // Mask the pin interrupt while debouncing, so a press costs about one
+        // interrupt however much the contact bounces.
+        bool mask_interrupt_while_debouncing;
+        // Quarantine the pin when more than storm_edge_limit edges arrive within
+        // storm_window; 0 disables storm detection. A quarantined pin is probed
+        // again every storm_recheck_time. Reported as button_event_fault.
+        uint16_t storm_edge_limit;
+        uint16_t storm_window;
+        uint16_t storm_recheck_time;
+        // Quarantine a pin that stays pressed for stuck_press_seconds, as a
+        // shorted or jammed contact does, or whose level keeps bouncing for
+        // unstable_window ms without settling. 0 disables either check. The
+        // pin interrupt stays masked while quarantined; a stuck pin is read
+        // once every storm_recheck_time and restored when it is released.
+        // Touch pads and encoders are not checked.
+        uint16_t stuck_press_seconds;
+        uint16_t unstable_window;
+
+        button_priority_t priority;
 } button_config_t;
 
 static inline button_config_t button_config_default(button_active_level_t level)
@@ -27,6 +100,21 @@ static inline button_config_t button_config_default(button_active_level_t level)
                 .long_press_time = 0,
                 .repeat_press_timeout = 300,
                 .max_repeat_presses = 1,
+                .speculative_single_press = false,
+                .adaptive_repeat_percentile = 0,
+                .adaptive_repeat_min_timeout = 150,
+                .adaptive_repeat_max_timeout = 600,
+                .long_press_tier_times = { 0 },
+                .long_press_report_on_release = false,
+                .debounce_time = 10,
+                .glitch_filter_ns = 750,
+                .mask_interrupt_while_debouncing = false,
+                .storm_edge_limit = 0,
+                .storm_window = 1000,
+                .storm_recheck_time = 5000,
+                .stuck_press_seconds = 0,
+                .unstable_window = 0,
+                .priority = button_priority_normal,
         };
 }
 
@@ -35,13 +123,89 @@ typedef enum {
         button_event_double_press,
         button_event_tripple_press,
         button_event_long_press,
+        // The input was quarantined; the event value holds the button_fault_t.
+        button_event_fault,
+        // The input recovered and is reported again.
+        button_event_fault_cleared,
+        // A rotary encoder turned; the event value holds the steps since the
+        // previous rotate event, positive when channel A leads channel B.
+        button_event_rotate,
+        // Held past the further thresholds of long_press_tier_times.
+        button_event_long_press_2,
+        button_event_long_press_3,
+        button_event_long_press_4,
+        // A single press reported by speculative_single_press turned out to
+        // be the start of a multi-press; undo it. The event value is 1.
+        button_event_single_press_revoked,
+        // The button was held when button_boot_capture ran and still is when
+        // it is created; the event value holds the milliseconds since the
+        // capture. Long press tiers follow, timed from the capture, and no
+        // press is reported on release.
+        button_event_held_since_boot,
 } button_event_t;
 
+typedef enum {
+        button_fault_none = 0,
+        button_fault_interrupt_storm,
+        // Pressed for longer than stuck_press_seconds.
+        button_fault_stuck,
+        // No stable level within unstable_window.
+        button_fault_unstable,
+} button_fault_t;
+
 typedef void (*button_callback_fn)(button_event_t event, void* context);
 
+typedef uint32_t button_event_mask_t;
+
+#define BUTTON_EVENT_MASK(event) ((button_event_mask_t) 1u << (event))
+#define BUTTON_EVENT_MASK_ALL ((button_event_mask_t) 0xffffffffu)
+
+// Number of subscribers that can be attached to a single button.
+#ifndef BUTTON_MAX_SUBSCRIBERS
+#define BUTTON_MAX_SUBSCRIBERS 4
+#endif
+
+typedef struct {
+        gpio_num_t gpio_num;
+        button_event_t event;
+        // Number of presses that produced the event, the tier of long press
+        // events, the button_fault_t of fault events or the steps of rotate
+        // events.
+        int32_t value;
+} button_event_info_t;
+
+typedef void (*button_subscriber_fn)(const button_event_info_t *info, void* context);
+
+typedef struct {
+        // Level of the common contact; selects the pull resistors on A and B.
+        button_active_level_t active_level;
+        // Quadrature transitions per step, 4 for most detented encoders.
+        uint8_t transitions_per_step;
+        // times in milliseconds
+        uint16_t report_interval;
+        // Multiply the steps when turning faster than acceleration_threshold
+        // steps per second, up to acceleration_max times. 0 disables it.
+        uint16_t acceleration_threshold;
+        uint8_t acceleration_max;
+} button_encoder_config_t;
+
+static inline button_encoder_config_t button_encoder_config_default(button_active_level_t level)
+{
+        return (button_encoder_config_t) {
+                .active_level = level,
+                .transitions_per_step = 4,
+                .report_interval = 20,
+                .acceleration_threshold = 0,
+                .acceleration_max = 4,
+        };
+}
+
 // Returns 0 on success.
 // -1 if the GPIO is already registered.
 // -2 if timer resources for the button cannot be created.
+// -3 if long_press_tier_times is not ascending or follows a long_press_time of 0,
+//    priority is not a button_priority_t, adaptive_repeat_percentile is above
+//    100 or the adaptive repeat bounds are empty.
 // -4 if the GPIO toggle helper cannot be initialised.
 // -5 if the GPIO number is invalid.
 // -6 if the callback is NULL.
@@ -51,6 +215,229 @@ int button_create(gpio_num_t gpio_num,
                   button_callback_fn callback,
                   void* context);
 
+// Register a rotary encoder on gpio_a and gpio_b. It reports
+// button_event_rotate at most once per report interval while it turns;
+// subscribers receive the steps in the event value. The encoder is a button
+// on gpio_a afterwards: subscribe and destroy it through gpio_a. A push switch
+// on the encoder is a separate button_create.
+// Returns the same codes as button_create; -5 also covers gpio_a == gpio_b.
+int button_encoder_create(gpio_num_t gpio_a,
+                          gpio_num_t gpio_b,
+                          button_encoder_config_t config,
+                          button_callback_fn callback,
+                          void* context);
+
+typedef struct {
+        // Deviation from the baseline that counts as a touch, and below which
+        // the pad is released again, in permille of the baseline.
+        uint16_t touch_threshold_permille;
+        uint16_t release_threshold_permille;
+        // The baseline follows the untouched pad by 1/2^baseline_shift of the
+        // difference per sample.
+        uint8_t baseline_shift;
+        // Samples past a threshold before touch or release is reported.
+        uint8_t confirm_samples;
+} button_touch_config_t;
+
+static inline button_touch_config_t button_touch_config_default(void)
+{
+        return (button_touch_config_t) {
+                .touch_threshold_permille = 100,
+                .release_threshold_permille = 50,
+                .baseline_shift = 4,
+                .confirm_samples = 2,
+        };
+}
+
+// Register the capacitive touch pad on gpio_num as a button. Touch and release
+// feed the same press logic as button_create; active_level and the interrupt
+// options of config do not apply. All pads are sampled together every
+// TOUCH_SAMPLE_INTERVAL_MS by one timer. The pad must not be touched while it
+// is created, its first sample is the baseline.
+// Returns the same codes as button_create; -5 also covers a GPIO without touch
+// channel and -4 invalid thresholds or a touch sensor that cannot be set up.
+int button_touch_create(gpio_num_t gpio_num,
+                        button_config_t config,
+                        button_touch_config_t touch,
+                        button_callback_fn callback,
+                        void* context);
+
+// Latest raw count and baseline of a touch button, for tuning the thresholds.
+// Returns 0, or -1 if no touch button is registered on the GPIO.
+int button_touch_get_counts(gpio_num_t gpio_num, uint32_t *raw, uint32_t *baseline);
+
 void button_destroy(gpio_num_t gpio_num);
 
+// Debounced pressed state of all buttons, bit n for the button on GPIO n.
+// Lock-free and consistent across all bits. When generation is not NULL it
+// receives a counter that changes whenever any bit changed, so pollers can
+// skip work when nothing happened.
+uint64_t button_get_pressed_mask(uint32_t *generation);
+
+// Debounced pressed state of a single button; a single load, lock-free.
+bool button_is_pressed(gpio_num_t gpio_num);
+
+// Sum of the steps reported by the encoder on gpio_a, including acceleration.
+int32_t button_encoder_get_position(gpio_num_t gpio_a);
+
+// Speed of the encoder on gpio_a in steps per second, 0 while it is idle.
+int32_t button_encoder_get_velocity(gpio_num_t gpio_a);
+
+// Returns the fault the input of the button is quarantined for, if any.
+button_fault_t button_get_fault(gpio_num_t gpio_num);
+
+typedef struct {
+        uint32_t captured;
+        uint32_t captured_during_flash;
+        uint32_t overflows;
+        uint32_t max_latency_us;
+        uint32_t max_flash_latency_us;
+} button_capture_stats_t;
+
+// Edge capture statistics of the button when built with
+// CONFIG_BUTTON_IRAM_SAFE: edges captured (during flash operations), edges
+// lost to a full ring, and the worst capture-to-processing latency overall and
+// during flash operations. All zero without the option. With reset set the
+// counters start over. Returns 0, or -1 if the GPIO is not registered.
+int button_get_capture_stats(gpio_num_t gpio_num, button_capture_stats_t *stats, bool reset);
+
+// Latch the level of button pins before they are created, with one read of
+// the input registers, so buttons held at power-on are seen. Call it as early
+// as possible, e.g. first thing in app_main or from a constructor; the pins
+// only get their input and pull resistors enabled. A button created later on
+// a captured pin that was held then and still is emits
+// button_event_held_since_boot. Returns 0, or -5 if a mask holds an invalid
+// GPIO or a pin in both masks.
+int button_boot_capture(uint64_t active_low_mask, uint64_t active_high_mask);
+
+// Repeat window of the button in milliseconds: the learned one for adaptive
+// buttons, repeat_press_timeout otherwise. Returns 0, or -1 if no button is
+// registered on the GPIO.
+int button_get_learned_repeat_timeout(gpio_num_t gpio_num, uint16_t *timeout_ms);
+
+// Seed the repeat window of an adaptive button, e.g. with a value persisted by
+// button_get_learned_repeat_timeout, clamped to the adaptive bounds. Gaps
+// observed afterwards keep refining it. Returns 0, -1 if no button is
+// registered on the GPIO or -3 if the button is not adaptive.
+int button_set_learned_repeat_timeout(gpio_num_t gpio_num, uint16_t timeout_ms);
+
+// Queue length of each dispatcher class. Events that find their queue full
+// are delivered from the timer task instead, unless events of the same button
+// are still queued: then they are dropped, so that a button's events are never
+// delivered out of order.
+#ifndef BUTTON_DISPATCH_QUEUE_LENGTH
+#define BUTTON_DISPATCH_QUEUE_LENGTH 16
+#endif
+
+// Route the events of normal and high priority buttons through the event
+// dispatcher, so slow callbacks no longer hold up the timer task and critical
+// buttons. The application delivers them by calling button_dispatcher_run from
+// one task of its own. Returns 0, or -1 if the queues cannot be created.
+int button_dispatcher_enable(void);
+
+// Deliver queued events, high priority first, waiting up to ticks_to_wait for
+// the first one. Returns the number of events delivered, or -1 when the
+// dispatcher is not enabled.
+int button_dispatcher_run(TickType_t ticks_to_wait);
+
+// button_dispatcher_enable plus a task running button_dispatcher_run. Returns
+// 0, -1 if the queues or -2 if the task cannot be created.
+int button_dispatcher_start(UBaseType_t task_priority, uint32_t stack_depth);
+
+typedef struct {
+        uint32_t delivered;
+        // Events delivered from the timer task because the queue was full.
+        uint32_t overflows;
+        // Events dropped because the queue was full while earlier events of
+        // the same button were still queued.
+        uint32_t dropped;
+        // Microseconds from detecting an event to calling its callback.
+        uint32_t max_latency_us;
+        uint64_t total_latency_us;
+} button_priority_stats_t;
+
+// Delivery statistics of a priority class. With reset set the counters start
+// over. Returns 0, or -1 for an unknown class.
+int button_get_priority_stats(button_priority_t priority, button_priority_stats_t *stats, bool reset);
+
+// Attach an additional listener to a registered button. The listener is only
+// invoked for events whose bit is set in event_mask. Listeners with a higher
+// priority run first; the callback passed to button_create always runs before
+// any subscriber. Subscribing the same callback/context pair again updates its
+// mask and priority.
+// Returns 0 on success.
+// -1 if no button is registered on the GPIO.
+// -2 if the subscriber table of the button is full.
+// -3 if the event mask is empty.
+// -5 if the GPIO number is invalid.
+// -6 if the callback is NULL.
+int button_subscribe(gpio_num_t gpio_num,
+                     button_event_mask_t event_mask,
+                     uint8_t priority,
+                     button_subscriber_fn callback,
+                     void* context);
+
+// Detach a listener added with button_subscribe.
+// Returns 0 on success, -1 if the listener is not attached and -5 if the GPIO
+// number is invalid.
+int button_unsubscribe(gpio_num_t gpio_num,
+                       button_subscriber_fn callback,
+                       void* context);
+
+// Number of reflex actions that can be bound to a single button.
+#ifndef BUTTON_MAX_REFLEXES
+#define BUTTON_MAX_REFLEXES 4
+#endif
+
+typedef enum {
+        button_reflex_output_high = 0,
+        button_reflex_output_low,
+        button_reflex_output_toggle,
+        button_reflex_give_semaphore,
+        // Sets notify_bits in the notification value of the task.
+        button_reflex_notify_task,
+} button_reflex_action_t;
+
+typedef struct {
+        button_reflex_action_t action;
+        // Pin of the output actions; it is made an output when bound and
+        // keeps the level it drives until the first action.
+        gpio_num_t output;
+        SemaphoreHandle_t semaphore;
+        TaskHandle_t task;
+        uint32_t notify_bits;
+} button_reflex_t;
+
+// Run a predefined action whenever the button emits one of the events in
+// event_mask, inside the component: before the event is queued or any
+// callback runs, on every priority class. Binding the same action twice runs
+// it twice.
+// Returns 0 on success.
+// -1 if no button is registered on the GPIO.
+// -2 if the reflex table of the button is full.
+// -3 if the event mask is empty or the reflex is invalid: an unknown action,
+//    an output that is no output-capable GPIO or the button itself, or a NULL
+//    semaphore or task.
+// -5 if the GPIO number is invalid.
+int button_reflex_bind(gpio_num_t gpio_num,
+                       button_event_mask_t event_mask,
+                       button_reflex_t reflex);
+
+// Run the action in the GPIO interrupt on the leading edge of a press, before
+// the contact is debounced: on the first edge towards the pressed level while
+// the button is released. A glitch that debouncing later rejects still
+// triggers it, so bind only actions that are harmless to repeat. With
+// CONFIG_BUTTON_IRAM_SAFE the action also runs while flash is written.
+// Returns the same codes as button_reflex_bind, and -4 for buttons without a
+// GPIO interrupt (touch pads and encoders).
+int button_reflex_bind_edge(gpio_num_t gpio_num, button_reflex_t reflex);
+
+// Remove all reflex actions of the button. Returns 0, -1 if no button is
+// registered on the GPIO or -5 if the GPIO number is invalid.
+int button_reflex_clear(gpio_num_t gpio_num);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // BUTTON_H
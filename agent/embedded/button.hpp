@@ -0,0 +1,324 @@
+#ifndef BUTTON_HPP
+#define BUTTON_HPP
+
+#pragma once
+
+// Header-only C++17 layer over button.h. Configurations are types with
+// static constexpr members, validated at compile time; callbacks are bound
+// through per-callback trampolines without allocating. Everything inlines to
+// the button_create/button_destroy calls one would write by hand.
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include <freertos/FreeRTOS.h>
+
+#include "button.h"
+
+namespace button {
+
+// Defaults of button_config_default(button_active_low). Derive from it, set
+// gpio and override what differs:
+//
+//   struct menu_button : button::default_config {
+//           static constexpr gpio_num_t gpio = GPIO_NUM_4;
+//           static constexpr uint16_t long_press_time = 1000;
+//   };
+struct default_config {
+        static constexpr button_active_level_t active_level = button_active_low;
+        static constexpr uint16_t long_press_time = 0;
+        static constexpr uint16_t repeat_press_timeout = 300;
+        static constexpr uint16_t max_repeat_presses = 1;
+        static constexpr bool speculative_single_press = false;
+        static constexpr uint8_t adaptive_repeat_percentile = 0;
+        static constexpr uint16_t adaptive_repeat_min_timeout = 150;
+        static constexpr uint16_t adaptive_repeat_max_timeout = 600;
+        static constexpr std::array<uint16_t, BUTTON_MAX_HOLD_TIERS - 1> long_press_tier_times = {};
+        static constexpr bool long_press_report_on_release = false;
+        static constexpr uint16_t debounce_time = 10;
+        static constexpr uint32_t glitch_filter_ns = 750;
+        static constexpr bool mask_interrupt_while_debouncing = false;
+        static constexpr uint16_t storm_edge_limit = 0;
+        static constexpr uint16_t storm_window = 1000;
+        static constexpr uint16_t storm_recheck_time = 5000;
+        static constexpr uint16_t stuck_press_seconds = 0;
+        static constexpr uint16_t unstable_window = 0;
+        static constexpr button_priority_t priority = button_priority_normal;
+};
+
+namespace detail {
+
+// True when the duration is a whole number of ticks, so the timers of the
+// button fire exactly when configured.
+constexpr bool tick_representable(uint32_t duration_ms) {
+        return (static_cast<uint64_t>(duration_ms) * configTICK_RATE_HZ) % 1000u == 0;
+}
+
+template <typename Config>
+constexpr bool timings_representable() {
+        bool representable = tick_representable(Config::long_press_time)
+                && tick_representable(Config::repeat_press_timeout)
+                && tick_representable(Config::debounce_time)
+                && tick_representable(Config::storm_window)
+                && tick_representable(Config::storm_recheck_time)
+                && tick_representable(Config::unstable_window);
+        for (uint16_t time : Config::long_press_tier_times)
+                representable = representable && tick_representable(time);
+        return representable;
+}
+
+// Mirrors the check button_create does at run time.
+template <typename Config>
+constexpr bool hold_tiers_ascending() {
+        if (!Config::long_press_time)
+                return !Config::long_press_tier_times[0];
+
+        uint16_t previous = Config::long_press_time;
+        for (uint16_t time : Config::long_press_tier_times) {
+                if (!time)
+                        break;
+                if (time <= previous)
+                        return false;
+                previous = time;
+        }
+        return true;
+}
+
+template <typename Config>
+constexpr button_config_t make_config() {
+        button_config_t config {};
+        config.active_level = Config::active_level;
+        config.long_press_time = Config::long_press_time;
+        config.repeat_press_timeout = Config::repeat_press_timeout;
+        config.max_repeat_presses = Config::max_repeat_presses;
+        config.speculative_single_press = Config::speculative_single_press;
+        config.adaptive_repeat_percentile = Config::adaptive_repeat_percentile;
+        config.adaptive_repeat_min_timeout = Config::adaptive_repeat_min_timeout;
+        config.adaptive_repeat_max_timeout = Config::adaptive_repeat_max_timeout;
+        for (std::size_t i = 0; i < Config::long_press_tier_times.size(); i++)
+                config.long_press_tier_times[i] = Config::long_press_tier_times[i];
+        config.long_press_report_on_release = Config::long_press_report_on_release;
+        config.debounce_time = Config::debounce_time;
+        config.glitch_filter_ns = Config::glitch_filter_ns;
+        config.mask_interrupt_while_debouncing = Config::mask_interrupt_while_debouncing;
+        config.storm_edge_limit = Config::storm_edge_limit;
+        config.storm_window = Config::storm_window;
+        config.storm_recheck_time = Config::storm_recheck_time;
+        config.stuck_press_seconds = Config::stuck_press_seconds;
+        config.unstable_window = Config::unstable_window;
+        config.priority = Config::priority;
+        return config;
+}
+
+template <void (*Function)(button_event_t)>
+void function_trampoline(button_event_t event, void*) {
+        Function(event);
+}
+
+template <auto Method, typename T>
+void method_trampoline(button_event_t event, void* context) {
+        (static_cast<T*>(context)->*Method)(event);
+}
+
+template <typename F>
+void callable_trampoline(button_event_t event, void* context) {
+        (*static_cast<F*>(context))(event);
+}
+
+template <typename T, typename = void>
+struct has_on_single_press : std::false_type {};
+template <typename T>
+struct has_on_single_press<T, std::void_t<decltype(std::declval<T&>().on_single_press())>> : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_single_press_revoked : std::false_type {};
+template <typename T>
+struct has_on_single_press_revoked<T, std::void_t<decltype(std::declval<T&>().on_single_press_revoked())>>
+        : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_double_press : std::false_type {};
+template <typename T>
+struct has_on_double_press<T, std::void_t<decltype(std::declval<T&>().on_double_press())>> : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_triple_press : std::false_type {};
+template <typename T>
+struct has_on_triple_press<T, std::void_t<decltype(std::declval<T&>().on_triple_press())>> : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_long_press : std::false_type {};
+template <typename T>
+struct has_on_long_press<T, std::void_t<decltype(std::declval<T&>().on_long_press(1u))>> : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_held_since_boot : std::false_type {};
+template <typename T>
+struct has_on_held_since_boot<T, std::void_t<decltype(std::declval<T&>().on_held_since_boot())>>
+        : std::true_type {};
+
+template <typename T, typename = void>
+struct has_on_fault : std::false_type {};
+template <typename T>
+struct has_on_fault<T, std::void_t<decltype(std::declval<T&>().on_fault(true))>> : std::true_type {};
+
+// Calls the on_* member of T for the event. Events T has no member for
+// compile to nothing.
+template <typename T>
+void handler_trampoline(button_event_t event, void* context) {
+        T& handler = *static_cast<T*>(context);
+
+        switch (event) {
+        case button_event_single_press:
+                if constexpr (has_on_single_press<T>::value)
+                        handler.on_single_press();
+                break;
+        case button_event_single_press_revoked:
+                if constexpr (has_on_single_press_revoked<T>::value)
+                        handler.on_single_press_revoked();
+                break;
+        case button_event_double_press:
+                if constexpr (has_on_double_press<T>::value)
+                        handler.on_double_press();
+                break;
+        case button_event_tripple_press:
+                if constexpr (has_on_triple_press<T>::value)
+                        handler.on_triple_press();
+                break;
+        case button_event_long_press:
+                if constexpr (has_on_long_press<T>::value)
+                        handler.on_long_press(1u);
+                break;
+        case button_event_long_press_2:
+        case button_event_long_press_3:
+        case button_event_long_press_4:
+                if constexpr (has_on_long_press<T>::value)
+                        handler.on_long_press(2u + static_cast<unsigned>(event - button_event_long_press_2));
+                break;
+        case button_event_held_since_boot:
+                if constexpr (has_on_held_since_boot<T>::value)
+                        handler.on_held_since_boot();
+                break;
+        case button_event_fault:
+        case button_event_fault_cleared:
+                if constexpr (has_on_fault<T>::value)
+                        handler.on_fault(event == button_event_fault);
+                break;
+        default:
+                break;
+        }
+}
+
+} // namespace detail
+
+// Owns the button registered on Config::gpio and destroys it when it goes out
+// of scope. Create one with bind; the bound object or callable must outlive
+// the handle, it is referenced, not copied.
+template <typename Config>
+class handle {
+        static_assert(GPIO_IS_VALID_GPIO(Config::gpio), "gpio is not a valid GPIO of the target");
+        static_assert(Config::max_repeat_presses > 0, "max_repeat_presses must be at least 1");
+        static_assert(detail::timings_representable<Config>(),
+                      "timings must be a whole number of FreeRTOS ticks");
+        static_assert(detail::hold_tiers_ascending<Config>(),
+                      "long_press_tier_times must be ascending and follow a non-zero long_press_time");
+        static_assert(!Config::adaptive_repeat_percentile
+                      || (Config::adaptive_repeat_percentile <= 100
+                          && Config::adaptive_repeat_max_timeout
+                          && Config::adaptive_repeat_min_timeout <= Config::adaptive_repeat_max_timeout),
+                      "adaptive_repeat_percentile must be at most 100 with non-empty adaptive bounds");
+
+public:
+        static constexpr gpio_num_t gpio = Config::gpio;
+        static constexpr button_config_t config = detail::make_config<Config>();
+
+        // A free function taking the event.
+        template <void (*Function)(button_event_t)>
+        static handle bind() {
+                return handle(&detail::function_trampoline<Function>, nullptr);
+        }
+
+        // A member function taking the event, called on object.
+        template <auto Method, typename T>
+        static handle bind(T& object) {
+                static_assert(std::is_member_function_pointer_v<decltype(Method)>,
+                              "Method must be a member function pointer");
+                return handle(&detail::method_trampoline<Method, T>, &object);
+        }
+
+        // A lambda or other callable taking the event, by reference.
+        template <typename F>
+        static handle bind(F& callable) {
+                static_assert(std::is_invocable_v<F&, button_event_t>, "callable must accept a button_event_t");
+                return handle(&detail::callable_trampoline<F>, &callable);
+        }
+
+        // Binding a temporary would leave the button calling a dead object.
+        template <typename F>
+        static handle bind(const F&& callable) = delete;
+
+        // An object with on_single_press(), on_single_press_revoked(),
+        // on_double_press(), on_triple_press(), on_long_press(unsigned tier),
+        // on_held_since_boot() and/or on_fault(bool) members. Only the members
+        // that exist are dispatched.
+        template <typename T>
+        static handle bind_handler(T& handler) {
+                return handle(&detail::handler_trampoline<T>, &handler);
+        }
+
+        handle(const handle&) = delete;
+        handle& operator=(const handle&) = delete;
+
+        handle(handle&& other) noexcept
+                : status_(std::exchange(other.status_, -1)) {
+        }
+
+        handle& operator=(handle&& other) noexcept {
+                if (this != &other) {
+                        reset();
+                        status_ = std::exchange(other.status_, -1);
+                }
+                return *this;
+        }
+
+        ~handle() {
+                reset();
+        }
+
+        // 0 while the handle owns the button, otherwise the error returned by
+        // button_create, or -1 after reset or move.
+        int status() const {
+                return status_;
+        }
+
+        explicit operator bool() const {
+                return status_ == 0;
+        }
+
+        void reset() {
+                if (status_ == 0)
+                        button_destroy(gpio);
+                status_ = -1;
+        }
+
+        button_fault_t fault() const {
+                return button_get_fault(gpio);
+        }
+
+        bool pressed() const {
+                return button_is_pressed(gpio);
+        }
+
+private:
+        handle(button_callback_fn callback, void* context)
+                : status_(button_create(gpio, config, callback, context)) {
+        }
+
+        int status_;
+};
+
+} // namespace button
+
+#endif // BUTTON_HPP
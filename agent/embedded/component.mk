@@ -8,4 +8,8 @@ ifdef component_compile_rules
     $(eval $(call component_compile_rules,button))
 else
     COMPONENT_ADD_INCLUDEDIRS = .
+
+    ifndef CONFIG_BUTTON_TELEMETRY
+        COMPONENT_OBJEXCLUDE := telemetry.o
+    endif
 endif
@@ -0,0 +1,339 @@
+#include <stdatomic.h>
+
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+
+#include "encoder.h"
+#include "toggle.h"
+#include "port.h"
+
+
+// Everything the ISR touches is atomic; the ISR never takes a lock and only
+// calls into FreeRTOS for the first transition after the encoder was idle.
+// - state is only used by the ISR. All GPIO interrupts are serviced by the
+//   same interrupt, so the handlers of A and B never run concurrently.
+// - transitions counts decoded quadrature transitions. The timer task turns
+//   them into steps at most once per report interval.
+// - report_armed is set by whoever starts the report timer and cleared by the
+//   timer callback once the encoder stopped turning.
+// - reported_transitions and last_report are only used by the timer task.
+// - busy counts timer task callbacks in flight, so encoder_delete can wait for
+//   them before it clears the slot.
+typedef struct _encoder {
+        gpio_num_t gpio_a;
+        gpio_num_t gpio_b;
+        encoder_callback_fn callback;
+        void* context;
+
+        uint8_t transitions_per_step;
+        uint16_t acceleration_threshold;
+        uint8_t acceleration_max;
+        TimerHandle_t report_timer;
+
+        atomic_bool claimed;
+        atomic_bool active;
+        atomic_uint_least16_t busy;
+
+        uint8_t state;
+        atomic_uint_least32_t transitions;
+        atomic_bool report_armed;
+
+        uint32_t reported_transitions;
+        TickType_t last_report;
+        atomic_int_least32_t position;
+        atomic_int_least32_t velocity;
+} encoder_t;
+
+
+// Indexed by the previous and current A/B levels, (A << 3 | B << 2 | A' << 1 | B').
+// Invalid transitions (both channels changed) and bounces that return to the
+// previous state decode to 0 or cancel out.
+static const DRAM_ATTR int8_t encoder_transitions[16] = {
+        0, -1, 1, 0,
+        1, 0, 0, -1,
+        -1, 0, 0, 1,
+        0, 1, -1, 0,
+};
+
+static encoder_t encoder_pool[GPIO_NUM_MAX];
+static StaticTimer_t encoder_timer_buffers[GPIO_NUM_MAX];
+static encoder_t *_Atomic encoder_map[GPIO_NUM_MAX];
+static const char *TAG = "encoder";
+
+
+// Marks a timer task callback as in flight. Returns false once the encoder is
+// being deleted.
+static bool encoder_enter(encoder_t *encoder) {
+        atomic_fetch_add(&encoder->busy, 1);
+        if (atomic_load(&encoder->active))
+                return true;
+
+        atomic_fetch_sub(&encoder->busy, 1);
+        return false;
+}
+
+
+static void encoder_leave(encoder_t *encoder) {
+        // Zero when the callback deleted its own encoder.
+        uint_least16_t busy = atomic_load(&encoder->busy);
+        while (busy && !atomic_compare_exchange_weak(&encoder->busy, &busy, busy - 1)) {
+        }
+}
+
+
+static uint8_t IRAM_ATTR encoder_read_state(const encoder_t *encoder) {
+        return (uint8_t) ((my_gpio_read_from_isr(encoder->gpio_a) << 1) | my_gpio_read_from_isr(encoder->gpio_b));
+}
+
+
+static void IRAM_ATTR encoder_gpio_isr_handler(void *arg) {
+        encoder_t *encoder = (encoder_t*) arg;
+        if (!encoder || !atomic_load_explicit(&encoder->active, memory_order_acquire))
+                return;
+
+        const uint8_t state = encoder_read_state(encoder);
+        const int8_t direction = encoder_transitions[(encoder->state << 2) | state];
+        encoder->state = state;
+
+        if (!direction)
+                return;
+
+        atomic_fetch_add_explicit(&encoder->transitions, (uint32_t) (int32_t) direction, memory_order_relaxed);
+
+        // Already reporting; the timer picks this transition up.
+        if (atomic_exchange(&encoder->report_armed, true))
+                return;
+
+        BaseType_t higher_task_woken = pdFALSE;
+        if (xTimerStartFromISR(encoder->report_timer, &higher_task_woken) != pdPASS) {
+                atomic_store(&encoder->report_armed, false);
+                return;
+        }
+
+        if (higher_task_woken == pdTRUE) {
+                portYIELD_FROM_ISR();
+        }
+}
+
+
+static int32_t encoder_acceleration(const encoder_t *encoder, int32_t velocity) {
+        if (!encoder->acceleration_threshold)
+                return 1;
+
+        const uint32_t speed = velocity < 0 ? (uint32_t) -(int64_t) velocity : (uint32_t) velocity;
+        uint32_t factor = speed / encoder->acceleration_threshold;
+        if (factor > encoder->acceleration_max)
+                factor = encoder->acceleration_max;
+
+        return factor ? (int32_t) factor : 1;
+}
+
+
+static void encoder_report_timer_callback(TimerHandle_t timer) {
+        encoder_t *encoder = (encoder_t*) pvTimerGetTimerID(timer);
+        if (!encoder || !encoder_enter(encoder))
+                return;
+
+        const uint32_t transitions = atomic_load(&encoder->transitions);
+        const int32_t pending = (int32_t) (transitions - encoder->reported_transitions);
+        const int32_t steps = pending / encoder->transitions_per_step;
+
+        if (!steps) {
+                // Stopped turning. An edge between reading the count and
+                // disarming found the timer armed and did not start it.
+                atomic_store(&encoder->velocity, 0);
+                atomic_store(&encoder->report_armed, false);
+                if (atomic_load(&encoder->transitions) != transitions
+                    && !atomic_exchange(&encoder->report_armed, true)) {
+                        xTimerStart(timer, 0);
+                }
+
+                encoder_leave(encoder);
+                return;
+        }
+
+        encoder->reported_transitions += (uint32_t) (steps * encoder->transitions_per_step);
+
+        const TickType_t now = xTaskGetTickCount();
+        const TickType_t elapsed = now - encoder->last_report;
+        encoder->last_report = now;
+
+        const int32_t velocity = (int32_t) ((int64_t) steps * configTICK_RATE_HZ / (elapsed ? elapsed : 1));
+        atomic_store(&encoder->velocity, velocity);
+
+        const int32_t reported = steps * encoder_acceleration(encoder, velocity);
+        atomic_fetch_add(&encoder->position, reported);
+
+        // Keep batching while the encoder turns.
+        xTimerStart(timer, 0);
+
+        encoder->callback(reported, encoder->context);
+        encoder_leave(encoder);
+}
+
+
+static encoder_t *encoder_find_by_gpio(const gpio_num_t gpio_a) {
+        if (!GPIO_IS_VALID_GPIO(gpio_a))
+                return NULL;
+
+        return atomic_load_explicit(&encoder_map[(size_t) gpio_a], memory_order_acquire);
+}
+
+
+static void encoder_slot_clear(encoder_t *encoder) {
+        encoder->gpio_a = GPIO_NUM_NC;
+        encoder->gpio_b = GPIO_NUM_NC;
+        encoder->callback = NULL;
+        encoder->context = NULL;
+        encoder->report_timer = NULL;
+        encoder->state = 0;
+        encoder->reported_transitions = 0;
+        encoder->last_report = 0;
+        atomic_store(&encoder->active, false);
+        atomic_store(&encoder->busy, 0);
+        atomic_store(&encoder->transitions, 0);
+        atomic_store(&encoder->report_armed, false);
+        atomic_store(&encoder->position, 0);
+        atomic_store(&encoder->velocity, 0);
+}
+
+
+int encoder_create(const gpio_num_t gpio_a,
+                   const gpio_num_t gpio_b,
+                   const encoder_config_t *config,
+                   encoder_callback_fn callback,
+                   void* context) {
+        if (!GPIO_IS_VALID_GPIO(gpio_a) || !GPIO_IS_VALID_GPIO(gpio_b) || gpio_a == gpio_b) {
+                ESP_LOGE(TAG, "Invalid GPIO numbers: %d, %d", (int) gpio_a, (int) gpio_b);
+                return -2;
+        }
+
+        if (!callback) {
+                ESP_LOGE(TAG, "NULL callback provided for GPIO %d", (int) gpio_a);
+                return -5;
+        }
+
+        const encoder_config_t defaults = encoder_config_default();
+        if (!config)
+                config = &defaults;
+
+        const size_t index = (size_t) gpio_a;
+        encoder_t *encoder = &encoder_pool[index];
+
+        if (atomic_exchange(&encoder->claimed, true))
+                return -1;
+
+        encoder_slot_clear(encoder);
+        encoder->gpio_a = gpio_a;
+        encoder->gpio_b = gpio_b;
+        encoder->callback = callback;
+        encoder->context = context;
+        encoder->transitions_per_step = config->transitions_per_step ? config->transitions_per_step : 1;
+        encoder->acceleration_threshold = config->acceleration_threshold;
+        encoder->acceleration_max = config->acceleration_max ? config->acceleration_max : 1;
+
+        TickType_t report_ticks = pdMS_TO_TICKS(config->report_interval_ms);
+        encoder->report_timer = xTimerCreateStatic(
+                "Encoder report",
+                report_ticks ? report_ticks : 1,
+                pdFALSE,
+                encoder,
+                encoder_report_timer_callback,
+                &encoder_timer_buffers[index]
+        );
+        if (!encoder->report_timer) {
+                ESP_LOGE(TAG, "Failed to create report timer for GPIO %d", (int) gpio_a);
+                atomic_store(&encoder->claimed, false);
+                return -4;
+        }
+
+        int result = toggle_isr_attach(gpio_a, encoder_gpio_isr_handler, encoder);
+        if (result)
+                goto fail_a;
+
+        result = toggle_isr_attach(gpio_b, encoder_gpio_isr_handler, encoder);
+        if (result)
+                goto fail_b;
+
+        my_gpio_glitch_filter_enable(gpio_a, config->glitch_filter_ns);
+        my_gpio_glitch_filter_enable(gpio_b, config->glitch_filter_ns);
+
+        if (config->pull == encoder_pull_up) {
+                my_gpio_pullup(gpio_a);
+                my_gpio_pullup(gpio_b);
+        } else if (config->pull == encoder_pull_down) {
+                my_gpio_pulldown(gpio_a);
+                my_gpio_pulldown(gpio_b);
+        }
+
+        // The ISR ignores edges until the encoder is active.
+        encoder->state = (uint8_t) ((my_gpio_read(gpio_a) << 1) | my_gpio_read(gpio_b));
+        encoder->last_report = xTaskGetTickCount();
+        atomic_store(&encoder->active, true);
+        atomic_store_explicit(&encoder_map[index], encoder, memory_order_release);
+
+        return 0;
+
+fail_b:
+        toggle_isr_detach(gpio_a);
+
+fail_a:
+        xTimerDelete(encoder->report_timer, 0);
+        encoder_slot_clear(encoder);
+        atomic_store(&encoder->claimed, false);
+
+        return result;
+}
+
+
+void encoder_delete(const gpio_num_t gpio_a) {
+        if (!GPIO_IS_VALID_GPIO(gpio_a)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_a);
+                return;
+        }
+
+        // Exactly one concurrent delete gets the encoder; the slot stays
+        // claimed until it is clear.
+        encoder_t *encoder = atomic_exchange(&encoder_map[(size_t) gpio_a], NULL);
+        if (!encoder)
+                return;
+
+        atomic_store(&encoder->active, false);
+
+        toggle_isr_detach(encoder->gpio_a);
+        toggle_isr_detach(encoder->gpio_b);
+        my_gpio_glitch_filter_disable(encoder->gpio_a);
+        my_gpio_glitch_filter_disable(encoder->gpio_b);
+
+        // The timer task cannot wait for room in its own command queue.
+        const bool timer_task = xTaskGetCurrentTaskHandle() == xTimerGetTimerDaemonTaskHandle();
+        const TickType_t block = timer_task ? 0 : portMAX_DELAY;
+        if (xTimerStop(encoder->report_timer, block) != pdPASS
+            || xTimerDelete(encoder->report_timer, block) != pdPASS)
+                ESP_LOGE(TAG, "Failed to delete report timer of GPIO %d", (int) gpio_a);
+
+        // A report of this encoder may still be running in the timer task.
+        // When we are that report, it does not touch the encoder after
+        // returning to us.
+        if (!timer_task) {
+                while (atomic_load(&encoder->busy)) {
+                        vTaskDelay(1);
+                }
+        }
+
+        encoder_slot_clear(encoder);
+        atomic_store(&encoder->claimed, false);
+}
+
+
+int32_t encoder_get_position(const gpio_num_t gpio_a) {
+        encoder_t *encoder = encoder_find_by_gpio(gpio_a);
+        return encoder ? atomic_load(&encoder->position) : 0;
+}
+
+
+int32_t encoder_get_velocity(const gpio_num_t gpio_a) {
+        encoder_t *encoder = encoder_find_by_gpio(gpio_a);
+        return encoder ? atomic_load(&encoder->velocity) : 0;
+}
@@ -0,0 +1,74 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <driver/gpio.h>
+
+// Called from the timer task with the steps turned since the previous call,
+// positive when channel A leads channel B.
+typedef void (*encoder_callback_fn)(int32_t steps, void* context);
+
+typedef enum {
+        encoder_pull_none = 0,
+        encoder_pull_up,
+        encoder_pull_down,
+} encoder_pull_t;
+
+typedef struct {
+        // Internal resistors applied to both channels before the initial state
+        // is sampled.
+        encoder_pull_t pull;
+        // Quadrature transitions per reported step. Most detented encoders go
+        // through a full cycle (4 transitions) per detent.
+        uint8_t transitions_per_step;
+        // Interval in milliseconds at which accumulated steps are reported
+        // while the encoder turns. Nothing runs while it is idle.
+        uint16_t report_interval_ms;
+        // Multiply the reported steps when turning faster than this many steps
+        // per second, up to acceleration_max times. 0 disables acceleration.
+        uint16_t acceleration_threshold;
+        uint8_t acceleration_max;
+        // Width of glitches to suppress with the hardware glitch filter of the
+        // target, in nanoseconds. 0 disables the hardware filter.
+        uint32_t glitch_filter_ns;
+} encoder_config_t;
+
+static inline encoder_config_t encoder_config_default(void)
+{
+        return (encoder_config_t) {
+                .pull = encoder_pull_up,
+                .transitions_per_step = 4,
+                .report_interval_ms = 20,
+                .acceleration_threshold = 0,
+                .acceleration_max = 4,
+                .glitch_filter_ns = 750,
+        };
+}
+
+// Decode a quadrature encoder on gpio_a and gpio_b. Transitions are decoded in
+// the ISR; the timer task is only involved once per report interval while the
+// encoder turns. The encoder is identified by gpio_a afterwards.
+// Returns 0 on success, -1 if either GPIO is already tracked, -2 if a GPIO is
+// invalid or both are the same, -3 if the toggle subsystem cannot be
+// initialised, -4 if timer or interrupt configuration fails, and -5 if the
+// callback is NULL.
+int encoder_create(gpio_num_t gpio_a,
+                   gpio_num_t gpio_b,
+                   const encoder_config_t *config,
+                   encoder_callback_fn callback,
+                   void* context);
+
+void encoder_delete(gpio_num_t gpio_a);
+
+// Sum of all reported steps, including acceleration.
+int32_t encoder_get_position(gpio_num_t gpio_a);
+
+// Speed in steps per second measured over the last report interval, signed
+// like the steps. 0 while idle.
+int32_t encoder_get_velocity(gpio_num_t gpio_a);
+
+#endif // ENCODER_H
@@ -1,12 +1,53 @@
 #include "port.h"
 
 #include <driver/gpio.h>
+#include <esp_attr.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_idf_version.h>
+#include <esp_private/cache_utils.h>
+#include <esp_timer.h>
+#include <hal/gpio_ll.h>
+#include <esp_rom_gpio.h>
+#include <esp_rom_sys.h>
+#include <soc/gpio_reg.h>
+#include <soc/gpio_struct.h>
+#include <soc/soc_caps.h>
 #include <stdbool.h>
 
+// The glitch filter driver is available from ESP-IDF 5.1 onwards.
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0) \
+        && (SOC_GPIO_FLEX_GLITCH_FILTER_NUM > 0 || SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER)
+#include <driver/gpio_filter.h>
+#define PORT_HAS_GLITCH_FILTER 1
+
+// The pin glitch filter removes pulses shorter than two IO MUX clock cycles.
+#define PORT_PIN_GLITCH_FILTER_NS 25
+
+static gpio_glitch_filter_handle_t glitch_filters[GPIO_NUM_MAX];
+#endif
+
+// The legacy touch pad driver covers both generations of the touch sensor.
+#if SOC_TOUCH_SENSOR_SUPPORTED
+#include <driver/touch_pad.h>
+#include <soc/touch_sensor_periph.h>
+#define PORT_HAS_TOUCH 1
+
+static bool touch_started;
+#endif
+
+// The HTTP client is only linked in with the telemetry uplink.
+#ifdef CONFIG_BUTTON_TELEMETRY
+#include <esp_http_client.h>
+#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include <esp_crt_bundle.h>
+#endif
+#endif
+
 static const char *TAG = "button_port";
 
+static portMUX_TYPE output_lock = portMUX_INITIALIZER_UNLOCKED;
+
 static void log_gpio_error(gpio_num_t gpio, const char *action, esp_err_t err) {
         ESP_LOGE(TAG, "%s failed for GPIO %d: %s", action, (int) gpio, esp_err_to_name(err));
 }
@@ -84,3 +125,293 @@ void my_gpio_pulldown(gpio_num_t gpio) {
 uint8_t my_gpio_read(gpio_num_t gpio) {
         return (uint8_t) gpio_get_level(gpio);
 }
+
+// Function to latch the levels of the boot pins with one read of the input
+// registers. The pulls need a few microseconds to charge the line before.
+uint64_t my_gpio_boot_latch(uint64_t pullup_mask, uint64_t pulldown_mask) {
+        const uint64_t mask = pullup_mask | pulldown_mask;
+        for (uint64_t pending = mask; pending; pending &= pending - 1) {
+                const gpio_num_t gpio = (gpio_num_t) __builtin_ctzll(pending);
+                gpio_ll_input_enable(&GPIO, gpio);
+                if (pullup_mask & (1ULL << (uint32_t) gpio)) {
+                        gpio_ll_pulldown_dis(&GPIO, gpio);
+                        gpio_ll_pullup_en(&GPIO, gpio);
+                } else {
+                        gpio_ll_pullup_dis(&GPIO, gpio);
+                        gpio_ll_pulldown_en(&GPIO, gpio);
+                }
+        }
+        esp_rom_delay_us(10);
+
+        uint64_t levels = REG_READ(GPIO_IN_REG);
+#if SOC_GPIO_PIN_COUNT > 32
+        levels |= (uint64_t) REG_READ(GPIO_IN1_REG) << 32;
+#endif
+        return levels;
+}
+
+// Function to mask a GPIO interrupt from an ISR; gpio_intr_disable is not safe
+// to call from interrupt context, the low level HAL access is
+void IRAM_ATTR my_gpio_intr_disable_from_isr(gpio_num_t gpio) {
+        gpio_ll_intr_disable(&GPIO, gpio);
+}
+
+// Function to allocate the GPIO interrupt for a single handler
+esp_err_t my_gpio_isr_register(void (*handler)(void *), void *arg, int flags) {
+        return gpio_isr_register(handler, arg, flags, NULL);
+}
+
+// Function to fetch and acknowledge the pending GPIO interrupts from an ISR.
+// Targets with fewer than 32 GPIOs report no high word.
+void IRAM_ATTR my_gpio_intr_status_take_from_isr(uint32_t status[MY_GPIO_STATUS_WORDS]) {
+        const uint32_t core_id = xPortGetCoreID();
+        gpio_ll_get_intr_status(&GPIO, core_id, &status[0]);
+        gpio_ll_get_intr_status_high(&GPIO, core_id, &status[1]);
+        gpio_ll_clear_intr_status(&GPIO, status[0]);
+        gpio_ll_clear_intr_status_high(&GPIO, status[1]);
+}
+
+// Function to read GPIO level from an ISR, without going through the driver
+uint8_t IRAM_ATTR my_gpio_read_from_isr(gpio_num_t gpio) {
+        return (uint8_t) gpio_ll_get_level(&GPIO, gpio);
+}
+
+// Function to configure GPIO as output. Input stays enabled so the driven
+// level can be read back for toggling.
+void my_gpio_output(gpio_num_t gpio) {
+        if (!GPIO_IS_VALID_OUTPUT_GPIO(gpio)) {
+                ESP_LOGE(TAG, "Invalid output GPIO number: %d", (int) gpio);
+                return;
+        }
+
+        esp_rom_gpio_pad_select_gpio(gpio);
+        esp_err_t err = gpio_set_direction(gpio, GPIO_MODE_INPUT_OUTPUT);
+        if (err != ESP_OK) {
+                log_gpio_error(gpio, "gpio_set_direction", err);
+        }
+}
+
+// Function to drive an output from an ISR, without going through the driver
+void IRAM_ATTR my_gpio_write_from_isr(gpio_num_t gpio, bool high) {
+        gpio_ll_set_level(&GPIO, gpio, high ? 1 : 0);
+}
+
+// Function to invert an output from an ISR. The read-modify-write is locked
+// so the timer task on the other core does not interleave with an interrupt.
+void IRAM_ATTR my_gpio_toggle_from_isr(gpio_num_t gpio) {
+        portENTER_CRITICAL_SAFE(&output_lock);
+        gpio_ll_set_level(&GPIO, gpio, gpio_ll_get_level(&GPIO, gpio) ? 0 : 1);
+        portEXIT_CRITICAL_SAFE(&output_lock);
+}
+
+// Function to read a microsecond timestamp from an ISR; esp_timer_get_time is
+// placed in IRAM
+uint32_t IRAM_ATTR my_time_us_from_isr(void) {
+        return (uint32_t) esp_timer_get_time();
+}
+
+// Function to check from an ISR whether flash is being written or erased
+bool IRAM_ATTR my_flash_cache_enabled_from_isr(void) {
+        return spi_flash_cache_enabled();
+}
+
+// Function to read the uptime in seconds; esp_timer counts 64 bit microseconds
+uint32_t my_uptime_seconds(void) {
+        return (uint32_t) (esp_timer_get_time() / 1000000);
+}
+
+#ifdef CONFIG_BUTTON_TELEMETRY
+// Function to POST a JSON body with the ESP-IDF HTTP client
+int my_http_post(const char *url, const char *body, size_t length, uint32_t timeout_ms) {
+        esp_http_client_config_t config = {
+                .url = url,
+                .method = HTTP_METHOD_POST,
+                .timeout_ms = (int) timeout_ms,
+#ifdef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+                .crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+        };
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        if (!client) {
+                ESP_LOGE(TAG, "Failed to create HTTP client for %s", url);
+                return -1;
+        }
+
+        esp_http_client_set_header(client, "Content-Type", "application/json");
+        esp_http_client_set_post_field(client, body, (int) length);
+
+        int status = -1;
+        esp_err_t err = esp_http_client_perform(client);
+        if (err == ESP_OK)
+                status = esp_http_client_get_status_code(client);
+        else
+                ESP_LOGE(TAG, "POST to %s failed: %s", url, esp_err_to_name(err));
+
+        esp_http_client_cleanup(client);
+        return status;
+}
+#endif
+
+#ifdef PORT_HAS_GLITCH_FILTER
+static uint32_t glitch_filter_start(gpio_num_t gpio, gpio_glitch_filter_handle_t filter, uint32_t width_ns) {
+        esp_err_t err = gpio_glitch_filter_enable(filter);
+        if (err != ESP_OK) {
+                log_gpio_error(gpio, "gpio_glitch_filter_enable", err);
+                gpio_del_glitch_filter(filter);
+                return 0;
+        }
+
+        glitch_filters[gpio] = filter;
+        return width_ns;
+}
+#endif
+
+// Function to enable the hardware glitch filter, preferring a flex filter with
+// the requested window and falling back to the fixed pin filter
+uint32_t my_gpio_glitch_filter_enable(gpio_num_t gpio, uint32_t window_ns) {
+        if (!validate_gpio(gpio) || !window_ns) {
+                return 0;
+        }
+
+#ifdef PORT_HAS_GLITCH_FILTER
+        if (glitch_filters[gpio]) {
+                my_gpio_glitch_filter_disable(gpio);
+        }
+
+        gpio_glitch_filter_handle_t filter = NULL;
+
+#if SOC_GPIO_FLEX_GLITCH_FILTER_NUM > 0
+        gpio_flex_glitch_filter_config_t flex_conf = {
+                .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+                .gpio_num = gpio,
+                .window_width_ns = window_ns,
+                .window_thres_ns = window_ns,
+        };
+
+        // Fails when all flex filters are in use or the window exceeds what the
+        // filter clock can count; fall through to the pin filter in that case.
+        if (gpio_new_flex_glitch_filter(&flex_conf, &filter) == ESP_OK) {
+                return glitch_filter_start(gpio, filter, window_ns);
+        }
+#endif
+
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+        gpio_pin_glitch_filter_config_t pin_conf = {
+                .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+                .gpio_num = gpio,
+        };
+
+        esp_err_t err = gpio_new_pin_glitch_filter(&pin_conf, &filter);
+        if (err == ESP_OK) {
+                return glitch_filter_start(gpio, filter, PORT_PIN_GLITCH_FILTER_NS);
+        }
+        log_gpio_error(gpio, "gpio_new_pin_glitch_filter", err);
+#endif
+#endif
+
+        return 0;
+}
+
+// Function to release the hardware glitch filter of a pin
+void my_gpio_glitch_filter_disable(gpio_num_t gpio) {
+#ifdef PORT_HAS_GLITCH_FILTER
+        if (!GPIO_IS_VALID_GPIO(gpio) || !glitch_filters[gpio]) {
+                return;
+        }
+
+        gpio_glitch_filter_disable(glitch_filters[gpio]);
+        gpio_del_glitch_filter(glitch_filters[gpio]);
+        glitch_filters[gpio] = NULL;
+#else
+        (void) gpio;
+#endif
+}
+
+// Function to find the touch channel wired to a pin
+int my_touch_channel(gpio_num_t gpio) {
+#ifdef PORT_HAS_TOUCH
+        for (int channel = 0; channel < SOC_TOUCH_SENSOR_NUM && channel < MY_TOUCH_CHANNELS; channel++) {
+#if SOC_TOUCH_VERSION_2
+                // Channel 0 is internal on the second generation.
+                if (channel == 0)
+                        continue;
+#endif
+                if (touch_sensor_channel_io_map[channel] == gpio)
+                        return channel;
+        }
+#else
+        (void) gpio;
+#endif
+        return -1;
+}
+
+// Function to add a channel to the measurements of the touch sensor, which is
+// set up to measure all its channels continuously on first use
+esp_err_t my_touch_enable(int channel) {
+#ifdef PORT_HAS_TOUCH
+        esp_err_t err = ESP_OK;
+        if (!touch_started) {
+                err = touch_pad_init();
+                if (err != ESP_OK)
+                        return err;
+                touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
+        }
+
+#if SOC_TOUCH_VERSION_1
+        err = touch_pad_config((touch_pad_t) channel, 0);
+#else
+        err = touch_pad_config((touch_pad_t) channel);
+#endif
+        if (err != ESP_OK)
+                return err;
+
+        if (!touch_started) {
+#if SOC_TOUCH_VERSION_2
+                touch_pad_fsm_start();
+#endif
+                touch_started = true;
+        }
+        return ESP_OK;
+#else
+        (void) channel;
+        return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+// Function to remove a channel from the measurements; the first generation
+// measures every configured channel and has nothing to remove
+void my_touch_disable(int channel) {
+#if defined(PORT_HAS_TOUCH) && SOC_TOUCH_VERSION_2
+        touch_pad_clear_channel_mask(BIT(channel));
+#else
+        (void) channel;
+#endif
+}
+
+// Function to read the latest measurements of several channels
+void my_touch_read(const uint8_t *channels, size_t count, uint32_t *raw) {
+        for (size_t i = 0; i < count; i++) {
+#if defined(PORT_HAS_TOUCH) && SOC_TOUCH_VERSION_1
+                uint16_t value = 0;
+                touch_pad_read_raw_data((touch_pad_t) channels[i], &value);
+                raw[i] = value;
+#elif defined(PORT_HAS_TOUCH)
+                uint32_t value = 0;
+                touch_pad_read_raw_data((touch_pad_t) channels[i], &value);
+                raw[i] = value;
+#else
+                (void) channels;
+                raw[i] = 0;
+#endif
+        }
+}
+
+// Function to tell the direction of a touch in the raw counts; the first
+// generation measures charge cycles, which drop when a finger adds capacity
+bool my_touch_lowers_count(void) {
+#if defined(PORT_HAS_TOUCH) && SOC_TOUCH_VERSION_1
+        return true;
+#else
+        return false;
+#endif
+}
@@ -3,15 +3,88 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <driver/gpio.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
 #include <freertos/timers.h>
 
 void my_gpio_enable(gpio_num_t gpio);
 void my_gpio_pullup(gpio_num_t gpio);
 void my_gpio_pulldown(gpio_num_t gpio);
 uint8_t my_gpio_read(gpio_num_t gpio);
+
+// Enable the input and the given pull resistors of the pins in the masks,
+// without resetting them, and read the levels of all pins at once. Bit n of
+// the result is the level of GPIO n. Works before the GPIO driver is used.
+uint64_t my_gpio_boot_latch(uint64_t pullup_mask, uint64_t pulldown_mask);
+
+// Mask the interrupt of the pin from interrupt context. gpio_intr_enable
+// unmasks it again from task context.
+void my_gpio_intr_disable_from_isr(gpio_num_t gpio);
+
+// Allocate the GPIO interrupt of the target for handler alone, bypassing the
+// GPIO ISR service. Pin interrupts are still enabled with gpio_intr_enable.
+esp_err_t my_gpio_isr_register(void (*handler)(void *), void *arg, int flags);
+
+#define MY_GPIO_STATUS_WORDS 2
+
+// Read and clear the pending GPIO interrupts of the calling core from
+// interrupt context. Bit n % 32 of status[n / 32] is set for GPIO n.
+void my_gpio_intr_status_take_from_isr(uint32_t status[MY_GPIO_STATUS_WORDS]);
+
+// Read the level of the pin from interrupt context.
+uint8_t my_gpio_read_from_isr(gpio_num_t gpio);
+
+// Turn the pin into an output that reads back its own level, keeping the
+// level it drives.
+void my_gpio_output(gpio_num_t gpio);
+
+// Drive or invert an output pin. Usable from task and interrupt context.
+void my_gpio_write_from_isr(gpio_num_t gpio, bool high);
+void my_gpio_toggle_from_isr(gpio_num_t gpio);
+
+// Microsecond timestamp, usable from interrupt context while the flash cache
+// is disabled. Wraps after about 71 minutes.
+uint32_t my_time_us_from_isr(void);
+
+// Whether the flash cache is enabled, i.e. no flash write or erase is running.
+bool my_flash_cache_enabled_from_isr(void);
+
+// Seconds since boot. Does not wrap.
+uint32_t my_uptime_seconds(void);
+
+// POST a JSON body to the URL and wait up to timeout_ms for the response.
+// Returns the HTTP status of the response, or -1 when none was received. Only
+// provided with CONFIG_BUTTON_TELEMETRY.
+int my_http_post(const char *url, const char *body, size_t length, uint32_t timeout_ms);
+
+// Enable the hardware glitch filter of the target on the pin. Returns the width
+// in nanoseconds of the glitches removed in hardware, or 0 when the target has
+// no (free) glitch filter and debouncing stays in software.
+uint32_t my_gpio_glitch_filter_enable(gpio_num_t gpio, uint32_t window_ns);
+void my_gpio_glitch_filter_disable(gpio_num_t gpio);
+
+// Capacitive touch sensor. Channels are numbered as touch_pad_t; no target has
+// more than MY_TOUCH_CHANNELS.
+#define MY_TOUCH_CHANNELS 15
+
+// Touch channel of the pin, or -1 if it has none or the target has no touch
+// sensor.
+int my_touch_channel(gpio_num_t gpio);
+
+// Start measuring the channel, setting up the touch sensor on first use.
+esp_err_t my_touch_enable(int channel);
+void my_touch_disable(int channel);
+
+// Read the latest raw counts of the channels in one pass; the sensor measures
+// all enabled channels continuously in the background.
+void my_touch_read(const uint8_t *channels, size_t count, uint32_t *raw);
+
+// Whether a touch lowers the raw count (ESP32) instead of raising it.
+bool my_touch_lowers_count(void);
 #endif // PORT_H
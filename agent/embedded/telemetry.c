@@ -0,0 +1,461 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "telemetry.h"
+#include "button.h"
+#include "port.h"
+
+
+// Events of one button in one bucket, counted.
+typedef struct {
+        uint32_t bucket_start;
+        uint32_t count;
+        uint8_t gpio_num;
+        uint8_t event;
+} telemetry_record_t;
+
+// The records form a ring in time order, head is the oldest. Subscribers count
+// into it from the timer task or the dispatcher, the upload runs elsewhere, so
+// the ring is only touched under lock and a batch is encoded from a copy:
+// - the first sealed records are in the batch being uploaded. Events are no
+//   longer counted into them, and they are removed once the upload succeeded.
+// - batch_records is the number of records the batch was encoded from. When a
+//   sealed record is dropped sealed shrinks; the difference is only counted
+//   as dropped if the upload then fails.
+// - unreported counts records dropped since the last successful upload; the
+//   next batch reports them in a log record.
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static telemetry_record_t records[TELEMETRY_MAX_RECORDS];
+static uint16_t head;
+static uint16_t count;
+static uint16_t sealed;
+static uint16_t batch_records;
+static uint32_t unreported;
+static telemetry_stats_t stats;
+static uint64_t tracked;
+static bool initialised;
+
+// Only used by the uploading task, under upload_lock.
+static telemetry_config_t config;
+static SemaphoreHandle_t upload_lock;
+static uint32_t backoff;
+static uint32_t next_attempt;
+static telemetry_record_t batch[TELEMETRY_MAX_RECORDS];
+static char payload[TELEMETRY_PAYLOAD_SIZE];
+static char batch_url[128];
+
+static _Atomic(TaskHandle_t) telemetry_task_handle;
+
+static const char *TAG = "telemetry";
+
+static const char *const event_names[] = {
+        [button_event_single_press] = "single_press",
+        [button_event_double_press] = "double_press",
+        [button_event_tripple_press] = "triple_press",
+        [button_event_long_press] = "long_press",
+        [button_event_fault] = "fault",
+        [button_event_fault_cleared] = "fault_cleared",
+        [button_event_rotate] = "rotate",
+        [button_event_long_press_2] = "long_press_2",
+        [button_event_long_press_3] = "long_press_3",
+        [button_event_long_press_4] = "long_press_4",
+        [button_event_single_press_revoked] = "single_press_revoked",
+        [button_event_held_since_boot] = "held_since_boot",
+};
+
+static const char *const priority_names[] = {
+        [button_priority_normal] = "normal",
+        [button_priority_high] = "high",
+        [button_priority_critical] = "critical",
+};
+
+typedef struct {
+        char *buffer;
+        size_t size;
+        size_t length;
+} telemetry_writer_t;
+
+static bool telemetry_serial_valid(const char *serial_number) {
+        if (!serial_number || !*serial_number)
+                return false;
+
+        for (const char *c = serial_number; *c; c++) {
+                if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')
+                      || strchr("-_.:", *c)))
+                        return false;
+        }
+        return true;
+}
+
+static int telemetry_http_post(const char *body, size_t length, void* context) {
+        (void) context;
+        return my_http_post(batch_url, body, length, config.timeout);
+}
+
+static uint16_t telemetry_slot(uint16_t index) {
+        return (uint16_t) ((head + index) % TELEMETRY_MAX_RECORDS);
+}
+
+// Must be called with lock held and the ring full.
+static void telemetry_drop_oldest(void) {
+        head = telemetry_slot(1);
+        count--;
+        if (sealed) {
+                sealed--;
+        } else {
+                unreported++;
+                stats.dropped++;
+        }
+}
+
+static void telemetry_count(const button_event_info_t *info, void* context) {
+        (void) context;
+
+        const uint32_t now = my_uptime_seconds();
+
+        portENTER_CRITICAL(&lock);
+        if (!initialised) {
+                portEXIT_CRITICAL(&lock);
+                return;
+        }
+
+        const uint32_t bucket_start = now - now % config.bucket_seconds;
+        for (uint16_t i = count; i > sealed; i--) {
+                telemetry_record_t *record = &records[telemetry_slot(i - 1)];
+                if (record->bucket_start != bucket_start)
+                        break;
+                if (record->gpio_num == info->gpio_num && record->event == info->event) {
+                        record->count++;
+                        portEXIT_CRITICAL(&lock);
+                        return;
+                }
+        }
+
+        if (count == TELEMETRY_MAX_RECORDS)
+                telemetry_drop_oldest();
+        records[telemetry_slot(count)] = (telemetry_record_t) {
+                .bucket_start = bucket_start,
+                .count = 1,
+                .gpio_num = (uint8_t) info->gpio_num,
+                .event = (uint8_t) info->event,
+        };
+        count++;
+        portEXIT_CRITICAL(&lock);
+}
+
+static bool telemetry_append(telemetry_writer_t *writer, const char *format, ...) {
+        const size_t available = writer->size - writer->length;
+
+        va_list args;
+        va_start(args, format);
+        const int length = vsnprintf(writer->buffer + writer->length, available, format, args);
+        va_end(args);
+
+        if (length < 0 || (size_t) length >= available) {
+                writer->buffer[writer->length] = '\0';
+                return false;
+        }
+        writer->length += (size_t) length;
+        return true;
+}
+
+// Encode the header, the log records and as many of the first records as fit.
+// Returns the number of records encoded, or -1 if not even the header fits.
+static int telemetry_encode(telemetry_writer_t *writer, uint16_t records_available, uint32_t dropped) {
+        bool fits = telemetry_append(writer, "{\"serial_number\":\"%s\",\"uptime\":%lu,\"bucket_seconds\":%u,\"logs\":[",
+                                     config.serial_number, (unsigned long) my_uptime_seconds(),
+                                     (unsigned) config.bucket_seconds);
+
+        const char *separator = "";
+        if (fits && dropped) {
+                fits = telemetry_append(writer, "{\"level\":\"warning\",\"message\":\"telemetry dropped_records=%lu\"}",
+                                        (unsigned long) dropped);
+                separator = ",";
+        }
+        for (int priority = 0; fits && priority < BUTTON_PRIORITY_CLASSES; priority++) {
+                button_priority_stats_t dispatch;
+                if (button_get_priority_stats((button_priority_t) priority, &dispatch, false) != 0
+                    || (!dispatch.delivered && !dispatch.overflows))
+                        continue;
+
+                fits = telemetry_append(writer,
+                                        "%s{\"level\":\"info\",\"message\":\"button dispatch %s delivered=%lu overflows=%lu "
+                                        "max_latency_us=%lu avg_latency_us=%lu\"}",
+                                        separator, priority_names[priority],
+                                        (unsigned long) dispatch.delivered, (unsigned long) dispatch.overflows,
+                                        (unsigned long) dispatch.max_latency_us,
+                                        (unsigned long) (dispatch.delivered
+                                                         ? dispatch.total_latency_us / dispatch.delivered : 0));
+                separator = ",";
+        }
+        if (!fits || !telemetry_append(writer, "],\"button_events\":["))
+                return -1;
+
+        // Keep room for the closing brackets.
+        writer->size -= 2;
+        uint16_t encoded = 0;
+        while (encoded < records_available) {
+                const telemetry_record_t *record = &batch[encoded];
+                const size_t length = writer->length;
+                bool appended;
+                if (record->event < sizeof(event_names) / sizeof(event_names[0]) && event_names[record->event]) {
+                        appended = telemetry_append(writer,
+                                                    "%s{\"gpio\":%u,\"event\":\"%s\",\"count\":%lu,\"bucket_start\":%lu}",
+                                                    encoded ? "," : "", (unsigned) record->gpio_num,
+                                                    event_names[record->event], (unsigned long) record->count,
+                                                    (unsigned long) record->bucket_start);
+                } else {
+                        appended = telemetry_append(writer,
+                                                    "%s{\"gpio\":%u,\"event\":\"event_%u\",\"count\":%lu,\"bucket_start\":%lu}",
+                                                    encoded ? "," : "", (unsigned) record->gpio_num,
+                                                    (unsigned) record->event, (unsigned long) record->count,
+                                                    (unsigned long) record->bucket_start);
+                }
+                if (!appended) {
+                        writer->length = length;
+                        writer->buffer[length] = '\0';
+                        break;
+                }
+                encoded++;
+        }
+        writer->size += 2;
+        telemetry_append(writer, "]}");
+
+        return encoded;
+}
+
+static void telemetry_failed(uint32_t now) {
+        if (!backoff)
+                backoff = config.backoff_min;
+        else if (backoff < config.backoff_max / 2u)
+                backoff *= 2;
+        else
+                backoff = config.backoff_max;
+        next_attempt = now + backoff;
+}
+
+static int telemetry_upload(bool force) {
+        const uint32_t now = my_uptime_seconds();
+        if (backoff && (int32_t) (now - next_attempt) < 0)
+                return 0;
+
+        portENTER_CRITICAL(&lock);
+        const bool due = count >= config.flush_records
+                || (count && (force || now - records[head].bucket_start >= config.flush_interval));
+        if (!due) {
+                portEXIT_CRITICAL(&lock);
+                return 0;
+        }
+        const uint16_t copied = count;
+        for (uint16_t i = 0; i < copied; i++)
+                batch[i] = records[telemetry_slot(i)];
+        const uint32_t dropped = unreported;
+        unreported = 0;
+        sealed = copied;
+        portEXIT_CRITICAL(&lock);
+
+        telemetry_writer_t writer = { .buffer = payload, .size = sizeof(payload), .length = 0 };
+        const int encoded = telemetry_encode(&writer, copied, dropped);
+
+        // Events may be counted into the records that did not fit again. A
+        // drop that reached beyond the encoded records is an ordinary drop.
+        portENTER_CRITICAL(&lock);
+        const uint16_t kept = encoded > 0 ? (uint16_t) encoded : 0;
+        const uint16_t lost = copied - sealed;
+        if (lost > kept) {
+                unreported += lost - kept;
+                stats.dropped += lost - kept;
+                sealed = 0;
+        } else {
+                sealed = kept - lost;
+        }
+        batch_records = kept;
+        portEXIT_CRITICAL(&lock);
+
+        int status = -1;
+        if (encoded > 0)
+                status = config.post(payload, writer.length, config.post_context);
+        else
+                ESP_LOGE(TAG, "TELEMETRY_PAYLOAD_SIZE %d is too small for a batch", TELEMETRY_PAYLOAD_SIZE);
+        const bool sent = status >= 200 && status < 300;
+
+        portENTER_CRITICAL(&lock);
+        const uint16_t sealed_lost = batch_records - sealed;
+        if (sent) {
+                head = telemetry_slot(sealed);
+                count -= sealed;
+                stats.batches_sent++;
+                stats.records_sent += batch_records;
+        } else {
+                unreported += dropped + sealed_lost;
+                stats.dropped += sealed_lost;
+                stats.batches_failed++;
+        }
+        sealed = 0;
+        batch_records = 0;
+        portEXIT_CRITICAL(&lock);
+
+        if (!sent) {
+                ESP_LOGE(TAG, "Uploading %d records failed with status %d", encoded, status);
+                telemetry_failed(now);
+                return -2;
+        }
+        backoff = 0;
+        return 1;
+}
+
+int telemetry_init(const telemetry_config_t *config_in) {
+        if (!config_in || !telemetry_serial_valid(config_in->serial_number)
+            || (!config_in->post && !config_in->server_url)
+            || !config_in->bucket_seconds || !config_in->flush_records
+            || config_in->flush_records > TELEMETRY_MAX_RECORDS
+            || config_in->backoff_min > config_in->backoff_max)
+                return -3;
+
+        // Formatted aside: a rejected second init must not redirect the
+        // uploads of the running one.
+        char url[sizeof(batch_url)] = "";
+        if (!config_in->post) {
+                const int length = snprintf(url, sizeof(url), "%s%s", config_in->server_url, TELEMETRY_BATCH_PATH);
+                if (length < 0 || (size_t) length >= sizeof(url))
+                        return -3;
+        }
+
+        if (initialised)
+                return -1;
+
+        upload_lock = xSemaphoreCreateMutex();
+        if (!upload_lock) {
+                ESP_LOGE(TAG, "Failed to create upload lock");
+                return -2;
+        }
+
+        memcpy(batch_url, url, sizeof(batch_url));
+        config = *config_in;
+        if (!config.post)
+                config.post = telemetry_http_post;
+        backoff = 0;
+        next_attempt = 0;
+
+        portENTER_CRITICAL(&lock);
+        head = 0;
+        count = 0;
+        sealed = 0;
+        batch_records = 0;
+        unreported = 0;
+        stats = (telemetry_stats_t) { 0 };
+        tracked = 0;
+        initialised = true;
+        portEXIT_CRITICAL(&lock);
+
+        return 0;
+}
+
+void telemetry_deinit(void) {
+        portENTER_CRITICAL(&lock);
+        const uint64_t buttons = tracked;
+        const bool was_initialised = initialised;
+        initialised = false;
+        tracked = 0;
+        count = 0;
+        portEXIT_CRITICAL(&lock);
+
+        if (!was_initialised)
+                return;
+
+        for (int gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+                if (buttons & (1ull << gpio))
+                        button_unsubscribe((gpio_num_t) gpio, telemetry_count, NULL);
+        }
+        vSemaphoreDelete(upload_lock);
+        upload_lock = NULL;
+}
+
+int telemetry_track(gpio_num_t gpio_num, button_event_mask_t event_mask) {
+        if (!initialised)
+                return -4;
+
+        const int result = button_subscribe(gpio_num, event_mask, 0, telemetry_count, NULL);
+        if (result != 0)
+                return result;
+
+        portENTER_CRITICAL(&lock);
+        tracked |= 1ull << gpio_num;
+        portEXIT_CRITICAL(&lock);
+
+        return 0;
+}
+
+int telemetry_untrack(gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return -5;
+
+        portENTER_CRITICAL(&lock);
+        const bool was_tracked = tracked & (1ull << gpio_num);
+        tracked &= ~(1ull << gpio_num);
+        portEXIT_CRITICAL(&lock);
+
+        if (!was_tracked)
+                return -1;
+
+        button_unsubscribe(gpio_num, telemetry_count, NULL);
+        return 0;
+}
+
+int telemetry_poll(bool force) {
+        if (!initialised)
+                return -1;
+
+        xSemaphoreTake(upload_lock, portMAX_DELAY);
+        const int result = telemetry_upload(force);
+        xSemaphoreGive(upload_lock);
+
+        return result;
+}
+
+static void telemetry_task(void *arg) {
+        (void) arg;
+
+        for (;;) {
+                telemetry_poll(false);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+}
+
+int telemetry_start(UBaseType_t task_priority, uint32_t stack_depth) {
+        if (!initialised)
+                return -1;
+
+        if (atomic_load(&telemetry_task_handle))
+                return 0;
+
+        TaskHandle_t task = NULL;
+        if (xTaskCreate(telemetry_task, "telemetry", stack_depth, NULL, task_priority, &task) != pdPASS) {
+                ESP_LOGE(TAG, "Failed to create telemetry task");
+                return -2;
+        }
+        atomic_store(&telemetry_task_handle, task);
+
+        return 0;
+}
+
+int telemetry_get_stats(telemetry_stats_t *stats_out) {
+        portENTER_CRITICAL(&lock);
+        if (!initialised) {
+                portEXIT_CRITICAL(&lock);
+                return -1;
+        }
+        if (stats_out) {
+                *stats_out = stats;
+                stats_out->pending = count;
+        }
+        portEXIT_CRITICAL(&lock);
+
+        return 0;
+}
@@ -0,0 +1,119 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+
+#include "button.h"
+
+// Number of records buffered until they are uploaded. When the buffer is full
+// the oldest record is dropped and counted.
+#ifndef TELEMETRY_MAX_RECORDS
+#define TELEMETRY_MAX_RECORDS 64
+#endif
+
+// Size of the buffer a batch is encoded into. Records that do not fit are left
+// for the next batch.
+#ifndef TELEMETRY_PAYLOAD_SIZE
+#define TELEMETRY_PAYLOAD_SIZE 2048
+#endif
+
+// Path of the batch endpoint, appended to server_url.
+#define TELEMETRY_BATCH_PATH "/api/v1/device-protocol/batch"
+
+// Send the JSON encoded batch. Returns the HTTP status of the response, or a
+// negative value when no response was received.
+typedef int (*telemetry_post_fn)(const char *body, size_t length, void* context);
+
+typedef struct {
+        // Identifies the device to the backend; letters, digits and "-_.:" only.
+        const char *serial_number;
+        // Base URL of the backend, e.g. "https://cms.example.com". Batches are
+        // POSTed to server_url TELEMETRY_BATCH_PATH when post is NULL.
+        const char *server_url;
+        // Transport replacing the HTTP client, for other uplinks and tests.
+        telemetry_post_fn post;
+        void* post_context;
+        // times in seconds
+        // Events of a button within one bucket are counted in one record.
+        uint16_t bucket_seconds;
+        // Upload once this many records are buffered, or once the oldest
+        // record is flush_interval old.
+        uint16_t flush_records;
+        uint16_t flush_interval;
+        // After a failed upload wait backoff_min, doubling on every further
+        // failure up to backoff_max.
+        uint16_t backoff_min;
+        uint16_t backoff_max;
+        // time in milliseconds
+        uint32_t timeout;
+} telemetry_config_t;
+
+static inline telemetry_config_t telemetry_config_default(const char *serial_number, const char *server_url)
+{
+        return (telemetry_config_t) {
+                .serial_number = serial_number,
+                .server_url = server_url,
+                .post = NULL,
+                .post_context = NULL,
+                .bucket_seconds = 60,
+                .flush_records = TELEMETRY_MAX_RECORDS / 2,
+                .flush_interval = 300,
+                .backoff_min = 10,
+                .backoff_max = 600,
+                .timeout = 5000,
+        };
+}
+
+typedef struct {
+        // Records waiting to be uploaded.
+        uint32_t pending;
+        // Records dropped because the buffer was full.
+        uint32_t dropped;
+        uint32_t batches_sent;
+        uint32_t batches_failed;
+        uint32_t records_sent;
+} telemetry_stats_t;
+
+// Returns 0 on success.
+// -1 if telemetry is already initialised.
+// -2 if the upload lock cannot be created.
+// -3 if the serial number is missing or not plain, neither post nor server_url
+//    is set, bucket_seconds or flush_records is 0, flush_records is above
+//    TELEMETRY_MAX_RECORDS or backoff_min is above backoff_max.
+int telemetry_init(const telemetry_config_t *config);
+
+// Stop tracking all buttons and discard the buffered records. Must not race
+// telemetry_poll; the task of telemetry_start is not stopped.
+void telemetry_deinit(void);
+
+// Count the events in event_mask of a registered button.
+// Returns 0 on success, -4 if telemetry is not initialised, and the errors of
+// button_subscribe otherwise.
+int telemetry_track(gpio_num_t gpio_num, button_event_mask_t event_mask);
+
+// Returns 0 on success, -1 if the button is not tracked and -5 if the GPIO
+// number is invalid.
+int telemetry_untrack(gpio_num_t gpio_num);
+
+// Upload one batch if the size or time threshold is reached and no backoff is
+// pending, or with force set as soon as anything is buffered. The button
+// dispatch statistics are sent along as log records.
+// Returns 1 if a batch was uploaded, 0 if none was due, -1 if telemetry is not
+// initialised and -2 if the upload failed; the records are kept then.
+int telemetry_poll(bool force);
+
+// telemetry_poll from a task of its own, once per second. Returns 0, -1 if
+// telemetry is not initialised or -2 if the task cannot be created.
+int telemetry_start(UBaseType_t task_priority, uint32_t stack_depth);
+
+// Returns 0, or -1 if telemetry is not initialised.
+int telemetry_get_stats(telemetry_stats_t *stats);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compares every wrapper_<name> function in an assembly file with c_<name>,
+# ignoring directives, local labels and symbol names.
+set -eu
+
+asm="$1"
+status=0
+
+body() {
+        awk -v name="$1" '
+                $0 == name ":" { inside = 1; next }
+                inside && $1 == ".size" { exit }
+                inside { print }
+        ' "$asm" \
+        | grep -v -E '^[[:space:]]*\.|^\.L[0-9]+:' \
+        | sed -E -e 's/\.L[0-9]+/.L/g' -e 's/_Z[A-Za-z0-9_]+/SYM/g'
+}
+
+names=$(sed -n -E 's/^wrapper_([A-Za-z0-9_]+):$/\1/p' "$asm")
+if [ -z "$names" ]; then
+        echo "no wrapper_* functions in $asm" >&2
+        exit 1
+fi
+
+for name in $names; do
+        if body "wrapper_$name" > "$asm.wrapper" && body "c_$name" > "$asm.c" \
+           && [ -s "$asm.c" ] && cmp -s "$asm.wrapper" "$asm.c"; then
+                echo "codegen $name: identical"
+        else
+                echo "codegen $name: differs" >&2
+                diff "$asm.wrapper" "$asm.c" >&2 || true
+                status=1
+        fi
+done
+
+rm -f "$asm.wrapper" "$asm.c"
+exit $status
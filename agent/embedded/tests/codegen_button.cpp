@@ -0,0 +1,73 @@
+// Compiled to assembly by the codegen target of tests/Makefile. Each
+// wrapper_* function must compile to the same instructions as its c_*
+// counterpart, which uses button.h directly; only symbol names may differ.
+
+#include "button.hpp"
+
+namespace {
+
+struct panel_button : button::default_config {
+        static constexpr gpio_num_t gpio = 5;
+        static constexpr uint16_t long_press_time = 1000;
+        static constexpr uint16_t max_repeat_presses = 2;
+};
+
+} // namespace
+
+struct panel {
+        void on_event(button_event_t event);
+};
+
+void panel_event(button_event_t event);
+
+// What a C caller would write: the configuration as a constant.
+static const button_config_t c_config = {
+        button_active_low, 1000, 300, 2, false, 0, 150, 600, { 0, 0, 0 }, false, 10, 750, false, 0, 1000, 5000, 0, 0, button_priority_normal,
+};
+
+// Free function.
+
+extern "C" int wrapper_function(void) {
+        auto handle = button::handle<panel_button>::bind<&panel_event>();
+        return handle.status();
+}
+
+static void c_function_trampoline(button_event_t event, void* context) {
+        (void) context;
+        panel_event(event);
+}
+
+extern "C" int c_function(void) {
+        const int status = button_create(5, c_config, c_function_trampoline, nullptr);
+        if (status == 0)
+                button_destroy(5);
+        return status;
+}
+
+// Member function.
+
+extern "C" int wrapper_method(panel* object) {
+        auto handle = button::handle<panel_button>::bind<&panel::on_event>(*object);
+        return handle.status();
+}
+
+static void c_method_trampoline(button_event_t event, void* context) {
+        static_cast<panel*>(context)->on_event(event);
+}
+
+extern "C" int c_method(panel* object) {
+        const int status = button_create(5, c_config, c_method_trampoline, object);
+        if (status == 0)
+                button_destroy(5);
+        return status;
+}
+
+// Trampolines, emitted under known names.
+
+extern "C" void wrapper_trampoline(button_event_t event, void* context) {
+        button::detail::method_trampoline<&panel::on_event, panel>(event, context);
+}
+
+extern "C" void c_trampoline(button_event_t event, void* context) {
+        c_method_trampoline(event, context);
+}
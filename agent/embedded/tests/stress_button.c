@@ -0,0 +1,250 @@
+// Concurrency stress benchmark, run against the pthread emulation in
+// stubs/emulation.c: worker tasks create and destroy buttons on a shared set
+// of pins while an interrupt thread storms those pins with bouncing edges and
+// a poller reads the pressed state. Ownership and callback invariants are
+// checked throughout; lock hold times and contention are reported at the end.
+//
+//   stress_button [seconds]
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "button.h"
+#include "emulation.h"
+
+#define STRESS_WORKERS 4
+#define STRESS_PINS 8
+#define STRESS_FIRST_GPIO 4
+
+typedef enum {
+        stress_idle,
+        stress_creating,
+        stress_live,
+        stress_destroying,
+} stress_state_t;
+
+typedef struct {
+        int worker;
+        gpio_num_t gpio;
+        _Atomic stress_state_t state;
+} stress_binding_t;
+
+static stress_binding_t bindings[STRESS_WORKERS][STRESS_PINS];
+static _Atomic int owners[STRESS_PINS];
+static atomic_bool running;
+
+static atomic_uint_fast64_t creates;
+static atomic_uint_fast64_t creates_taken;
+static atomic_uint_fast64_t events;
+static atomic_uint_fast64_t subscriber_events;
+static atomic_uint_fast64_t polls;
+static atomic_uint_fast64_t violations;
+
+static void violation(const char *what, const stress_binding_t *binding) {
+        atomic_fetch_add(&violations, 1);
+        fprintf(stderr, "violation: %s (worker %d, GPIO %d)\n", what, binding->worker, (int) binding->gpio);
+}
+
+static void check_callback(const stress_binding_t *binding) {
+        if (atomic_load(&binding->state) == stress_idle)
+                violation("callback of a destroyed button", binding);
+}
+
+static void stress_callback(button_event_t event, void *context) {
+        (void) event;
+        check_callback(context);
+        atomic_fetch_add_explicit(&events, 1, memory_order_relaxed);
+}
+
+static void stress_subscriber(const button_event_info_t *info, void *context) {
+        const stress_binding_t *binding = context;
+        if (info->gpio_num != binding->gpio)
+                violation("subscriber called for another GPIO", binding);
+        check_callback(binding);
+        atomic_fetch_add_explicit(&subscriber_events, 1, memory_order_relaxed);
+}
+
+static void sleep_us(long us) {
+        const struct timespec delay = { .tv_sec = 0, .tv_nsec = us * 1000 };
+        nanosleep(&delay, NULL);
+}
+
+static void *stress_worker(void *arg) {
+        const int worker = (int) (intptr_t) arg;
+        unsigned int seed = (unsigned int) worker + 1;
+
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 5;
+        config.repeat_press_timeout = 3;
+        config.max_repeat_presses = 2;
+        // One worker per class, so events also race through the dispatcher.
+        config.priority = (button_priority_t) (worker % BUTTON_PRIORITY_CLASSES);
+
+        while (atomic_load(&running)) {
+                const size_t pin = (size_t) rand_r(&seed) % STRESS_PINS;
+                stress_binding_t *binding = &bindings[worker][pin];
+
+                atomic_store(&binding->state, stress_creating);
+                const int result = button_create(binding->gpio, config, stress_callback, binding);
+                if (result == -1) {
+                        atomic_store(&binding->state, stress_idle);
+                        atomic_fetch_add_explicit(&creates_taken, 1, memory_order_relaxed);
+                        continue;
+                }
+                if (result != 0) {
+                        violation("button_create failed", binding);
+                        atomic_store(&binding->state, stress_idle);
+                        continue;
+                }
+
+                int expected = -1;
+                if (!atomic_compare_exchange_strong(&owners[pin], &expected, worker))
+                        violation("GPIO owned twice", binding);
+                atomic_store(&binding->state, stress_live);
+                atomic_fetch_add_explicit(&creates, 1, memory_order_relaxed);
+
+                if (rand_r(&seed) % 2)
+                        button_subscribe(binding->gpio, BUTTON_EVENT_MASK_ALL, 0, stress_subscriber, binding);
+                // Mostly short lives to race create against destroy, some long
+                // enough for debounce and press timers to fire.
+                sleep_us(rand_r(&seed) % (rand_r(&seed) % 4 ? 2000 : 40000));
+                if (rand_r(&seed) % 4 == 0)
+                        button_unsubscribe(binding->gpio, stress_subscriber, binding);
+
+                atomic_store(&binding->state, stress_destroying);
+                atomic_store(&owners[pin], -1);
+                button_destroy(binding->gpio);
+                atomic_store(&binding->state, stress_idle);
+        }
+
+        return NULL;
+}
+
+static void *stress_poller(void *arg) {
+        (void) arg;
+        uint32_t last_generation = 0;
+
+        while (atomic_load(&running)) {
+                uint32_t generation;
+                const uint64_t mask = button_get_pressed_mask(&generation);
+                if (mask & ~(((1ull << STRESS_PINS) - 1) << STRESS_FIRST_GPIO)) {
+                        atomic_fetch_add(&violations, 1);
+                        fprintf(stderr, "violation: pressed bit outside the stressed pins\n");
+                }
+                if ((int32_t) (generation - last_generation) < 0) {
+                        atomic_fetch_add(&violations, 1);
+                        fprintf(stderr, "violation: pressed generation went backwards\n");
+                }
+                last_generation = generation;
+                atomic_fetch_add_explicit(&polls, 1, memory_order_relaxed);
+                sched_yield();
+        }
+
+        return NULL;
+}
+
+static void report_lock(const char *name, emulation_lock_kind_t kind) {
+        emulation_lock_stats_t stats;
+        emulation_lock_stats(kind, &stats);
+
+        const double acquisitions = stats.acquisitions ? (double) stats.acquisitions : 1.0;
+        const double contended = stats.contended ? (double) stats.contended : 1.0;
+        printf("%-9s %10llu acquisitions, %5.2f%% contended, hold avg %.2f us max %.1f us, wait avg %.2f us max %.1f us\n",
+               name,
+               (unsigned long long) stats.acquisitions,
+               100.0 * (double) stats.contended / acquisitions,
+               (double) stats.hold_ns_total / acquisitions / 1000.0,
+               (double) stats.hold_ns_max / 1000.0,
+               (double) stats.wait_ns_total / contended / 1000.0,
+               (double) stats.wait_ns_max / 1000.0);
+}
+
+int main(int argc, char **argv) {
+        const double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+        gpio_num_t gpios[STRESS_PINS];
+        for (size_t pin = 0; pin < STRESS_PINS; pin++) {
+                gpios[pin] = (gpio_num_t) (STRESS_FIRST_GPIO + pin);
+                atomic_store(&owners[pin], -1);
+                for (int worker = 0; worker < STRESS_WORKERS; worker++) {
+                        bindings[worker][pin].worker = worker;
+                        bindings[worker][pin].gpio = gpios[pin];
+                }
+        }
+
+        const emulation_storm_t storm = {
+                .gpios = gpios,
+                .count = STRESS_PINS,
+                .burst = 6,
+                .interval_us = 1000,
+        };
+
+        if (button_dispatcher_start(5, 4096) != 0) {
+                fprintf(stderr, "stress: cannot start the event dispatcher\n");
+                return 1;
+        }
+
+        atomic_store(&running, true);
+        emulation_storm_start(&storm);
+
+        pthread_t workers[STRESS_WORKERS];
+        for (int worker = 0; worker < STRESS_WORKERS; worker++)
+                pthread_create(&workers[worker], NULL, stress_worker, (void*) (intptr_t) worker);
+        pthread_t poller;
+        pthread_create(&poller, NULL, stress_poller, NULL);
+
+        const struct timespec duration = {
+                .tv_sec = (time_t) seconds,
+                .tv_nsec = (long) ((seconds - (double) (time_t) seconds) * 1e9),
+        };
+        nanosleep(&duration, NULL);
+
+        atomic_store(&running, false);
+        for (int worker = 0; worker < STRESS_WORKERS; worker++)
+                pthread_join(workers[worker], NULL);
+        pthread_join(poller, NULL);
+        const uint64_t edges = emulation_storm_stop();
+
+        if (button_get_pressed_mask(NULL) != 0) {
+                atomic_fetch_add(&violations, 1);
+                fprintf(stderr, "violation: destroyed buttons still read as pressed\n");
+        }
+        emulation_shutdown();
+
+        printf("stress: %.1f s, %d workers on %d pins\n", seconds, STRESS_WORKERS, STRESS_PINS);
+        printf("buttons   %10llu created, %llu found taken\n",
+               (unsigned long long) atomic_load(&creates), (unsigned long long) atomic_load(&creates_taken));
+        printf("edges     %10llu raised, %llu timer callbacks\n",
+               (unsigned long long) edges, (unsigned long long) emulation_timer_callbacks());
+        printf("events    %10llu delivered, %llu to subscribers, %llu polls\n",
+               (unsigned long long) atomic_load(&events),
+               (unsigned long long) atomic_load(&subscriber_events),
+               (unsigned long long) atomic_load(&polls));
+        report_lock("mutex", emulation_lock_mutex);
+        report_lock("critical", emulation_lock_critical);
+        for (int priority = 0; priority < BUTTON_PRIORITY_CLASSES; priority++) {
+                button_priority_stats_t stats;
+                button_get_priority_stats((button_priority_t) priority, &stats, false);
+                printf("class %d   %10lu delivered, %lu overflows, latency avg %.1f us max %lu us\n",
+                       priority,
+                       (unsigned long) stats.delivered,
+                       (unsigned long) stats.overflows,
+                       stats.delivered ? (double) stats.total_latency_us / stats.delivered : 0.0,
+                       (unsigned long) stats.max_latency_us);
+        }
+
+        const uint64_t failed = atomic_load(&violations);
+        if (failed) {
+                printf("stress: %llu violations\n", (unsigned long long) failed);
+                return 1;
+        }
+
+        printf("stress test passed\n");
+        return 0;
+}
@@ -0,0 +1,920 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "port.h"
+#include "emulation.h"
+
+#define EMULATION_MAX_TIMERS (4 * GPIO_NUM_MAX)
+#define EMULATION_NS_PER_TICK (1000000000u / configTICK_RATE_HZ)
+
+typedef struct {
+        atomic_uint_fast64_t acquisitions;
+        atomic_uint_fast64_t contended;
+        atomic_uint_fast64_t hold_ns_total;
+        atomic_uint_fast64_t hold_ns_max;
+        atomic_uint_fast64_t wait_ns_total;
+        atomic_uint_fast64_t wait_ns_max;
+} emulation_lock_counters_t;
+
+// A mutex, or a count guarded by the mutex when counting is set; takes of a
+// counting semaphore wait on cond.
+struct FakeSemaphore {
+        pthread_mutex_t mutex;
+        uint64_t acquired_ns;
+        bool counting;
+        pthread_cond_t cond;
+        UBaseType_t count;
+        UBaseType_t max_count;
+};
+
+// Sends never block, receives poll; the component only uses them that way.
+struct FakeQueue {
+        pthread_mutex_t mutex;
+        UBaseType_t length;
+        UBaseType_t item_size;
+        UBaseType_t head;
+        UBaseType_t count;
+        unsigned char items[];
+};
+
+// Task handles tell threads apart; every thread is a task of its own.
+// notified and the notification value are guarded by lock.
+struct FakeTask {
+        pthread_mutex_t lock;
+        bool notified;
+        uint32_t notification_value;
+};
+
+static pthread_once_t s_init_once = PTHREAD_ONCE_INIT;
+static uint64_t s_start_ns;
+
+static emulation_lock_counters_t s_lock_counters[emulation_lock_kinds];
+
+static _Thread_local struct FakeTask tls_task = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Timer service. All timer fields are guarded by s_timer_mutex.
+static pthread_mutex_t s_timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timer_cond;
+static pthread_t s_timer_thread;
+static TaskHandle_t _Atomic s_timer_task;
+static TimerHandle_t s_timers[EMULATION_MAX_TIMERS];
+static size_t s_timer_count;
+static bool s_timer_shutdown;
+static atomic_uint_fast64_t s_timer_callbacks;
+
+// Interrupt controller. Holding s_isr_mutex is running in the GPIO interrupt,
+// so removing a handler waits for a dispatch in flight on the other core.
+static pthread_mutex_t s_isr_mutex = PTHREAD_MUTEX_INITIALIZER;
+static gpio_isr_t s_isr_handlers[GPIO_NUM_MAX];
+static void *s_isr_args[GPIO_NUM_MAX];
+static void (*s_direct_isr)(void *);
+static void *s_direct_isr_arg;
+static uint32_t s_intr_status[MY_GPIO_STATUS_WORDS];
+static atomic_bool s_intr_enabled[GPIO_NUM_MAX];
+static atomic_uint s_gpio_levels[GPIO_NUM_MAX];
+
+static pthread_t s_storm_thread;
+static const emulation_storm_t *s_storm;
+static atomic_bool s_storm_running;
+static atomic_uint_fast64_t s_storm_edges;
+
+static uint64_t emulation_now_ns(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static void *emulation_timer_task(void *arg);
+
+static void emulation_init(void) {
+        s_start_ns = emulation_now_ns();
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&s_timer_cond, &attr);
+        pthread_condattr_destroy(&attr);
+
+        pthread_create(&s_timer_thread, NULL, emulation_timer_task, NULL);
+        while (!atomic_load(&s_timer_task))
+                sched_yield();
+}
+
+static void emulation_ensure_init(void) {
+        pthread_once(&s_init_once, emulation_init);
+}
+
+static void emulation_atomic_max(atomic_uint_fast64_t *max, uint64_t value) {
+        uint_fast64_t current = atomic_load_explicit(max, memory_order_relaxed);
+        while (value > current
+               && !atomic_compare_exchange_weak_explicit(max, &current, value,
+                                                         memory_order_relaxed, memory_order_relaxed)) {
+        }
+}
+
+// Locks mutex, counting the wait when it was taken. Returns when it was
+// acquired.
+static uint64_t emulation_lock(pthread_mutex_t *mutex, emulation_lock_kind_t kind) {
+        emulation_lock_counters_t *counters = &s_lock_counters[kind];
+
+        if (pthread_mutex_trylock(mutex) != 0) {
+                const uint64_t start = emulation_now_ns();
+                pthread_mutex_lock(mutex);
+                const uint64_t waited = emulation_now_ns() - start;
+
+                atomic_fetch_add_explicit(&counters->contended, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&counters->wait_ns_total, waited, memory_order_relaxed);
+                emulation_atomic_max(&counters->wait_ns_max, waited);
+        }
+
+        atomic_fetch_add_explicit(&counters->acquisitions, 1, memory_order_relaxed);
+        return emulation_now_ns();
+}
+
+static void emulation_unlock(pthread_mutex_t *mutex, emulation_lock_kind_t kind, uint64_t acquired_ns) {
+        const uint64_t held = emulation_now_ns() - acquired_ns;
+        pthread_mutex_unlock(mutex);
+
+        emulation_lock_counters_t *counters = &s_lock_counters[kind];
+        atomic_fetch_add_explicit(&counters->hold_ns_total, held, memory_order_relaxed);
+        emulation_atomic_max(&counters->hold_ns_max, held);
+}
+
+void emulation_critical_init(portMUX_TYPE *mux) {
+        pthread_mutex_init(&mux->mutex, NULL);
+        mux->acquired_ns = 0;
+}
+
+void emulation_critical_enter(portMUX_TYPE *mux) {
+        const uint64_t acquired = emulation_lock(&mux->mutex, emulation_lock_critical);
+        mux->acquired_ns = acquired;
+}
+
+void emulation_critical_exit(portMUX_TYPE *mux) {
+        emulation_unlock(&mux->mutex, emulation_lock_critical, mux->acquired_ns);
+}
+
+void emulation_lock_stats(emulation_lock_kind_t kind, emulation_lock_stats_t *stats) {
+        const emulation_lock_counters_t *counters = &s_lock_counters[kind];
+        stats->acquisitions = atomic_load(&counters->acquisitions);
+        stats->contended = atomic_load(&counters->contended);
+        stats->hold_ns_total = atomic_load(&counters->hold_ns_total);
+        stats->hold_ns_max = atomic_load(&counters->hold_ns_max);
+        stats->wait_ns_total = atomic_load(&counters->wait_ns_total);
+        stats->wait_ns_max = atomic_load(&counters->wait_ns_max);
+}
+
+static void emulation_deadline(struct timespec *deadline, clockid_t clock, TickType_t ticks) {
+        clock_gettime(clock, deadline);
+        const uint64_t nsec = (uint64_t) deadline->tv_nsec + (uint64_t) ticks * EMULATION_NS_PER_TICK;
+        deadline->tv_sec += (time_t) (nsec / 1000000000u);
+        deadline->tv_nsec = (long) (nsec % 1000000000u);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+        struct FakeSemaphore *sem = calloc(1, sizeof(*sem));
+        if (sem)
+                pthread_mutex_init(&sem->mutex, NULL);
+        return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+        struct FakeSemaphore *sem = calloc(1, sizeof(*sem));
+        if (!sem)
+                return NULL;
+
+        pthread_mutex_init(&sem->mutex, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&sem->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        sem->counting = true;
+        sem->count = initial_count;
+        sem->max_count = max_count;
+        return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+        if (!semaphore)
+                return;
+
+        if (semaphore->counting)
+                pthread_cond_destroy(&semaphore->cond);
+        pthread_mutex_destroy(&semaphore->mutex);
+        free(semaphore);
+}
+
+static BaseType_t emulation_counting_take(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+        struct timespec deadline;
+        if (ticks_to_wait != portMAX_DELAY)
+                emulation_deadline(&deadline, CLOCK_MONOTONIC, ticks_to_wait);
+
+        pthread_mutex_lock(&semaphore->mutex);
+        while (!semaphore->count) {
+                if (ticks_to_wait == portMAX_DELAY) {
+                        pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+                } else if (pthread_cond_timedwait(&semaphore->cond, &semaphore->mutex, &deadline) == ETIMEDOUT) {
+                        break;
+                }
+        }
+
+        const BaseType_t taken = semaphore->count ? pdTRUE : pdFALSE;
+        if (taken)
+                semaphore->count--;
+        pthread_mutex_unlock(&semaphore->mutex);
+        return taken;
+}
+
+static BaseType_t emulation_counting_give(SemaphoreHandle_t semaphore) {
+        pthread_mutex_lock(&semaphore->mutex);
+        const BaseType_t given = semaphore->count < semaphore->max_count ? pdTRUE : pdFALSE;
+        if (given) {
+                semaphore->count++;
+                pthread_cond_signal(&semaphore->cond);
+        }
+        pthread_mutex_unlock(&semaphore->mutex);
+        return given;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+        if (!semaphore)
+                return pdFALSE;
+        if (semaphore->counting)
+                return emulation_counting_take(semaphore, ticks_to_wait);
+
+        if (ticks_to_wait != portMAX_DELAY) {
+                if (pthread_mutex_trylock(&semaphore->mutex) != 0) {
+                        atomic_fetch_add_explicit(&s_lock_counters[emulation_lock_mutex].contended, 1,
+                                                  memory_order_relaxed);
+
+                        struct timespec deadline;
+                        emulation_deadline(&deadline, CLOCK_REALTIME, ticks_to_wait);
+                        if (pthread_mutex_timedlock(&semaphore->mutex, &deadline) != 0)
+                                return pdFALSE;
+                }
+                atomic_fetch_add_explicit(&s_lock_counters[emulation_lock_mutex].acquisitions, 1,
+                                          memory_order_relaxed);
+                semaphore->acquired_ns = emulation_now_ns();
+                return pdTRUE;
+        }
+
+        const uint64_t acquired = emulation_lock(&semaphore->mutex, emulation_lock_mutex);
+        semaphore->acquired_ns = acquired;
+        return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+        if (!semaphore)
+                return pdFALSE;
+        if (semaphore->counting)
+                return emulation_counting_give(semaphore);
+
+        emulation_unlock(&semaphore->mutex, emulation_lock_mutex, semaphore->acquired_ns);
+        return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken) {
+        // Like FreeRTOS, only ever sets the flag; no task is woken here.
+        (void) higher_priority_task_woken;
+        return xSemaphoreGive(semaphore);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+        struct FakeQueue *queue = calloc(1, sizeof(*queue) + (size_t) length * item_size);
+        if (queue) {
+                pthread_mutex_init(&queue->mutex, NULL);
+                queue->length = length;
+                queue->item_size = item_size;
+        }
+        return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+        if (!queue)
+                return;
+
+        pthread_mutex_destroy(&queue->mutex);
+        free(queue);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!queue)
+                return pdFALSE;
+
+        const uint64_t acquired = emulation_lock(&queue->mutex, emulation_lock_mutex);
+        const BaseType_t sent = queue->count < queue->length ? pdTRUE : pdFALSE;
+        if (sent) {
+                const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+                memcpy(&queue->items[(size_t) tail * queue->item_size], item, queue->item_size);
+                queue->count++;
+        }
+        emulation_unlock(&queue->mutex, emulation_lock_mutex, acquired);
+        return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!queue)
+                return pdFALSE;
+
+        const uint64_t acquired = emulation_lock(&queue->mutex, emulation_lock_mutex);
+        const BaseType_t received = queue->count ? pdTRUE : pdFALSE;
+        if (received) {
+                memcpy(item, &queue->items[(size_t) queue->head * queue->item_size], queue->item_size);
+                queue->head = (queue->head + 1) % queue->length;
+                queue->count--;
+        }
+        emulation_unlock(&queue->mutex, emulation_lock_mutex, acquired);
+        return received;
+}
+
+TickType_t xTaskGetTickCount(void) {
+        emulation_ensure_init();
+        return (TickType_t) ((emulation_now_ns() - s_start_ns) / EMULATION_NS_PER_TICK);
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+        return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+        return &tls_task;
+}
+
+typedef struct {
+        TaskFunction_t code;
+        void *parameters;
+        TaskHandle_t _Atomic handle;
+} emulation_task_start_t;
+
+static void *emulation_task_entry(void *arg) {
+        emulation_task_start_t *start = arg;
+        const TaskFunction_t code = start->code;
+        void * const parameters = start->parameters;
+        atomic_store(&start->handle, &tls_task);
+
+        code(parameters);
+        return NULL;
+}
+
+// Every task is a detached thread. The creator waits until the thread has
+// published its handle, as FreeRTOS hands out the handle before returning.
+BaseType_t xTaskCreate(TaskFunction_t task_code,
+                       const char * const name,
+                       uint32_t stack_depth,
+                       void * const parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t * const created_task) {
+        (void) name;
+        (void) stack_depth;
+        (void) priority;
+
+        emulation_task_start_t start = { .code = task_code, .parameters = parameters };
+        atomic_init(&start.handle, NULL);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        const int result = pthread_create(&thread, &attr, emulation_task_entry, &start);
+        pthread_attr_destroy(&attr);
+        if (result != 0)
+                return pdFAIL;
+
+        TaskHandle_t handle;
+        while (!(handle = atomic_load(&start.handle)))
+                sched_yield();
+        if (created_task)
+                *created_task = handle;
+        return pdPASS;
+}
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(void) {
+        emulation_ensure_init();
+        return atomic_load(&s_timer_task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+        const uint64_t ns = (uint64_t) (ticks ? ticks : 1) * EMULATION_NS_PER_TICK;
+        const struct timespec delay = {
+                .tv_sec = (time_t) (ns / 1000000000u),
+                .tv_nsec = (long) (ns % 1000000000u),
+        };
+        nanosleep(&delay, NULL);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+        if (!task)
+                return pdFAIL;
+
+        BaseType_t result = pdPASS;
+        pthread_mutex_lock(&task->lock);
+        switch (action) {
+        case eSetBits: task->notification_value |= value; break;
+        case eIncrement: task->notification_value++; break;
+        case eSetValueWithoutOverwrite:
+                if (task->notified)
+                        result = pdFAIL;
+                else
+                        task->notification_value = value;
+                break;
+        case eSetValueWithOverwrite: task->notification_value = value; break;
+        default: break;
+        }
+        task->notified = true;
+        pthread_mutex_unlock(&task->lock);
+        return result;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task,
+                              uint32_t value,
+                              eNotifyAction action,
+                              BaseType_t *higher_priority_task_woken) {
+        (void) higher_priority_task_woken;
+        return xTaskNotify(task, value, action);
+}
+
+// Polls once per tick; nothing in the emulation waits on notifications in a
+// latency-sensitive path.
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry,
+                           uint32_t bits_to_clear_on_exit,
+                           uint32_t *notification_value,
+                           TickType_t ticks_to_wait) {
+        struct FakeTask *task = &tls_task;
+        pthread_mutex_lock(&task->lock);
+        if (!task->notified)
+                task->notification_value &= ~bits_to_clear_on_entry;
+
+        for (TickType_t waited = 0; !task->notified && waited < ticks_to_wait; waited++) {
+                pthread_mutex_unlock(&task->lock);
+                vTaskDelay(1);
+                pthread_mutex_lock(&task->lock);
+        }
+
+        if (notification_value)
+                *notification_value = task->notification_value;
+        const bool notified = task->notified;
+        if (notified) {
+                task->notified = false;
+                task->notification_value &= ~bits_to_clear_on_exit;
+        }
+        pthread_mutex_unlock(&task->lock);
+        return notified ? pdTRUE : pdFALSE;
+}
+
+// Runs due timers one at a time, like the FreeRTOS timer service task. The
+// timer mutex is released while a callback runs.
+static void *emulation_timer_task(void *arg) {
+        (void) arg;
+        atomic_store(&s_timer_task, &tls_task);
+
+        pthread_mutex_lock(&s_timer_mutex);
+        while (!s_timer_shutdown) {
+                TimerHandle_t next = NULL;
+                for (size_t i = 0; i < s_timer_count; i++) {
+                        TimerHandle_t timer = s_timers[i];
+                        if (timer->active && (!next || (int32_t) (timer->expiry - next->expiry) < 0))
+                                next = timer;
+                }
+
+                if (!next) {
+                        pthread_cond_wait(&s_timer_cond, &s_timer_mutex);
+                        continue;
+                }
+
+                const TickType_t now = xTaskGetTickCount();
+                if ((int32_t) (next->expiry - now) > 0) {
+                        const uint64_t deadline_ns = s_start_ns + (uint64_t) next->expiry * EMULATION_NS_PER_TICK;
+                        const struct timespec deadline = {
+                                .tv_sec = (time_t) (deadline_ns / 1000000000u),
+                                .tv_nsec = (long) (deadline_ns % 1000000000u),
+                        };
+                        pthread_cond_timedwait(&s_timer_cond, &s_timer_mutex, &deadline);
+                        continue;
+                }
+
+                next->active = next->auto_reload;
+                next->expiry += next->period;
+                TimerCallbackFunction_t callback = next->callback;
+                pthread_mutex_unlock(&s_timer_mutex);
+
+                callback(next);
+                atomic_fetch_add_explicit(&s_timer_callbacks, 1, memory_order_relaxed);
+
+                pthread_mutex_lock(&s_timer_mutex);
+        }
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return NULL;
+}
+
+uint64_t emulation_timer_callbacks(void) {
+        return atomic_load(&s_timer_callbacks);
+}
+
+void emulation_shutdown(void) {
+        emulation_ensure_init();
+
+        pthread_mutex_lock(&s_timer_mutex);
+        s_timer_shutdown = true;
+        pthread_cond_signal(&s_timer_cond);
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        pthread_join(s_timer_thread, NULL);
+}
+
+TimerHandle_t xTimerCreateStatic(const char * const name,
+                                 TickType_t period_in_ticks,
+                                 UBaseType_t auto_reload,
+                                 void * const timer_id,
+                                 TimerCallbackFunction_t callback,
+                                 StaticTimer_t *timer_buffer) {
+        (void) name;
+
+        if (!timer_buffer)
+                return NULL;
+
+        emulation_ensure_init();
+
+        pthread_mutex_lock(&s_timer_mutex);
+        timer_buffer->id = timer_id;
+        timer_buffer->callback = callback;
+        timer_buffer->active = pdFALSE;
+        timer_buffer->auto_reload = auto_reload ? pdTRUE : pdFALSE;
+        timer_buffer->period = period_in_ticks;
+
+        bool registered = false;
+        for (size_t i = 0; i < s_timer_count; i++)
+                registered |= s_timers[i] == timer_buffer;
+
+        TimerHandle_t result = timer_buffer;
+        if (!registered) {
+                if (s_timer_count < EMULATION_MAX_TIMERS)
+                        s_timers[s_timer_count++] = timer_buffer;
+                else
+                        result = NULL;
+        }
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return result;
+}
+
+static BaseType_t emulation_timer_arm(TimerHandle_t timer, const TickType_t *new_period) {
+        if (!timer)
+                return pdFAIL;
+
+        pthread_mutex_lock(&s_timer_mutex);
+        if (new_period)
+                timer->period = *new_period;
+        timer->active = pdTRUE;
+        timer->expiry = xTaskGetTickCount() + timer->period;
+        pthread_cond_signal(&s_timer_cond);
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return pdPASS;
+}
+
+static void emulation_no_yield(BaseType_t *higher_priority_task_woken) {
+        if (higher_priority_task_woken)
+                *higher_priority_task_woken = pdFALSE;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t new_period, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        return emulation_timer_arm(timer, &new_period);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        return emulation_timer_arm(timer, NULL);
+}
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken) {
+        emulation_no_yield(higher_priority_task_woken);
+        return emulation_timer_arm(timer, NULL);
+}
+
+BaseType_t xTimerChangePeriodFromISR(TimerHandle_t timer,
+                                     TickType_t new_period,
+                                     BaseType_t *higher_priority_task_woken) {
+        emulation_no_yield(higher_priority_task_woken);
+        return emulation_timer_arm(timer, &new_period);
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken) {
+        emulation_no_yield(higher_priority_task_woken);
+        return emulation_timer_arm(timer, NULL);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!timer)
+                return pdFAIL;
+
+        pthread_mutex_lock(&s_timer_mutex);
+        timer->active = pdFALSE;
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!timer)
+                return pdFAIL;
+
+        pthread_mutex_lock(&s_timer_mutex);
+        timer->active = pdFALSE;
+        for (size_t i = 0; i < s_timer_count; i++) {
+                if (s_timers[i] == timer) {
+                        s_timers[i] = s_timers[--s_timer_count];
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer) {
+        if (!timer)
+                return pdFALSE;
+
+        pthread_mutex_lock(&s_timer_mutex);
+        const BaseType_t active = timer->active;
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return active;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) {
+        if (!timer)
+                return NULL;
+
+        pthread_mutex_lock(&s_timer_mutex);
+        void *id = timer->id;
+        pthread_mutex_unlock(&s_timer_mutex);
+
+        return id;
+}
+
+esp_err_t gpio_install_isr_service(int flags) {
+        (void) flags;
+        return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+        (void) intr_type;
+        return GPIO_IS_VALID_GPIO(gpio_num) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return ESP_FAIL;
+
+        pthread_mutex_lock(&s_isr_mutex);
+        s_isr_handlers[gpio_num] = isr_handler;
+        s_isr_args[gpio_num] = args;
+        pthread_mutex_unlock(&s_isr_mutex);
+
+        return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return ESP_FAIL;
+
+        pthread_mutex_lock(&s_isr_mutex);
+        s_isr_handlers[gpio_num] = NULL;
+        s_isr_args[gpio_num] = NULL;
+        pthread_mutex_unlock(&s_isr_mutex);
+
+        return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return ESP_FAIL;
+
+        atomic_store(&s_intr_enabled[gpio_num], true);
+        return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return ESP_FAIL;
+
+        atomic_store(&s_intr_enabled[gpio_num], false);
+        return ESP_OK;
+}
+
+uint32_t gpio_get_level(gpio_num_t gpio_num) {
+        return GPIO_IS_VALID_GPIO(gpio_num) ? atomic_load(&s_gpio_levels[gpio_num]) : 0;
+}
+
+void my_gpio_enable(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+void my_gpio_pullup(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+void my_gpio_pulldown(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+uint8_t my_gpio_read(gpio_num_t gpio) {
+        return (uint8_t) gpio_get_level(gpio);
+}
+
+uint64_t my_gpio_boot_latch(uint64_t pullup_mask, uint64_t pulldown_mask) {
+        (void) pullup_mask;
+        (void) pulldown_mask;
+
+        uint64_t levels = 0;
+        for (int gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+                if (gpio_get_level((gpio_num_t) gpio))
+                        levels |= 1ull << gpio;
+        }
+        return levels;
+}
+
+uint8_t my_gpio_read_from_isr(gpio_num_t gpio) {
+        return (uint8_t) gpio_get_level(gpio);
+}
+
+void my_gpio_output(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+void my_gpio_write_from_isr(gpio_num_t gpio, bool high) {
+        atomic_store(&s_gpio_levels[gpio], high ? 1u : 0u);
+}
+
+void my_gpio_toggle_from_isr(gpio_num_t gpio) {
+        atomic_fetch_xor(&s_gpio_levels[gpio], 1u);
+}
+
+void my_gpio_intr_disable_from_isr(gpio_num_t gpio) {
+        gpio_intr_disable(gpio);
+}
+
+esp_err_t my_gpio_isr_register(void (*handler)(void *), void *arg, int flags) {
+        (void) flags;
+
+        pthread_mutex_lock(&s_isr_mutex);
+        const bool taken = s_direct_isr != NULL;
+        if (!taken) {
+                s_direct_isr = handler;
+                s_direct_isr_arg = arg;
+        }
+        pthread_mutex_unlock(&s_isr_mutex);
+
+        return taken ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+// Only called by the interrupt thread, with s_isr_mutex held.
+void my_gpio_intr_status_take_from_isr(uint32_t status[MY_GPIO_STATUS_WORDS]) {
+        for (size_t i = 0; i < MY_GPIO_STATUS_WORDS; i++) {
+                status[i] = s_intr_status[i];
+                s_intr_status[i] = 0;
+        }
+}
+
+uint32_t my_time_us_from_isr(void) {
+        emulation_ensure_init();
+        return (uint32_t) ((emulation_now_ns() - s_start_ns) / 1000u);
+}
+
+bool my_flash_cache_enabled_from_isr(void) {
+        return true;
+}
+
+uint32_t my_uptime_seconds(void) {
+        return (uint32_t) (xTaskGetTickCount() / configTICK_RATE_HZ);
+}
+
+// No touch pads; the stress benchmark only drives GPIOs.
+int my_touch_channel(gpio_num_t gpio) {
+        (void) gpio;
+        return -1;
+}
+
+esp_err_t my_touch_enable(int channel) {
+        (void) channel;
+        return ESP_ERR_NOT_SUPPORTED;
+}
+
+void my_touch_disable(int channel) {
+        (void) channel;
+}
+
+void my_touch_read(const uint8_t *channels, size_t count, uint32_t *raw) {
+        (void) channels;
+        for (size_t i = 0; i < count; i++)
+                raw[i] = 0;
+}
+
+bool my_touch_lowers_count(void) {
+        return false;
+}
+
+uint32_t my_gpio_glitch_filter_enable(gpio_num_t gpio, uint32_t window_ns) {
+        (void) gpio;
+        (void) window_ns;
+        return 0;
+}
+
+void my_gpio_glitch_filter_disable(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+const char *esp_err_to_name(esp_err_t err) {
+        switch (err) {
+        case ESP_OK:
+                return "ESP_OK";
+        case ESP_ERR_INVALID_STATE:
+                return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:
+                return "ESP_ERR_NOT_FOUND";
+        case ESP_FAIL:
+                return "ESP_FAIL";
+        default:
+                return "ESP_ERR_UNKNOWN";
+        }
+}
+
+static void emulation_raise(gpio_num_t gpio, uint32_t level) {
+        pthread_mutex_lock(&s_isr_mutex);
+        atomic_store(&s_gpio_levels[gpio], level);
+        if (atomic_load(&s_intr_enabled[gpio])) {
+                if (s_direct_isr) {
+                        s_intr_status[gpio / 32] |= 1u << (gpio % 32);
+                        s_direct_isr(s_direct_isr_arg);
+                } else if (s_isr_handlers[gpio]) {
+                        s_isr_handlers[gpio](s_isr_args[gpio]);
+                }
+        }
+        pthread_mutex_unlock(&s_isr_mutex);
+
+        atomic_fetch_add_explicit(&s_storm_edges, 1, memory_order_relaxed);
+}
+
+static void *emulation_storm_task(void *arg) {
+        (void) arg;
+        unsigned int seed = 1;
+
+        while (atomic_load(&s_storm_running)) {
+                const gpio_num_t gpio = s_storm->gpios[(size_t) rand_r(&seed) % s_storm->count];
+                const uint32_t level = atomic_load(&s_gpio_levels[gpio]);
+
+                for (uint32_t edge = 0; edge < s_storm->burst; edge++)
+                        emulation_raise(gpio, (edge % 2) ? level : !level);
+                emulation_raise(gpio, (uint32_t) rand_r(&seed) % 2);
+
+                if (s_storm->interval_us) {
+                        const struct timespec delay = {
+                                .tv_sec = 0,
+                                .tv_nsec = (long) s_storm->interval_us * 1000,
+                        };
+                        nanosleep(&delay, NULL);
+                }
+        }
+
+        return NULL;
+}
+
+void emulation_storm_start(const emulation_storm_t *storm) {
+        emulation_ensure_init();
+
+        s_storm = storm;
+        atomic_store(&s_storm_edges, 0);
+        atomic_store(&s_storm_running, true);
+        pthread_create(&s_storm_thread, NULL, emulation_storm_task, NULL);
+}
+
+uint64_t emulation_storm_stop(void) {
+        atomic_store(&s_storm_running, false);
+        pthread_join(s_storm_thread, NULL);
+
+        return atomic_load(&s_storm_edges);
+}
@@ -0,0 +1,58 @@
+#ifndef EMULATION_H
+#define EMULATION_H
+
+// Thread-backed replacement for stubs.c, built with -DSTUB_PTHREAD. Mutexes
+// and critical sections are real locks, timer callbacks run on a timer
+// service thread, and pin interrupts are raised by an interrupt thread, so the
+// locking of the component is exercised the way it is on a dual-core target.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/gpio.h"
+
+typedef enum {
+        // SemaphoreHandle_t mutexes.
+        emulation_lock_mutex,
+        // portMUX_TYPE critical sections.
+        emulation_lock_critical,
+        emulation_lock_kinds,
+} emulation_lock_kind_t;
+
+typedef struct {
+        uint64_t acquisitions;
+        // Acquisitions that found the lock taken and had to wait.
+        uint64_t contended;
+        uint64_t hold_ns_total;
+        uint64_t hold_ns_max;
+        uint64_t wait_ns_total;
+        uint64_t wait_ns_max;
+} emulation_lock_stats_t;
+
+typedef struct {
+        // Pins the interrupt thread toggles, chosen at random.
+        const gpio_num_t *gpios;
+        size_t count;
+        // Edges per burst; the pin bounces this many times before it settles.
+        uint32_t burst;
+        // Pause between bursts in microseconds.
+        uint32_t interval_us;
+} emulation_storm_t;
+
+// Start raising edges on the interrupt thread. The storm must outlive the
+// thread; one storm runs at a time.
+void emulation_storm_start(const emulation_storm_t *storm);
+
+// Stop the interrupt thread. Returns the number of edges raised.
+uint64_t emulation_storm_stop(void);
+
+// Statistics of all locks of a kind since the start of the program.
+void emulation_lock_stats(emulation_lock_kind_t kind, emulation_lock_stats_t *stats);
+
+// Number of timer callbacks the timer service thread has run.
+uint64_t emulation_timer_callbacks(void);
+
+// Stop the timer service thread.
+void emulation_shutdown(void);
+
+#endif // EMULATION_H
@@ -0,0 +1,100 @@
+// my_http_post for the host builds: a minimal HTTP/1.0 client over POSIX
+// sockets, enough to talk to a test server on the loopback interface. Only
+// http:// URLs with a numeric host are supported.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "port.h"
+
+static int http_send_all(int fd, const char *data, size_t length) {
+        while (length) {
+                const ssize_t sent = send(fd, data, length, 0);
+                if (sent <= 0)
+                        return -1;
+                data += sent;
+                length -= (size_t) sent;
+        }
+        return 0;
+}
+
+int my_http_post(const char *url, const char *body, size_t length, uint32_t timeout_ms) {
+        static const char scheme[] = "http://";
+        if (strncmp(url, scheme, sizeof(scheme) - 1) != 0)
+                return -1;
+
+        const char *authority = url + sizeof(scheme) - 1;
+        const char *path = strchr(authority, '/');
+        if (!path)
+                path = authority + strlen(authority);
+
+        char host[64];
+        const size_t authority_length = (size_t) (path - authority);
+        if (authority_length >= sizeof(host))
+                return -1;
+        memcpy(host, authority, authority_length);
+        host[authority_length] = '\0';
+
+        unsigned long port = 80;
+        char *colon = strchr(host, ':');
+        if (colon) {
+                *colon = '\0';
+                port = strtoul(colon + 1, NULL, 10);
+        }
+
+        struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons((uint16_t) port) };
+        if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+                return -1;
+
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+                return -1;
+
+        const struct timeval timeout = {
+                .tv_sec = timeout_ms / 1000,
+                .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        int status = -1;
+        char buffer[512];
+        const int header_length = snprintf(buffer, sizeof(buffer),
+                                           "POST %s HTTP/1.0\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                                           "Content-Length: %zu\r\n\r\n",
+                                           *path ? path : "/", host, length);
+        if (header_length < 0 || (size_t) header_length >= sizeof(buffer))
+                goto done;
+        if (connect(fd, (const struct sockaddr *) &address, sizeof(address)) != 0
+            || http_send_all(fd, buffer, (size_t) header_length) != 0
+            || http_send_all(fd, body, length) != 0)
+                goto done;
+
+        // The status line is all that is needed.
+        size_t received = 0;
+        while (received < sizeof(buffer) - 1) {
+                const ssize_t n = recv(fd, buffer + received, sizeof(buffer) - 1 - received, 0);
+                if (n <= 0)
+                        break;
+                received += (size_t) n;
+                if (memchr(buffer, '\n', received))
+                        break;
+        }
+        buffer[received] = '\0';
+
+        int parsed = 0;
+        if (sscanf(buffer, "HTTP/%*d.%*d %d", &parsed) == 1)
+                status = parsed;
+
+done:
+        close(fd);
+        return status;
+}
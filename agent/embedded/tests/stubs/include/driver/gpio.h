@@ -14,8 +14,10 @@ typedef enum {
         GPIO_INTR_ANYEDGE = 3,
 } gpio_int_type_t;
 
+#define GPIO_NUM_NC (-1)
 #define GPIO_NUM_MAX 48
 #define GPIO_IS_VALID_GPIO(gpio) ((gpio) >= 0 && (gpio) < GPIO_NUM_MAX)
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio) GPIO_IS_VALID_GPIO(gpio)
 
 esp_err_t gpio_install_isr_service(int flags);
 esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type);
@@ -2,5 +2,6 @@
 #define ESP_ATTR_H
 
 #define IRAM_ATTR
+#define DRAM_ATTR
 
 #endif // ESP_ATTR_H
@@ -2,5 +2,6 @@
 #define ESP_INTR_ALLOC_H
 
 #define ESP_INTR_FLAG_LOWMED 0
+#define ESP_INTR_FLAG_IRAM (1 << 10)
 
 #endif // ESP_INTR_ALLOC_H
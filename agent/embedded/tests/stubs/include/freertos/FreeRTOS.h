@@ -20,7 +20,43 @@ typedef uint32_t StaticSemaphore_t;
 #define pdPASS (pdTRUE)
 #define pdFAIL (pdFALSE)
 #define portMAX_DELAY ((TickType_t)0xffffffffu)
-#define pdMS_TO_TICKS(ms) (ms)
+#define configTICK_RATE_HZ 1000
+// As in FreeRTOS: the product is computed in TickType_t.
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / 1000u))
+#define pdTICKS_TO_MS(ticks) (ticks)
 #define portYIELD_FROM_ISR() do { } while (0)
 
+#ifdef STUB_PTHREAD
+// The emulation in stubs/emulation.c: critical sections are real locks, held
+// by task, timer and interrupt threads alike.
+#include <pthread.h>
+
+typedef struct {
+        pthread_mutex_t mutex;
+        uint64_t acquired_ns;
+} portMUX_TYPE;
+
+void emulation_critical_init(portMUX_TYPE *mux);
+void emulation_critical_enter(portMUX_TYPE *mux);
+void emulation_critical_exit(portMUX_TYPE *mux);
+
+#define portMUX_INITIALIZER_UNLOCKED { .mutex = PTHREAD_MUTEX_INITIALIZER, .acquired_ns = 0 }
+#define portMUX_INITIALIZE(mux) emulation_critical_init(mux)
+#define portENTER_CRITICAL(mux) emulation_critical_enter(mux)
+#define portEXIT_CRITICAL(mux) emulation_critical_exit(mux)
+#else
+typedef struct {
+        int owner;
+        int count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { .owner = 0, .count = 0 }
+#define portMUX_INITIALIZE(mux) do { (mux)->owner = 0; (mux)->count = 0; } while (0)
+#define portENTER_CRITICAL(mux) do { (mux)->count++; } while (0)
+#define portEXIT_CRITICAL(mux) do { (mux)->count--; } while (0)
+#endif
+
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
 #endif // FREERTOS_FREERTOS_H
@@ -2,12 +2,15 @@
 #define FREERTOS_SEMPHR_H
 
 #include "FreeRTOS.h"
+#include "queue.h"
 
 typedef struct FakeSemaphore* SemaphoreHandle_t;
 
 SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
 void vSemaphoreDelete(SemaphoreHandle_t semaphore);
 BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
 BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken);
 
 #endif // FREERTOS_SEMPHR_H
@@ -0,0 +1,39 @@
+#ifndef FREERTOS_TASK_H
+#define FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct FakeTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void *parameters);
+
+typedef enum {
+        eNoAction = 0,
+        eSetBits,
+        eIncrement,
+        eSetValueWithOverwrite,
+        eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t task_code,
+                       const char * const name,
+                       uint32_t stack_depth,
+                       void * const parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t * const created_task);
+
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task,
+                              uint32_t value,
+                              eNotifyAction action,
+                              BaseType_t *higher_priority_task_woken);
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry,
+                           uint32_t bits_to_clear_on_exit,
+                           uint32_t *notification_value,
+                           TickType_t ticks_to_wait);
+
+#endif // FREERTOS_TASK_H
@@ -2,6 +2,7 @@
 #define FREERTOS_TIMERS_H
 
 #include "FreeRTOS.h"
+#include "task.h"
 
 typedef struct StaticTimer StaticTimer_t;
 typedef StaticTimer_t* TimerHandle_t;
@@ -11,6 +12,9 @@ struct StaticTimer {
         void *id;
         TimerCallbackFunction_t callback;
         BaseType_t active;
+        BaseType_t auto_reload;
+        TickType_t period;
+        TickType_t expiry;
 };
 
 TimerHandle_t xTimerCreateStatic(const char * const name,
@@ -19,11 +23,17 @@ TimerHandle_t xTimerCreateStatic(const char * const name,
                                  void * const timer_id,
                                  TimerCallbackFunction_t callback,
                                  StaticTimer_t *timer_buffer);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t new_period, TickType_t ticks_to_wait);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
 BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken);
+BaseType_t xTimerChangePeriodFromISR(TimerHandle_t timer,
+                                     TickType_t new_period,
+                                     BaseType_t *higher_priority_task_woken);
 BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken);
 BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
 BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait);
 BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
 void *pvTimerGetTimerID(TimerHandle_t timer);
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(void);
 
 #endif // FREERTOS_TIMERS_H
@@ -0,0 +1,7 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Options of the component are passed on the compiler command line by
+// tests/Makefile.
+
+#endif // SDKCONFIG_H
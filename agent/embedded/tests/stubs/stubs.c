@@ -1,21 +1,80 @@
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "esp_err.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "freertos/timers.h"
 #include "port.h"
+#include "stubs.h"
 
+// Mutexes are always free; counting semaphores never block, a take fails
+// when the count is zero.
 struct FakeSemaphore {
-        int dummy;
+        bool counting;
+        UBaseType_t count;
+        UBaseType_t max_count;
 };
 
+struct FakeQueue {
+        UBaseType_t length;
+        UBaseType_t item_size;
+        UBaseType_t head;
+        UBaseType_t count;
+        unsigned char items[];
+};
+
+#define STUB_MAX_TIMERS (2 * GPIO_NUM_MAX)
+
+static TimerHandle_t s_timers[STUB_MAX_TIMERS];
+static size_t s_timer_count;
+
+// Task handles only need to tell the timer task apart from everything else,
+// and carry a notification value.
+struct FakeTask {
+        bool notified;
+        uint32_t notification_value;
+};
+
+static struct FakeTask s_app_task;
+static struct FakeTask s_timer_task;
+static TaskHandle_t s_current_task = &s_app_task;
+
+static uint32_t s_timer_resets;
+static uint32_t s_timer_isr_starts;
+static TickType_t s_tick_count;
+static bool s_flash_cache_disabled;
+
+// Touch channel n is wired to GPIO n, channel 0 is internal as on the ESP32-S3.
+typedef struct {
+        bool enabled;
+        const uint32_t *recording;
+        size_t length;
+        size_t position;
+        uint32_t raw;
+} stub_touch_channel_t;
+
+static stub_touch_channel_t s_touch[MY_TOUCH_CHANNELS];
+static uint32_t s_touch_reads;
+
 SemaphoreHandle_t xSemaphoreCreateMutex(void) {
-        struct FakeSemaphore *sem = malloc(sizeof(*sem));
+        return calloc(1, sizeof(struct FakeSemaphore));
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+        struct FakeSemaphore *sem = calloc(1, sizeof(*sem));
+        if (sem) {
+                sem->counting = true;
+                sem->count = initial_count;
+                sem->max_count = max_count;
+        }
         return sem;
 }
 
@@ -25,11 +84,68 @@ void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
 
 BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
         (void) ticks_to_wait;
-        return semaphore ? pdTRUE : pdFALSE;
+        if (!semaphore)
+                return pdFALSE;
+        if (!semaphore->counting)
+                return pdTRUE;
+        if (!semaphore->count)
+                return pdFALSE;
+
+        semaphore->count--;
+        return pdTRUE;
 }
 
 BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
-        return semaphore ? pdTRUE : pdFALSE;
+        if (!semaphore)
+                return pdFALSE;
+        if (!semaphore->counting)
+                return pdTRUE;
+        if (semaphore->count == semaphore->max_count)
+                return pdFALSE;
+
+        semaphore->count++;
+        return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken) {
+        // Like FreeRTOS, only ever sets the flag; no task is woken here.
+        (void) higher_priority_task_woken;
+        return xSemaphoreGive(semaphore);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+        struct FakeQueue *queue = calloc(1, sizeof(*queue) + (size_t) length * item_size);
+        if (queue) {
+                queue->length = length;
+                queue->item_size = item_size;
+        }
+        return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+        free(queue);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!queue || queue->count == queue->length)
+                return pdFALSE;
+
+        const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[(size_t) tail * queue->item_size], item, queue->item_size);
+        queue->count++;
+        return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!queue || !queue->count)
+                return pdFALSE;
+
+        memcpy(item, &queue->items[(size_t) queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        return pdTRUE;
 }
 
 TimerHandle_t xTimerCreateStatic(const char * const name,
@@ -39,8 +155,6 @@ TimerHandle_t xTimerCreateStatic(const char * const name,
                                  TimerCallbackFunction_t callback,
                                  StaticTimer_t *timer_buffer) {
         (void) name;
-        (void) period_in_ticks;
-        (void) auto_reload;
 
         if (!timer_buffer)
                 return NULL;
@@ -48,15 +162,47 @@ TimerHandle_t xTimerCreateStatic(const char * const name,
         timer_buffer->id = timer_id;
         timer_buffer->callback = callback;
         timer_buffer->active = pdFALSE;
+        timer_buffer->auto_reload = auto_reload ? pdTRUE : pdFALSE;
+        timer_buffer->period = period_in_ticks;
+
+        for (size_t i = 0; i < s_timer_count; i++) {
+                if (s_timers[i] == timer_buffer)
+                        return timer_buffer;
+        }
+        if (s_timer_count < STUB_MAX_TIMERS)
+                s_timers[s_timer_count++] = timer_buffer;
 
         return timer_buffer;
 }
 
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t new_period, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!timer)
+                return pdFAIL;
+
+        timer->period = new_period;
+        timer->active = pdTRUE;
+        timer->expiry = s_tick_count + timer->period;
+        return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        if (!timer)
+                return pdFAIL;
+
+        timer->active = pdTRUE;
+        timer->expiry = s_tick_count + timer->period;
+        return pdPASS;
+}
+
 BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken) {
         if (!timer)
                 return pdFAIL;
 
         timer->active = pdTRUE;
+        timer->expiry = s_tick_count + timer->period;
+        s_timer_isr_starts++;
 
         if (higher_priority_task_woken)
                 *higher_priority_task_woken = pdFALSE;
@@ -64,11 +210,22 @@ BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_t
         return pdPASS;
 }
 
+BaseType_t xTimerChangePeriodFromISR(TimerHandle_t timer,
+                                     TickType_t new_period,
+                                     BaseType_t *higher_priority_task_woken) {
+        if (higher_priority_task_woken)
+                *higher_priority_task_woken = pdFALSE;
+
+        return xTimerChangePeriod(timer, new_period, 0);
+}
+
 BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken) {
         if (!timer)
                 return pdFAIL;
 
         timer->active = pdTRUE;
+        timer->expiry = s_tick_count + timer->period;
+        s_timer_resets++;
 
         if (higher_priority_task_woken)
                 *higher_priority_task_woken = pdFALSE;
@@ -77,7 +234,8 @@ BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_t
 }
 
 BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
-        (void) ticks_to_wait;
+        // The timer task would wait for itself to drain its command queue.
+        assert(!ticks_to_wait || s_current_task != &s_timer_task);
         if (!timer)
                 return pdFAIL;
 
@@ -86,8 +244,18 @@ BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait) {
 }
 
 BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait) {
-        (void) timer;
-        (void) ticks_to_wait;
+        // The timer task would wait for itself to drain its command queue.
+        assert(!ticks_to_wait || s_current_task != &s_timer_task);
+        if (!timer)
+                return pdFAIL;
+
+        timer->active = pdFALSE;
+        for (size_t i = 0; i < s_timer_count; i++) {
+                if (s_timers[i] == timer) {
+                        s_timers[i] = s_timers[--s_timer_count];
+                        break;
+                }
+        }
         return pdPASS;
 }
 
@@ -105,10 +273,106 @@ void *pvTimerGetTimerID(TimerHandle_t timer) {
         return timer->id;
 }
 
+TickType_t xTaskGetTickCount(void) {
+        return s_tick_count;
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+        return s_tick_count;
+}
+
+static struct FakeTask s_created_task;
+
+// Tasks are never run; tests call what the task would loop over themselves.
+BaseType_t xTaskCreate(TaskFunction_t task_code,
+                       const char * const name,
+                       uint32_t stack_depth,
+                       void * const parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t * const created_task) {
+        (void) task_code;
+        (void) name;
+        (void) stack_depth;
+        (void) parameters;
+        (void) priority;
+
+        if (created_task)
+                *created_task = &s_created_task;
+        return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+        return s_current_task;
+}
+
+TaskHandle_t xTimerGetTimerDaemonTaskHandle(void) {
+        return &s_timer_task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+        s_tick_count += ticks;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+        if (!task)
+                return pdFAIL;
+
+        switch (action) {
+        case eSetBits: task->notification_value |= value; break;
+        case eIncrement: task->notification_value++; break;
+        case eSetValueWithoutOverwrite:
+                if (task->notified)
+                        return pdFAIL;
+                task->notification_value = value;
+                break;
+        case eSetValueWithOverwrite: task->notification_value = value; break;
+        default: break;
+        }
+        task->notified = true;
+        return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task,
+                              uint32_t value,
+                              eNotifyAction action,
+                              BaseType_t *higher_priority_task_woken) {
+        (void) higher_priority_task_woken;
+        return xTaskNotify(task, value, action);
+}
+
+// Never blocks: fails right away when the calling task was not notified.
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry,
+                           uint32_t bits_to_clear_on_exit,
+                           uint32_t *notification_value,
+                           TickType_t ticks_to_wait) {
+        (void) ticks_to_wait;
+        TaskHandle_t task = s_current_task;
+        if (!task->notified)
+                task->notification_value &= ~bits_to_clear_on_entry;
+        if (notification_value)
+                *notification_value = task->notification_value;
+        if (!task->notified)
+                return pdFALSE;
+
+        task->notified = false;
+        task->notification_value &= ~bits_to_clear_on_exit;
+        return pdTRUE;
+}
+
 static gpio_isr_t s_isr_handlers[GPIO_NUM_MAX];
+static void *s_isr_args[GPIO_NUM_MAX];
 static bool s_intr_enabled[GPIO_NUM_MAX];
 static gpio_int_type_t s_intr_types[GPIO_NUM_MAX];
 static uint32_t s_gpio_levels[GPIO_NUM_MAX];
+static bool s_gpio_outputs[GPIO_NUM_MAX];
+static uint32_t s_isr_calls[GPIO_NUM_MAX];
+static uint32_t s_glitch_filter_max_ns;
+static uint32_t s_glitch_filter_ns[GPIO_NUM_MAX];
+// The GPIO interrupt allocated by my_gpio_isr_register, and its status register.
+static void (*s_direct_isr)(void *);
+static void *s_direct_isr_arg;
+static uint32_t s_intr_status[MY_GPIO_STATUS_WORDS];
+static uint32_t s_isr_entries;
 
 esp_err_t gpio_install_isr_service(int flags) {
         (void) flags;
@@ -124,11 +388,11 @@ esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
 }
 
 esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
-        (void) args;
         if (!GPIO_IS_VALID_GPIO(gpio_num))
                 return ESP_FAIL;
 
         s_isr_handlers[gpio_num] = isr_handler;
+        s_isr_args[gpio_num] = args;
         return ESP_OK;
 }
 
@@ -137,6 +401,7 @@ esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
                 return ESP_FAIL;
 
         s_isr_handlers[gpio_num] = NULL;
+        s_isr_args[gpio_num] = NULL;
         return ESP_OK;
 }
 
@@ -167,19 +432,338 @@ void my_gpio_enable(gpio_num_t gpio) {
         (void) gpio;
 }
 
+void my_gpio_pullup(gpio_num_t gpio) {
+        (void) gpio;
+}
+
+void my_gpio_pulldown(gpio_num_t gpio) {
+        (void) gpio;
+}
+
 uint8_t my_gpio_read(gpio_num_t gpio) {
         return (uint8_t) gpio_get_level(gpio);
 }
 
+uint64_t my_gpio_boot_latch(uint64_t pullup_mask, uint64_t pulldown_mask) {
+        (void) pullup_mask;
+        (void) pulldown_mask;
+
+        uint64_t levels = 0;
+        for (int gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+                if (gpio_get_level((gpio_num_t) gpio))
+                        levels |= 1ull << gpio;
+        }
+        return levels;
+}
+
+esp_err_t my_gpio_isr_register(void (*handler)(void *), void *arg, int flags) {
+        (void) flags;
+        if (s_direct_isr)
+                return ESP_ERR_NOT_FOUND;
+
+        s_direct_isr = handler;
+        s_direct_isr_arg = arg;
+        return ESP_OK;
+}
+
+void my_gpio_intr_status_take_from_isr(uint32_t status[MY_GPIO_STATUS_WORDS]) {
+        for (size_t i = 0; i < MY_GPIO_STATUS_WORDS; i++) {
+                status[i] = s_intr_status[i];
+                s_intr_status[i] = 0;
+        }
+}
+
+uint8_t my_gpio_read_from_isr(gpio_num_t gpio) {
+        return (uint8_t) gpio_get_level(gpio);
+}
+
+void my_gpio_output(gpio_num_t gpio) {
+        assert(GPIO_IS_VALID_OUTPUT_GPIO(gpio));
+        s_gpio_outputs[gpio] = true;
+}
+
+// Outputs read back their own level, as with GPIO_MODE_INPUT_OUTPUT.
+void my_gpio_write_from_isr(gpio_num_t gpio, bool high) {
+        assert(s_gpio_outputs[gpio]);
+        s_gpio_levels[gpio] = high ? 1 : 0;
+}
+
+void my_gpio_toggle_from_isr(gpio_num_t gpio) {
+        assert(s_gpio_outputs[gpio]);
+        s_gpio_levels[gpio] ^= 1;
+}
+
+bool stub_gpio_is_output(gpio_num_t gpio) {
+        return GPIO_IS_VALID_GPIO(gpio) && s_gpio_outputs[gpio];
+}
+
+uint32_t my_time_us_from_isr(void) {
+        return (uint32_t) (s_tick_count * (1000000u / configTICK_RATE_HZ));
+}
+
+bool my_flash_cache_enabled_from_isr(void) {
+        return !s_flash_cache_disabled;
+}
+
+uint32_t my_uptime_seconds(void) {
+        return (uint32_t) (xTaskGetTickCount() / configTICK_RATE_HZ);
+}
+
+int my_touch_channel(gpio_num_t gpio) {
+        return gpio > 0 && gpio < MY_TOUCH_CHANNELS ? (int) gpio : -1;
+}
+
+esp_err_t my_touch_enable(int channel) {
+        s_touch[channel].enabled = true;
+        return ESP_OK;
+}
+
+void my_touch_disable(int channel) {
+        s_touch[channel].enabled = false;
+}
+
+void my_touch_read(const uint8_t *channels, size_t count, uint32_t *raw) {
+        s_touch_reads++;
+        for (size_t i = 0; i < count; i++) {
+                stub_touch_channel_t *touch = &s_touch[channels[i]];
+                assert(touch->enabled);
+                if (touch->position < touch->length)
+                        touch->raw = touch->recording[touch->position++];
+                raw[i] = touch->raw;
+        }
+}
+
+bool my_touch_lowers_count(void) {
+        return false;
+}
+
+void stub_touch_set_raw(gpio_num_t gpio, uint32_t raw) {
+        stub_touch_channel_t *touch = &s_touch[gpio];
+        touch->recording = NULL;
+        touch->length = 0;
+        touch->position = 0;
+        touch->raw = raw;
+}
+
+void stub_touch_replay(gpio_num_t gpio, const uint32_t *raw, size_t count) {
+        stub_touch_channel_t *touch = &s_touch[gpio];
+        touch->recording = raw;
+        touch->length = count;
+        touch->position = 0;
+}
+
+uint32_t stub_touch_reads(void) {
+        return s_touch_reads;
+}
+
+void my_gpio_intr_disable_from_isr(gpio_num_t gpio) {
+        gpio_intr_disable(gpio);
+}
+
+uint32_t my_gpio_glitch_filter_enable(gpio_num_t gpio, uint32_t window_ns) {
+        if (!GPIO_IS_VALID_GPIO(gpio) || !s_glitch_filter_max_ns)
+                return 0;
+
+        s_glitch_filter_ns[gpio] = window_ns < s_glitch_filter_max_ns ? window_ns : s_glitch_filter_max_ns;
+        return s_glitch_filter_ns[gpio];
+}
+
+void my_gpio_glitch_filter_disable(gpio_num_t gpio) {
+        if (!GPIO_IS_VALID_GPIO(gpio))
+                return;
+
+        s_glitch_filter_ns[gpio] = 0;
+}
+
 const char *esp_err_to_name(esp_err_t err) {
         switch (err) {
         case ESP_OK:
                 return "ESP_OK";
         case ESP_ERR_INVALID_STATE:
                 return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:
+                return "ESP_ERR_NOT_FOUND";
         case ESP_FAIL:
                 return "ESP_FAIL";
         default:
                 return "ESP_ERR_UNKNOWN";
         }
 }
+
+void stub_gpio_set_level(gpio_num_t gpio, uint32_t level) {
+        if (!GPIO_IS_VALID_GPIO(gpio))
+                return;
+
+        s_gpio_levels[gpio] = level;
+}
+
+void stub_gpio_edge(gpio_num_t gpio, uint32_t level) {
+        stub_gpio_edges(&gpio, &level, 1);
+}
+
+// Latches the edge in the status register, or calls the handler of the GPIO
+// ISR service. Returns whether the interrupt of the pin is enabled.
+static bool stub_gpio_raise(gpio_num_t gpio, uint32_t level) {
+        s_gpio_levels[gpio] = level;
+        if (!s_intr_enabled[gpio])
+                return false;
+
+        if (s_direct_isr) {
+                s_intr_status[gpio / 32] |= 1u << (gpio % 32);
+                return true;
+        }
+        if (!s_isr_handlers[gpio])
+                return false;
+
+        s_isr_calls[gpio]++;
+        s_isr_handlers[gpio](s_isr_args[gpio]);
+        return true;
+}
+
+void stub_gpio_edges(const gpio_num_t *gpios, const uint32_t *levels, size_t count) {
+        bool raised = false;
+        for (size_t i = 0; i < count; i++) {
+                if (GPIO_IS_VALID_GPIO(gpios[i]))
+                        raised |= stub_gpio_raise(gpios[i], levels[i]);
+        }
+
+        if (!raised)
+                return;
+
+        s_isr_entries++;
+        if (s_direct_isr) {
+                for (size_t i = 0; i < count; i++) {
+                        if (GPIO_IS_VALID_GPIO(gpios[i]) && s_intr_status[gpios[i] / 32] & (1u << (gpios[i] % 32)))
+                                s_isr_calls[gpios[i]]++;
+                }
+                s_direct_isr(s_direct_isr_arg);
+        }
+}
+
+uint32_t stub_gpio_isr_entries(void) {
+        return s_isr_entries;
+}
+
+void stub_gpio_glitch(gpio_num_t gpio, uint32_t width_ns) {
+        if (!GPIO_IS_VALID_GPIO(gpio) || width_ns <= s_glitch_filter_ns[gpio])
+                return;
+
+        const uint32_t level = s_gpio_levels[gpio];
+        stub_gpio_edge(gpio, !level);
+        stub_gpio_edge(gpio, level);
+}
+
+void stub_quadrature_turn(gpio_num_t gpio_a, gpio_num_t gpio_b, int32_t transitions, uint32_t bounces) {
+        if (!GPIO_IS_VALID_GPIO(gpio_a) || !GPIO_IS_VALID_GPIO(gpio_b))
+                return;
+
+        // Gray sequence of (A, B) when A leads B.
+        static const uint8_t sequence[4] = { 0x0, 0x2, 0x3, 0x1 };
+
+        const int32_t direction = transitions < 0 ? -1 : 1;
+        const uint8_t current = (uint8_t) ((s_gpio_levels[gpio_a] ? 0x2 : 0) | (s_gpio_levels[gpio_b] ? 0x1 : 0));
+
+        size_t position = 0;
+        while (sequence[position] != current)
+                position++;
+
+        for (int32_t i = 0; i != transitions; i += direction) {
+                const uint8_t from = sequence[position];
+                position = (position + 4 + direction) % 4;
+                const uint8_t to = sequence[position];
+
+                const uint8_t changed = from ^ to;
+                const gpio_num_t gpio = (changed & 0x2) ? gpio_a : gpio_b;
+                const uint32_t level = (to & changed) ? 1 : 0;
+
+                for (uint32_t bounce = 0; bounce < bounces; bounce++) {
+                        stub_gpio_edge(gpio, level);
+                        stub_gpio_edge(gpio, !level);
+                }
+                stub_gpio_edge(gpio, level);
+        }
+}
+
+uint32_t stub_gpio_isr_calls(gpio_num_t gpio) {
+        return GPIO_IS_VALID_GPIO(gpio) ? s_isr_calls[gpio] : 0;
+}
+
+void stub_gpio_set_glitch_filter_support(uint32_t max_ns) {
+        s_glitch_filter_max_ns = max_ns;
+}
+
+uint32_t stub_gpio_glitch_filter_ns(gpio_num_t gpio) {
+        return GPIO_IS_VALID_GPIO(gpio) ? s_glitch_filter_ns[gpio] : 0;
+}
+
+bool stub_gpio_intr_enabled(gpio_num_t gpio) {
+        return GPIO_IS_VALID_GPIO(gpio) && s_intr_enabled[gpio];
+}
+
+void stub_tick_advance(TickType_t ticks) {
+        s_tick_count += ticks;
+}
+
+uint32_t stub_timer_resets(void) {
+        return s_timer_resets;
+}
+
+uint32_t stub_timer_isr_starts(void) {
+        return s_timer_isr_starts;
+}
+
+void stub_flash_cache_set_enabled(bool enabled) {
+        s_flash_cache_disabled = !enabled;
+}
+
+void stub_timers_advance(TickType_t ticks) {
+        const TickType_t target = s_tick_count + ticks;
+
+        while (!s_flash_cache_disabled) {
+                TimerHandle_t next = NULL;
+                for (size_t i = 0; i < s_timer_count; i++) {
+                        TimerHandle_t timer = s_timers[i];
+                        if (!timer->active || (int32_t) (timer->expiry - target) > 0)
+                                continue;
+                        if (!next || (int32_t) (timer->expiry - next->expiry) < 0)
+                                next = timer;
+                }
+
+                if (!next)
+                        break;
+
+                if ((int32_t) (next->expiry - s_tick_count) > 0)
+                        s_tick_count = next->expiry;
+
+                next->active = next->auto_reload;
+                next->expiry += next->period;
+                s_current_task = &s_timer_task;
+                next->callback(next);
+                s_current_task = &s_app_task;
+        }
+
+        s_tick_count = target;
+}
+
+size_t stub_timers_run(void) {
+        TimerHandle_t due[STUB_MAX_TIMERS];
+        size_t count = 0;
+
+        for (size_t i = 0; i < s_timer_count; i++) {
+                if (s_timers[i]->active)
+                        due[count++] = s_timers[i];
+        }
+
+        for (size_t i = 0; i < count; i++) {
+                if (!due[i]->active)
+                        continue;
+
+                due[i]->active = due[i]->auto_reload;
+                due[i]->expiry = s_tick_count + due[i]->period;
+                s_current_task = &s_timer_task;
+                due[i]->callback(due[i]);
+                s_current_task = &s_app_task;
+        }
+
+        return count;
+}
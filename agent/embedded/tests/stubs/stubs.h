@@ -0,0 +1,86 @@
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+
+// Set the level returned by gpio_get_level without raising an interrupt.
+void stub_gpio_set_level(gpio_num_t gpio, uint32_t level);
+
+// Set the level and invoke the ISR registered for the GPIO, if its interrupt
+// is enabled.
+void stub_gpio_edge(gpio_num_t gpio, uint32_t level);
+
+// Change several levels at the same instant. With an interrupt allocated by
+// my_gpio_isr_register all pending pins are latched in the status register
+// and the interrupt is entered once.
+void stub_gpio_edges(const gpio_num_t *gpios, const uint32_t *levels, size_t count);
+
+// Whether the pin was turned into an output by my_gpio_output. Its level is
+// then written by my_gpio_write_from_isr and read with gpio_get_level.
+bool stub_gpio_is_output(gpio_num_t gpio);
+
+// Number of times a GPIO interrupt was entered.
+uint32_t stub_gpio_isr_entries(void);
+
+// Emit a pulse of the given width. The pulse never reaches the ISR when it is
+// not wider than the hardware glitch filter configured for the pin.
+void stub_gpio_glitch(gpio_num_t gpio, uint32_t width_ns);
+
+// Number of times the ISR of the GPIO was entered.
+uint32_t stub_gpio_isr_calls(gpio_num_t gpio);
+
+// Model a target with a hardware glitch filter of up to max_ns, or without one
+// when max_ns is 0 (the default).
+void stub_gpio_set_glitch_filter_support(uint32_t max_ns);
+
+// Glitch width currently filtered in hardware for the GPIO, 0 if none.
+uint32_t stub_gpio_glitch_filter_ns(gpio_num_t gpio);
+
+// Whether the interrupt of the GPIO is currently enabled.
+bool stub_gpio_intr_enabled(gpio_num_t gpio);
+
+// Drive a quadrature encoder on gpio_a/gpio_b through the given number of
+// transitions, forwards (A leads B) when positive. Every transition bounces
+// the changing channel back and forth bounces times before it settles.
+void stub_quadrature_turn(gpio_num_t gpio_a, gpio_num_t gpio_b, int32_t transitions, uint32_t bounces);
+
+// Advance the tick count returned by xTaskGetTickCount. Timers are not
+// expired by this; use stub_timers_run.
+void stub_tick_advance(TickType_t ticks);
+
+// Number of xTimerResetFromISR calls so far.
+uint32_t stub_timer_resets(void);
+
+// Number of xTimerStartFromISR calls so far.
+uint32_t stub_timer_isr_starts(void);
+
+// Advance the tick count by ticks and expire the timers that fall due on the
+// way, in order of their expiry.
+void stub_timers_advance(TickType_t ticks);
+
+// Model a flash write: while the cache is disabled only IRAM interrupts run,
+// so stub_timers_advance moves time without expiring timers.
+void stub_flash_cache_set_enabled(bool enabled);
+
+// Touch channel n is wired to GPIO n for 1 <= n < MY_TOUCH_CHANNELS. Set the
+// raw count the touch sensor measures on the channel of the GPIO.
+void stub_touch_set_raw(gpio_num_t gpio, uint32_t raw);
+
+// Replay recorded raw counts on the channel of the GPIO: each read of the
+// touch sensor takes the next one, the last one holds once the recording is
+// used up. The recording must outlive the replay.
+void stub_touch_replay(gpio_num_t gpio, const uint32_t *raw, size_t count);
+
+// Number of batch reads of the touch sensor so far.
+uint32_t stub_touch_reads(void);
+
+// Expire every timer that is active at the time of the call, once.
+// Returns the number of timers that were due.
+size_t stub_timers_run(void);
+
+#endif // STUBS_H
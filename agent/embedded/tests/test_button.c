@@ -0,0 +1,666 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "button.h"
+#include "stubs.h"
+
+#define TEST_GPIO 5
+
+static button_event_t last_event;
+static int primary_calls;
+
+static char order[16];
+static size_t order_len;
+
+static void primary_callback(button_event_t event, void *context) {
+        (void) context;
+        last_event = event;
+        primary_calls++;
+}
+
+static void tagged_subscriber(const button_event_info_t *info, void *context) {
+        assert(info->gpio_num == TEST_GPIO);
+        order[order_len++] = *(const char*) context;
+}
+
+static void press_and_release(void) {
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_run();
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_run();
+}
+
+static void reset_trace(void) {
+        memset(order, 0, sizeof(order));
+        order_len = 0;
+        primary_calls = 0;
+}
+
+static void test_subscribers(void) {
+        static const char tag_a = 'a', tag_b = 'b', tag_c = 'c';
+
+        button_config_t config = button_config_default(button_active_low);
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+
+        assert(button_subscribe(TEST_GPIO, 0, 0, tagged_subscriber, (void*) &tag_a) == -3);
+        assert(button_subscribe(TEST_GPIO + 1, BUTTON_EVENT_MASK_ALL, 0, tagged_subscriber, (void*) &tag_a) == -1);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, NULL, NULL) == -6);
+
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK(button_event_single_press), 1,
+                                tagged_subscriber, (void*) &tag_a) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK(button_event_single_press), 9,
+                                tagged_subscriber, (void*) &tag_b) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK(button_event_long_press), 5,
+                                tagged_subscriber, (void*) &tag_c) == 0);
+
+        reset_trace();
+        press_and_release();
+        assert(primary_calls == 1);
+        assert(last_event == button_event_single_press);
+        assert(strcmp(order, "ba") == 0);
+
+        // Re-subscribing updates the priority in place.
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK(button_event_single_press), 0,
+                                tagged_subscriber, (void*) &tag_b) == 0);
+        reset_trace();
+        press_and_release();
+        assert(strcmp(order, "ab") == 0);
+
+        assert(button_unsubscribe(TEST_GPIO, tagged_subscriber, (void*) &tag_a) == 0);
+        assert(button_unsubscribe(TEST_GPIO, tagged_subscriber, (void*) &tag_a) == -1);
+        reset_trace();
+        press_and_release();
+        assert(strcmp(order, "b") == 0);
+
+        static const char fillers[BUTTON_MAX_SUBSCRIBERS];
+        size_t attached = 2;
+        for (size_t i = 0; attached < BUTTON_MAX_SUBSCRIBERS; i++, attached++) {
+                assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0,
+                                        tagged_subscriber, (void*) &fillers[i]) == 0);
+        }
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, tagged_subscriber, (void*) &tag_a) == -2);
+
+        button_destroy(TEST_GPIO);
+        assert(button_unsubscribe(TEST_GPIO, tagged_subscriber, (void*) &tag_b) == -1);
+}
+
+static void test_storm_fault_events(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.storm_edge_limit = 2;
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+
+        reset_trace();
+        for (int i = 0; i < 2; i++) {
+                stub_gpio_edge(TEST_GPIO, 0);
+                stub_gpio_edge(TEST_GPIO, 1);
+        }
+        stub_timers_run();
+        assert(last_event == button_event_fault);
+        assert(button_get_fault(TEST_GPIO) == button_fault_interrupt_storm);
+
+        // Recheck, then a quiet storm window.
+        stub_timers_run();
+        stub_tick_advance(config.storm_window);
+        stub_timers_run();
+        assert(last_event == button_event_fault_cleared);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+
+        press_and_release();
+        assert(last_event == button_event_single_press);
+
+        button_destroy(TEST_GPIO);
+}
+
+static int32_t last_value;
+
+static void value_subscriber(const button_event_info_t *info, void *context) {
+        (void) context;
+        last_value = info->value;
+}
+
+static void test_stuck_fault(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 1000;
+        config.stuck_press_seconds = 10;
+        config.storm_recheck_time = 2000;
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+
+        // Jammed: the long press fires once, then the pin goes quiet.
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(9000);
+        assert(last_event == button_event_long_press);
+        assert(button_is_pressed(TEST_GPIO));
+        stub_timers_advance(1020);
+        assert(last_event == button_event_fault);
+        assert(button_get_fault(TEST_GPIO) == button_fault_stuck);
+        assert(!button_is_pressed(TEST_GPIO));
+        assert(!stub_gpio_intr_enabled(TEST_GPIO));
+        assert(primary_calls == 2);
+
+        // Only rechecked every storm_recheck_time while it stays stuck.
+        const uint32_t resets = stub_timer_resets();
+        stub_timers_advance(20000);
+        assert(primary_calls == 2);
+        assert(stub_timer_resets() == resets);
+
+        // Freed: restored at the next recheck, without a press.
+        stub_gpio_set_level(TEST_GPIO, 1);
+        stub_timers_advance(2000);
+        assert(last_event == button_event_fault_cleared);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+        assert(stub_gpio_intr_enabled(TEST_GPIO));
+        stub_timers_advance(1000);
+        assert(primary_calls == 3);
+
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(50);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(400);
+        assert(last_event == button_event_single_press);
+
+        // Without long press the watch starts with the press.
+        button_destroy(TEST_GPIO);
+        config.long_press_time = 0;
+        config.stuck_press_seconds = 2;
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(1999);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+        stub_timers_advance(20);
+        assert(button_get_fault(TEST_GPIO) == button_fault_stuck);
+        stub_gpio_set_level(TEST_GPIO, 1);
+        stub_timers_advance(2000);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+
+        // Beyond the 4294 s at which milliseconds times the tick rate
+        // overflow 32 bits.
+        button_destroy(TEST_GPIO);
+        config.stuck_press_seconds = 5000;
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(4999000);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+        stub_timers_advance(1020);
+        assert(button_get_fault(TEST_GPIO) == button_fault_stuck);
+        stub_gpio_set_level(TEST_GPIO, 1);
+        stub_timers_advance(2000);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void test_unstable_fault(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.unstable_window = 100;
+        config.storm_recheck_time = 1000;
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+
+        // Hovering around the threshold: slow enough to pass any storm
+        // limit, but the debounce window never completes.
+        reset_trace();
+        for (int i = 0; i < 20; i++) {
+                stub_gpio_edge(TEST_GPIO, (uint32_t) (i % 2 == 0 ? 0 : 1));
+                stub_timers_advance(8);
+        }
+        assert(last_event == button_event_fault);
+        assert(button_get_fault(TEST_GPIO) == button_fault_unstable);
+        assert(!stub_gpio_intr_enabled(TEST_GPIO));
+        assert(primary_calls == 1);
+
+        // Still unstable during the probe: back to quarantine.
+        stub_gpio_set_level(TEST_GPIO, 1);
+        stub_timers_advance(1000);
+        assert(stub_gpio_intr_enabled(TEST_GPIO));
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_gpio_edge(TEST_GPIO, 1);
+        assert(!stub_gpio_intr_enabled(TEST_GPIO));
+        assert(button_get_fault(TEST_GPIO) == button_fault_unstable);
+
+        // A quiet window after the next recheck restores it.
+        stub_timers_advance(1000);
+        stub_timers_advance(100);
+        assert(last_event == button_event_fault_cleared);
+        assert(button_get_fault(TEST_GPIO) == button_fault_none);
+
+        // Normal presses settle well within the window.
+        press_and_release();
+        assert(last_event == button_event_single_press);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void test_hold_tiers(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 1000;
+        config.long_press_tier_times[0] = 5000;
+        config.long_press_tier_times[1] = 10000;
+        stub_gpio_set_level(TEST_GPIO, 1);
+
+        config.long_press_tier_times[2] = 7000;
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == -3);
+        config.long_press_tier_times[2] = 0;
+
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, value_subscriber, NULL) == 0);
+
+        // Each threshold of one hold emits its own event, timed from the press.
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(10);
+        assert(primary_calls == 0);
+
+        const button_event_t tiers[] = {
+                button_event_long_press, button_event_long_press_2, button_event_long_press_3,
+        };
+        const TickType_t thresholds[] = { 1000, 5000, 10000 };
+        TickType_t held = 0;
+        for (int32_t tier = 1; tier <= 3; tier++) {
+                stub_timers_advance(thresholds[tier - 1] - held - 1);
+                assert(primary_calls == tier - 1);
+                stub_timers_advance(1);
+                held = thresholds[tier - 1];
+                assert(primary_calls == tier);
+                assert(last_event == tiers[tier - 1]);
+                assert(last_value == tier);
+        }
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(60000);
+        assert(primary_calls == 3);
+
+        // Released between tiers: the chain stops.
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(10 + 1000);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(60000);
+        assert(primary_calls == 1);
+        assert(last_event == button_event_long_press);
+
+        button_destroy(TEST_GPIO);
+
+        // Only the highest tier, on release.
+        config.long_press_report_on_release = true;
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, value_subscriber, NULL) == 0);
+
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(10 + 6000);
+        assert(primary_calls == 0);
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(10);
+        assert(primary_calls == 1);
+        assert(last_event == button_event_long_press_2);
+        assert(last_value == 2);
+
+        // A short press is still a press.
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(10);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(10);
+        assert(last_event == button_event_single_press);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void test_speculative_single_press(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.max_repeat_presses = 2;
+        config.speculative_single_press = true;
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, value_subscriber, NULL) == 0);
+
+        // Reported on release, not again when the window closes.
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(20);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(20);
+        assert(primary_calls == 1);
+        assert(last_event == button_event_single_press);
+        assert(last_value == 1);
+        stub_timers_advance(400);
+        assert(primary_calls == 1);
+
+        // The second press revokes it, its release completes the double.
+        reset_trace();
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(20);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(100);
+        assert(primary_calls == 1);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(20);
+        assert(primary_calls == 2);
+        assert(last_event == button_event_single_press_revoked);
+        assert(last_value == 1);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(20);
+        assert(primary_calls == 3);
+        assert(last_event == button_event_double_press);
+        assert(last_value == 2);
+        stub_timers_advance(400);
+        assert(primary_calls == 3);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void click(TickType_t hold, TickType_t pause) {
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(hold);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(pause);
+}
+
+static void test_adaptive_repeat_window(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.max_repeat_presses = 2;
+        config.adaptive_repeat_percentile = 90;
+        config.adaptive_repeat_min_timeout = 100;
+        stub_gpio_set_level(TEST_GPIO, 1);
+
+        config.adaptive_repeat_percentile = 101;
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == -3);
+        config.adaptive_repeat_percentile = 90;
+
+        uint16_t timeout = 0;
+        assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == -1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == 0);
+        assert(timeout == 300);
+
+        // A fast double-clicker: the window shrinks to the lower bound once
+        // enough gaps were seen, and only then.
+        reset_trace();
+        for (int i = 0; i < 8; i++) {
+                click(20, 60);
+                click(20, 700);
+                assert(last_event == button_event_double_press);
+                assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == 0);
+                assert(timeout == (i < 7 ? 300 : 100));
+        }
+        assert(primary_calls == 8);
+
+        reset_trace();
+        click(20, 150);
+        assert(primary_calls == 1);
+        assert(last_event == button_event_single_press);
+
+        // Slower clicks just after the short window still count and widen it.
+        for (int i = 0; i < 64; i++)
+                click(20, 250);
+        assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == 0);
+        assert(timeout > 250 && timeout <= 600);
+
+        // A persisted value is clamped into the bounds.
+        assert(button_set_learned_repeat_timeout(TEST_GPIO, 1000) == 0);
+        assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == 0);
+        assert(timeout == 600);
+        assert(button_set_learned_repeat_timeout(TEST_GPIO, 40) == 0);
+        assert(button_get_learned_repeat_timeout(TEST_GPIO, &timeout) == 0);
+        assert(timeout == 100);
+        button_destroy(TEST_GPIO);
+
+        // Fixed windows cannot be seeded.
+        assert(button_create(TEST_GPIO, button_config_default(button_active_low), primary_callback, NULL) == 0);
+        assert(button_set_learned_repeat_timeout(TEST_GPIO, 200) == -3);
+        button_destroy(TEST_GPIO);
+}
+
+static void test_boot_capture(void) {
+        const gpio_num_t released = TEST_GPIO + 1;
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 1000;
+        config.long_press_tier_times[0] = 3000;
+
+        assert(button_boot_capture(1ull << TEST_GPIO, 1ull << TEST_GPIO) == -5);
+        assert(button_boot_capture(1ull << GPIO_NUM_MAX, 0) == -5);
+
+        stub_gpio_set_level(TEST_GPIO, 0);
+        stub_gpio_set_level(released, 1);
+        assert(button_boot_capture((1ull << TEST_GPIO) | (1ull << released), 0) == 0);
+        stub_timers_advance(1500);
+
+        // Held for 1.5 s when created: reported with the first tier, which
+        // passed meanwhile, and no press on release.
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK_ALL, 0, value_subscriber, NULL) == 0);
+        assert(button_create(released, config, primary_callback, NULL) == 0);
+        assert(button_is_pressed(TEST_GPIO));
+        reset_trace();
+        stub_timers_advance(1);
+        assert(primary_calls == 2);
+        assert(last_event == button_event_long_press);
+
+        stub_timers_advance(1498);
+        assert(primary_calls == 2);
+        stub_timers_advance(1);
+        assert(primary_calls == 3);
+        assert(last_event == button_event_long_press_2);
+        assert(last_value == 2);
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(1000);
+        assert(primary_calls == 3);
+
+        // Afterwards it is an ordinary button.
+        click(20, 20);
+        assert(primary_calls == 4);
+        assert(last_event == button_event_single_press);
+        button_destroy(TEST_GPIO);
+        button_destroy(released);
+
+        // The capture is used once.
+        stub_gpio_set_level(TEST_GPIO, 0);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        reset_trace();
+        stub_timers_advance(10);
+        assert(primary_calls == 0);
+        button_destroy(TEST_GPIO);
+        stub_gpio_set_level(TEST_GPIO, 1);
+}
+
+static void boot_value_callback(button_event_t event, void *context) {
+        int *seen = context;
+        seen[event == button_event_held_since_boot ? 0 : 1]++;
+}
+
+static void test_boot_capture_held_value(void) {
+        int seen[2] = { 0, 0 };
+        stub_gpio_set_level(TEST_GPIO, 0);
+        assert(button_boot_capture(1ull << TEST_GPIO, 0) == 0);
+        stub_timers_advance(250);
+
+        assert(button_create(TEST_GPIO, button_config_default(button_active_low), boot_value_callback, seen) == 0);
+        assert(button_subscribe(TEST_GPIO, BUTTON_EVENT_MASK(button_event_held_since_boot), 0, value_subscriber, NULL) == 0);
+
+        // Released right away: reported once, without tiers configured and
+        // without a press on release.
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(500);
+        assert(seen[0] == 1 && seen[1] == 0);
+        assert(last_value >= 250 && last_value < 260);
+
+        button_destroy(TEST_GPIO);
+}
+
+static bool pressed_in_callback;
+
+static void pressed_state_callback(button_event_t event, void *context) {
+        (void) event;
+        (void) context;
+        pressed_in_callback = button_is_pressed(TEST_GPIO);
+}
+
+static void test_pressed_mask(void) {
+        const gpio_num_t other = TEST_GPIO + 35;
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 1000;
+
+        uint32_t generation = 0;
+        assert(button_get_pressed_mask(&generation) == 0);
+
+        // Already held when created.
+        stub_gpio_set_level(other, 0);
+        assert(button_create(other, config, primary_callback, NULL) == 0);
+        assert(button_is_pressed(other));
+        assert(button_get_pressed_mask(NULL) == (1ull << other));
+
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, pressed_state_callback, NULL) == 0);
+        assert(!button_is_pressed(TEST_GPIO));
+
+        // Bounces do not show; the debounced level does, before any callback.
+        uint32_t before = 0;
+        button_get_pressed_mask(&before);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_gpio_edge(TEST_GPIO, 0);
+        assert(!button_is_pressed(TEST_GPIO));
+        stub_timers_advance(10);
+        assert(button_is_pressed(TEST_GPIO));
+        assert(button_get_pressed_mask(&generation) == ((1ull << other) | (1ull << TEST_GPIO)));
+        assert(generation != before);
+
+        // No change, no new generation.
+        before = generation;
+        stub_timers_advance(1000);
+        assert(pressed_in_callback);
+        button_get_pressed_mask(&generation);
+        assert(generation == before);
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(10);
+        assert(!button_is_pressed(TEST_GPIO));
+
+        button_destroy(other);
+        assert(!button_is_pressed(other));
+        assert(button_get_pressed_mask(NULL) == 0);
+
+        button_destroy(TEST_GPIO);
+        stub_gpio_set_level(other, 1);
+}
+
+// Presses the button and returns after how many milliseconds it reads as
+// pressed.
+static int debounced_after(button_config_t config) {
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+
+        int elapsed = 0;
+        stub_gpio_edge(TEST_GPIO, 0);
+        while (!button_is_pressed(TEST_GPIO)) {
+                assert(elapsed < 100);
+                stub_timers_advance(1);
+                elapsed++;
+        }
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(100);
+        button_destroy(TEST_GPIO);
+        return elapsed;
+}
+
+static void test_debounce_window(void) {
+        button_config_t config = button_config_default(button_active_low);
+        assert(debounced_after(config) == 10);
+        config.debounce_time = 25;
+        assert(debounced_after(config) == 25);
+
+        // The 4 ms the hardware filter removes are not waited for again.
+        stub_gpio_set_glitch_filter_support(4000000);
+        config.debounce_time = 10;
+        config.glitch_filter_ns = 4000000;
+        assert(debounced_after(config) == 6);
+
+        // Filtered in hardware only; the edge is just deferred to the timer task.
+        config.debounce_time = 0;
+        assert(debounced_after(config) == 1);
+
+        stub_gpio_set_glitch_filter_support(0);
+}
+
+static void destroying_callback(button_event_t event, void *context) {
+        (void) event;
+        (void) context;
+        button_destroy(TEST_GPIO);
+        primary_calls++;
+}
+
+static void test_destroy_from_callback(void) {
+        button_config_t config = button_config_default(button_active_low);
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, config, destroying_callback, NULL) == 0);
+
+        reset_trace();
+        press_and_release();
+        assert(primary_calls == 1);
+
+        // The slot is released again and the pin no longer reports.
+        press_and_release();
+        assert(primary_calls == 1);
+        assert(button_create(TEST_GPIO, config, primary_callback, NULL) == 0);
+        button_destroy(TEST_GPIO);
+}
+
+static button_config_t recreated_config;
+
+static void recreating_callback(button_event_t event, void *context) {
+        (void) event;
+        (void) context;
+        button_destroy(TEST_GPIO);
+        assert(button_create(TEST_GPIO, recreated_config, primary_callback, NULL) == 0);
+        primary_calls++;
+}
+
+static void test_boot_hold_recreated(void) {
+        button_config_t config = button_config_default(button_active_low);
+        config.long_press_time = 1000;
+        config.long_press_tier_times[0] = 3000;
+        recreated_config = config;
+
+        stub_gpio_set_level(TEST_GPIO, 0);
+        assert(button_boot_capture(1ull << TEST_GPIO, 0) == 0);
+        stub_timers_advance(3500);
+
+        // Both tiers passed before it was created, but the first callback
+        // replaces the button: they are not reported to the new one.
+        assert(button_create(TEST_GPIO, config, recreating_callback, NULL) == 0);
+        reset_trace();
+        stub_timers_advance(1);
+        assert(primary_calls == 1);
+
+        stub_timers_advance(5000);
+        assert(primary_calls == 1);
+        button_destroy(TEST_GPIO);
+        stub_gpio_set_level(TEST_GPIO, 1);
+}
+
+int main(void) {
+        test_subscribers();
+        test_storm_fault_events();
+        test_stuck_fault();
+        test_unstable_fault();
+        test_hold_tiers();
+        test_speculative_single_press();
+        test_adaptive_repeat_window();
+        test_boot_capture();
+        test_boot_capture_held_value();
+        test_pressed_mask();
+        test_debounce_window();
+        test_destroy_from_callback();
+        test_boot_hold_recreated();
+
+        puts("button tests passed");
+        return 0;
+}
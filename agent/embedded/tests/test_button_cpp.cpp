@@ -0,0 +1,180 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "button.hpp"
+
+extern "C" {
+#include "stubs.h"
+}
+
+namespace {
+
+constexpr gpio_num_t test_gpio = 7;
+
+struct test_button : button::default_config {
+        static constexpr gpio_num_t gpio = test_gpio;
+};
+
+struct tiered_button : button::default_config {
+        static constexpr gpio_num_t gpio = test_gpio;
+        static constexpr uint16_t long_press_time = 1000;
+        static constexpr std::array<uint16_t, BUTTON_MAX_HOLD_TIERS - 1> long_press_tier_times = { 5000 };
+        static constexpr uint16_t max_repeat_presses = 2;
+};
+
+int function_events;
+
+void on_event(button_event_t event) {
+        assert(event == button_event_single_press);
+        function_events++;
+}
+
+struct counter {
+        int events = 0;
+
+        void on_event(button_event_t event) {
+                assert(event == button_event_single_press);
+                events++;
+        }
+};
+
+struct handler {
+        int single = 0;
+        unsigned tier = 0;
+        int boot_holds = 0;
+
+        void on_single_press() {
+                single++;
+        }
+
+        void on_held_since_boot() {
+                boot_holds++;
+        }
+
+        void on_long_press(unsigned long_press_tier) {
+                tier = long_press_tier;
+        }
+};
+
+void press_and_release() {
+        stub_gpio_edge(test_gpio, 0);
+        stub_timers_advance(10);
+        stub_gpio_edge(test_gpio, 1);
+        stub_timers_advance(10);
+}
+
+void test_config() {
+        // The configuration is a compile-time constant equal to what C code
+        // builds at run time.
+        constexpr button_config_t config = button::handle<tiered_button>::config;
+        static_assert(config.long_press_time == 1000);
+        static_assert(config.long_press_tier_times[0] == 5000);
+        static_assert(config.max_repeat_presses == 2);
+
+        button_config_t expected = button_config_default(button_active_low);
+        expected.long_press_time = 1000;
+        expected.long_press_tier_times[0] = 5000;
+        expected.max_repeat_presses = 2;
+        assert(std::memcmp(&config, &expected, sizeof(config)) == 0);
+
+        static_assert(button::detail::tick_representable(1000));
+        static_assert(button::detail::tick_representable(0));
+        static_assert(!std::is_copy_constructible_v<button::handle<test_button>>);
+        static_assert(std::is_nothrow_move_constructible_v<button::handle<test_button>>);
+}
+
+void test_bindings() {
+        stub_gpio_set_level(test_gpio, 1);
+
+        {
+                auto handle = button::handle<test_button>::bind<&on_event>();
+                assert(handle);
+                press_and_release();
+                assert(function_events == 1);
+
+                // The GPIO is owned until the handle goes away.
+                auto second = button::handle<test_button>::bind<&on_event>();
+                assert(!second);
+                assert(second.status() == -1);
+        }
+        assert(button_create(test_gpio, button_config_default(button_active_low), [](button_event_t, void*) {}, nullptr) == 0);
+        button_destroy(test_gpio);
+
+        counter object;
+        {
+                auto handle = button::handle<test_button>::bind<&counter::on_event>(object);
+                press_and_release();
+                assert(object.events == 1);
+
+                // Moving keeps the binding; the moved-from handle owns nothing.
+                auto moved = std::move(handle);
+                assert(!handle);
+                assert(moved);
+                press_and_release();
+                assert(object.events == 2);
+        }
+
+        int lambda_events = 0;
+        auto lambda = [&lambda_events](button_event_t event) {
+                assert(event == button_event_single_press);
+                lambda_events++;
+        };
+        {
+                auto handle = button::handle<test_button>::bind(lambda);
+                press_and_release();
+                assert(lambda_events == 1);
+
+                handle.reset();
+                assert(!handle);
+                press_and_release();
+                assert(lambda_events == 1);
+        }
+}
+
+void test_handler_dispatch() {
+        handler object;
+        auto handle = button::handle<tiered_button>::bind_handler(object);
+        assert(handle);
+
+        stub_gpio_edge(test_gpio, 0);
+        stub_timers_advance(10 + 5000);
+        assert(object.tier == 2);
+        stub_gpio_edge(test_gpio, 1);
+        stub_timers_advance(10);
+
+        press_and_release();
+        stub_timers_advance(tiered_button::repeat_press_timeout);
+        assert(object.single == 1);
+        assert(object.boot_holds == 0);
+}
+
+void test_handler_boot_hold() {
+        stub_gpio_set_level(test_gpio, 0);
+        assert(button_boot_capture(1ull << test_gpio, 0) == 0);
+        stub_timers_advance(100);
+
+        handler object;
+        auto handle = button::handle<test_button>::bind_handler(object);
+        assert(handle);
+
+        // Reported once; the release is no press.
+        stub_gpio_edge(test_gpio, 1);
+        stub_timers_advance(500);
+        assert(object.boot_holds == 1);
+        assert(object.single == 0);
+}
+
+} // namespace
+
+int main() {
+        test_config();
+        test_bindings();
+        test_handler_dispatch();
+        test_handler_boot_hold();
+
+        std::puts("button C++ tests passed");
+        return 0;
+}
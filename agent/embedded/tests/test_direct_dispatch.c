@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "stubs.h"
+
+#define GPIO_LOW 4
+#define GPIO_HIGH 38
+#define GPIO_A 12
+#define GPIO_B 13
+
+static int presses[GPIO_NUM_MAX];
+static int rotate_steps;
+
+static void count_press(button_event_t event, void *context) {
+        const gpio_num_t gpio = (gpio_num_t) (intptr_t) context;
+        if (event == button_event_single_press)
+                presses[gpio]++;
+}
+
+static void count_steps(const button_event_info_t *info, void *context) {
+        (void) context;
+        rotate_steps += info->value;
+}
+
+static void test_simultaneous_edges(void) {
+        stub_gpio_set_level(GPIO_LOW, 1);
+        stub_gpio_set_level(GPIO_HIGH, 1);
+        assert(button_create(GPIO_LOW, button_config_default(button_active_low), count_press, (void*) GPIO_LOW) == 0);
+        assert(button_create(GPIO_HIGH, button_config_default(button_active_low), count_press, (void*) GPIO_HIGH) == 0);
+
+        // Both buttons, one in each status word, in a single interrupt entry.
+        const gpio_num_t gpios[] = { GPIO_LOW, GPIO_HIGH };
+        const uint32_t pressed[] = { 0, 0 };
+        const uint32_t released[] = { 1, 1 };
+
+        const uint32_t entries = stub_gpio_isr_entries();
+        stub_gpio_edges(gpios, pressed, 2);
+        assert(stub_gpio_isr_entries() == entries + 1);
+        assert(stub_gpio_isr_calls(GPIO_LOW) == 1);
+        assert(stub_gpio_isr_calls(GPIO_HIGH) == 1);
+
+        stub_timers_advance(20);
+        assert(button_is_pressed(GPIO_LOW) && button_is_pressed(GPIO_HIGH));
+        stub_gpio_edges(gpios, released, 2);
+        stub_timers_advance(400);
+        assert(presses[GPIO_LOW] == 1);
+        assert(presses[GPIO_HIGH] == 1);
+
+        // A destroyed button no longer receives its pin.
+        button_destroy(GPIO_HIGH);
+        stub_gpio_edges(gpios, pressed, 2);
+        stub_timers_advance(20);
+        stub_gpio_edges(gpios, released, 2);
+        stub_timers_advance(400);
+        assert(presses[GPIO_LOW] == 2);
+        assert(presses[GPIO_HIGH] == 1);
+        assert(stub_gpio_isr_calls(GPIO_HIGH) == 2);
+
+        button_destroy(GPIO_LOW);
+}
+
+static void test_encoder_dispatch(void) {
+        stub_gpio_set_level(GPIO_A, 1);
+        stub_gpio_set_level(GPIO_B, 1);
+        const button_encoder_config_t config = button_encoder_config_default(button_active_low);
+        assert(button_encoder_create(GPIO_A, GPIO_B, config, count_press, (void*) GPIO_A) == 0);
+        assert(button_subscribe(GPIO_A, BUTTON_EVENT_MASK(button_event_rotate), 0, count_steps, NULL) == 0);
+
+        stub_quadrature_turn(GPIO_A, GPIO_B, 8, 1);
+        stub_timers_advance(20);
+        assert(rotate_steps == 2);
+
+        button_destroy(GPIO_A);
+}
+
+int main(void) {
+        test_simultaneous_edges();
+        test_encoder_dispatch();
+
+        printf("direct GPIO dispatch tests passed\n");
+        return 0;
+}
@@ -0,0 +1,214 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "stubs.h"
+
+#define GPIO_NORMAL 4
+#define GPIO_HIGH 5
+#define GPIO_CRITICAL 6
+#define GPIO_OTHER 7
+
+static gpio_num_t delivered[BUTTON_DISPATCH_QUEUE_LENGTH * 2];
+static int delivered_count;
+
+static void record_press(button_event_t event, void *context) {
+        if (event != button_event_single_press)
+                return;
+        assert(delivered_count < (int) (sizeof(delivered) / sizeof(delivered[0])));
+        delivered[delivered_count++] = (gpio_num_t) (intptr_t) context;
+}
+
+static void press(gpio_num_t gpio) {
+        stub_gpio_edge(gpio, 0);
+        stub_timers_advance(20);
+        stub_gpio_edge(gpio, 1);
+        stub_timers_advance(20);
+}
+
+static void create(gpio_num_t gpio, button_priority_t priority) {
+        stub_gpio_set_level(gpio, 1);
+        button_config_t config = button_config_default(button_active_low);
+        config.repeat_press_timeout = 100;
+        config.priority = priority;
+        assert(button_create(gpio, config, record_press, (void*) (intptr_t) gpio) == 0);
+}
+
+static void test_priority_order(void) {
+        create(GPIO_NORMAL, button_priority_normal);
+        create(GPIO_HIGH, button_priority_high);
+        create(GPIO_CRITICAL, button_priority_critical);
+
+        // Normal first, then high, then critical; the critical one is
+        // delivered from the timer task, the others wait for the dispatcher.
+        press(GPIO_NORMAL);
+        press(GPIO_HIGH);
+        press(GPIO_CRITICAL);
+        stub_timers_advance(200);
+        assert(delivered_count == 1 && delivered[0] == GPIO_CRITICAL);
+
+        stub_timers_advance(50);
+        assert(button_dispatcher_run(0) == 2);
+        assert(delivered_count == 3);
+        assert(delivered[1] == GPIO_HIGH);
+        assert(delivered[2] == GPIO_NORMAL);
+        assert(button_dispatcher_run(0) == 0);
+
+        button_priority_stats_t stats;
+        assert(button_get_priority_stats(button_priority_critical, &stats, true) == 0);
+        assert(stats.delivered == 1 && stats.overflows == 0);
+        assert(stats.max_latency_us == 0);
+        assert(button_get_priority_stats(button_priority_high, &stats, true) == 0);
+        assert(stats.delivered == 1);
+        assert(stats.max_latency_us >= 50000);
+        assert(stats.total_latency_us == stats.max_latency_us);
+        assert(button_get_priority_stats(button_priority_normal, &stats, true) == 0);
+        assert(stats.delivered == 1);
+        assert(stats.max_latency_us >= 50000);
+        assert(button_get_priority_stats(BUTTON_PRIORITY_CLASSES, &stats, false) == -1);
+
+        button_destroy(GPIO_CRITICAL);
+        button_destroy(GPIO_HIGH);
+        button_destroy(GPIO_NORMAL);
+}
+
+static void test_destroyed_button_dropped(void) {
+        delivered_count = 0;
+        create(GPIO_NORMAL, button_priority_normal);
+        press(GPIO_NORMAL);
+        stub_timers_advance(200);
+
+        // Queued for the old button; a new one on the same GPIO must not get it.
+        button_destroy(GPIO_NORMAL);
+        create(GPIO_NORMAL, button_priority_normal);
+        assert(button_dispatcher_run(0) == 0);
+        assert(delivered_count == 0);
+
+        button_destroy(GPIO_NORMAL);
+        button_get_priority_stats(button_priority_normal, NULL, true);
+}
+
+static int destroying_deliveries;
+
+static void destroy_self(button_event_t event, void *context) {
+        if (event != button_event_single_press)
+                return;
+        destroying_deliveries++;
+        button_destroy((gpio_num_t) (intptr_t) context);
+}
+
+static void test_destroy_from_dispatcher(void) {
+        stub_gpio_set_level(GPIO_NORMAL, 1);
+        button_config_t config = button_config_default(button_active_low);
+        config.repeat_press_timeout = 100;
+        assert(button_create(GPIO_NORMAL, config, destroy_self, (void*) (intptr_t) GPIO_NORMAL) == 0);
+
+        press(GPIO_NORMAL);
+        stub_timers_advance(200);
+        press(GPIO_NORMAL);
+        stub_timers_advance(200);
+
+        // The first delivery destroys its own button without waiting for
+        // itself; the second one is dropped.
+        assert(button_dispatcher_run(0) == 1);
+        assert(destroying_deliveries == 1);
+
+        create(GPIO_NORMAL, button_priority_normal);
+        button_destroy(GPIO_NORMAL);
+        button_get_priority_stats(button_priority_normal, NULL, true);
+}
+
+static void test_queue_overflow(void) {
+        delivered_count = 0;
+        create(GPIO_NORMAL, button_priority_normal);
+        create(GPIO_OTHER, button_priority_normal);
+
+        for (int i = 0; i < BUTTON_DISPATCH_QUEUE_LENGTH + 1; i++) {
+                press(GPIO_NORMAL);
+                stub_timers_advance(200);
+        }
+
+        // Delivering it now would overtake the queued ones, so it is dropped.
+        assert(delivered_count == 0);
+        button_priority_stats_t stats;
+        assert(button_get_priority_stats(button_priority_normal, &stats, false) == 0);
+        assert(stats.dropped == 1 && stats.overflows == 0);
+
+        // A button with nothing queued is delivered right away.
+        press(GPIO_OTHER);
+        stub_timers_advance(200);
+        assert(delivered_count == 1 && delivered[0] == GPIO_OTHER);
+        assert(button_get_priority_stats(button_priority_normal, &stats, true) == 0);
+        assert(stats.overflows == 1);
+        assert(stats.delivered == 1);
+
+        assert(button_dispatcher_run(0) == BUTTON_DISPATCH_QUEUE_LENGTH);
+        assert(delivered_count == BUTTON_DISPATCH_QUEUE_LENGTH + 1);
+
+        button_destroy(GPIO_OTHER);
+        button_destroy(GPIO_NORMAL);
+}
+
+static button_event_t speculative_events[4];
+static int speculative_count;
+
+static void record_event(button_event_t event, void *context) {
+        (void) context;
+        assert(speculative_count < (int) (sizeof(speculative_events) / sizeof(speculative_events[0])));
+        speculative_events[speculative_count++] = event;
+}
+
+static void test_overflow_keeps_order(void) {
+        delivered_count = 0;
+        speculative_count = 0;
+        create(GPIO_OTHER, button_priority_normal);
+        for (int i = 0; i < BUTTON_DISPATCH_QUEUE_LENGTH - 1; i++) {
+                press(GPIO_OTHER);
+                stub_timers_advance(200);
+        }
+
+        stub_gpio_set_level(GPIO_NORMAL, 1);
+        button_config_t config = button_config_default(button_active_low);
+        config.repeat_press_timeout = 100;
+        config.max_repeat_presses = 2;
+        config.speculative_single_press = true;
+        assert(button_create(GPIO_NORMAL, config, record_event, NULL) == 0);
+
+        // The single press takes the last place in the queue; the revoke that
+        // depends on it must not reach the callback first.
+        press(GPIO_NORMAL);
+        press(GPIO_NORMAL);
+        stub_timers_advance(200);
+        assert(speculative_count == 0);
+
+        assert(button_dispatcher_run(0) == BUTTON_DISPATCH_QUEUE_LENGTH);
+        assert(speculative_count == 1);
+        assert(speculative_events[0] == button_event_single_press);
+
+        button_priority_stats_t stats;
+        assert(button_get_priority_stats(button_priority_normal, &stats, true) == 0);
+        assert(stats.dropped == 2 && stats.overflows == 0);
+
+        button_destroy(GPIO_NORMAL);
+        button_destroy(GPIO_OTHER);
+}
+
+int main(void) {
+        assert(button_dispatcher_run(0) == -1);
+        assert(button_dispatcher_enable() == 0);
+        assert(button_dispatcher_enable() == 0);
+
+        button_config_t config = button_config_default(button_active_low);
+        config.priority = (button_priority_t) BUTTON_PRIORITY_CLASSES;
+        assert(button_create(GPIO_NORMAL, config, record_press, NULL) == -3);
+
+        test_priority_order();
+        test_destroyed_button_dropped();
+        test_destroy_from_dispatcher();
+        test_queue_overflow();
+        test_overflow_keeps_order();
+
+        printf("dispatch tests passed\n");
+        return 0;
+}
@@ -0,0 +1,189 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "encoder.h"
+#include "stubs.h"
+
+#define GPIO_A 12
+#define GPIO_B 13
+
+static int32_t reported_steps;
+static int reports;
+static int32_t rotate_value;
+static int rotate_events;
+
+static void encoder_callback(int32_t steps, void *context) {
+        (void) context;
+        reported_steps += steps;
+        reports++;
+}
+
+static void button_callback(button_event_t event, void *context) {
+        (void) context;
+        assert(event == button_event_rotate);
+}
+
+static void rotate_subscriber(const button_event_info_t *info, void *context) {
+        (void) context;
+        assert(info->gpio_num == GPIO_A);
+        assert(info->event == button_event_rotate);
+        rotate_value += info->value;
+        rotate_events++;
+}
+
+static void reset_trace(void) {
+        reported_steps = 0;
+        reports = 0;
+        rotate_value = 0;
+        rotate_events = 0;
+}
+
+static void test_batching(void) {
+        stub_gpio_set_level(GPIO_A, 1);
+        stub_gpio_set_level(GPIO_B, 1);
+        assert(encoder_create(GPIO_A, GPIO_B, NULL, encoder_callback, NULL) == 0);
+        assert(encoder_create(GPIO_A, GPIO_B + 1, NULL, encoder_callback, NULL) == -1);
+        assert(encoder_create(GPIO_B + 1, GPIO_B, NULL, encoder_callback, NULL) == -1);
+
+        // A fast, bouncy burst only involves the timer task once.
+        reset_trace();
+        const uint32_t starts = stub_timer_isr_starts();
+        stub_quadrature_turn(GPIO_A, GPIO_B, 4000, 3);
+        assert(stub_timer_isr_starts() == starts + 1);
+
+        stub_tick_advance(20);
+        assert(stub_timers_run() == 1);
+        assert(reports == 1);
+        assert(reported_steps == 1000);
+        assert(encoder_get_position(GPIO_A) == 1000);
+        assert(encoder_get_velocity(GPIO_A) > 0);
+
+        // Idle: the next expiry finds nothing and disarms.
+        stub_tick_advance(20);
+        assert(stub_timers_run() == 1);
+        assert(reports == 1);
+        assert(encoder_get_velocity(GPIO_A) == 0);
+        assert(stub_timers_run() == 0);
+
+        // Backwards, with a partial step left over until the turn completes.
+        reset_trace();
+        stub_quadrature_turn(GPIO_A, GPIO_B, -6, 1);
+        stub_tick_advance(20);
+        stub_timers_run();
+        assert(reported_steps == -1);
+        stub_quadrature_turn(GPIO_A, GPIO_B, -2, 0);
+        stub_tick_advance(20);
+        stub_timers_run();
+        assert(reported_steps == -2);
+        assert(encoder_get_velocity(GPIO_A) < 0);
+        assert(encoder_get_position(GPIO_A) == 998);
+
+        // Bouncing on one channel without completing a transition is no step.
+        stub_tick_advance(20);
+        stub_timers_run();
+        stub_timers_run();
+        reset_trace();
+        stub_gpio_edge(GPIO_A, 0);
+        stub_gpio_edge(GPIO_A, 1);
+        stub_gpio_edge(GPIO_A, 0);
+        stub_gpio_edge(GPIO_A, 1);
+        stub_tick_advance(20);
+        stub_timers_run();
+        assert(reports == 0);
+
+        encoder_delete(GPIO_A);
+        assert(encoder_get_position(GPIO_A) == 0);
+        assert(stub_timers_run() == 0);
+}
+
+static void test_acceleration(void) {
+        encoder_config_t config = encoder_config_default();
+        config.acceleration_threshold = 100;
+        config.acceleration_max = 3;
+        assert(encoder_create(GPIO_A, GPIO_B, &config, encoder_callback, NULL) == 0);
+
+        // 1 step per interval: 50 steps/s, not accelerated.
+        reset_trace();
+        stub_tick_advance(20);
+        stub_quadrature_turn(GPIO_A, GPIO_B, 4, 0);
+        stub_timers_run();
+        assert(reported_steps == 1);
+
+        // 4 steps in 20 ms: 200 steps/s, doubled.
+        stub_tick_advance(20);
+        stub_quadrature_turn(GPIO_A, GPIO_B, 16, 0);
+        stub_timers_run();
+        assert(reported_steps == 1 + 8);
+        assert(encoder_get_velocity(GPIO_A) == 200);
+
+        // Very fast: capped at acceleration_max.
+        stub_tick_advance(20);
+        stub_quadrature_turn(GPIO_A, GPIO_B, -400, 0);
+        stub_timers_run();
+        assert(reported_steps == 1 + 8 - 300);
+        assert(encoder_get_position(GPIO_A) == reported_steps);
+
+        encoder_delete(GPIO_A);
+}
+
+static void deleting_callback(int32_t steps, void *context) {
+        (void) context;
+        reported_steps += steps;
+        reports++;
+        encoder_delete(GPIO_A);
+}
+
+static void test_delete_from_report(void) {
+        assert(encoder_create(GPIO_A, GPIO_B, NULL, deleting_callback, NULL) == 0);
+
+        reset_trace();
+        stub_quadrature_turn(GPIO_A, GPIO_B, 8, 0);
+        stub_tick_advance(20);
+        assert(stub_timers_run() == 1);
+        assert(reports == 1);
+
+        // Deleted from its own report: nothing fires and the pins are free.
+        stub_quadrature_turn(GPIO_A, GPIO_B, 8, 0);
+        stub_tick_advance(20);
+        assert(stub_timers_run() == 0);
+        assert(reports == 1);
+        assert(encoder_create(GPIO_A, GPIO_B, NULL, encoder_callback, NULL) == 0);
+        encoder_delete(GPIO_A);
+}
+
+static void test_button_encoder(void) {
+        button_encoder_config_t config = button_encoder_config_default(button_active_low);
+        assert(button_encoder_create(GPIO_A, GPIO_A, config, button_callback, NULL) == -5);
+        assert(button_encoder_create(GPIO_A, GPIO_B, config, NULL, NULL) == -6);
+        assert(button_encoder_create(GPIO_A, GPIO_B, config, button_callback, NULL) == 0);
+
+        // The second channel is taken as well.
+        assert(button_create(GPIO_B, button_config_default(button_active_low), button_callback, NULL) == -1);
+
+        assert(button_subscribe(GPIO_A, BUTTON_EVENT_MASK(button_event_rotate), 0, rotate_subscriber, NULL) == 0);
+
+        reset_trace();
+        stub_quadrature_turn(GPIO_A, GPIO_B, 12, 2);
+        stub_tick_advance(20);
+        stub_timers_run();
+        assert(rotate_events == 1);
+        assert(rotate_value == 3);
+        assert(button_encoder_get_position(GPIO_A) == 3);
+
+        button_destroy(GPIO_A);
+        assert(button_encoder_get_position(GPIO_A) == 0);
+        assert(button_create(GPIO_B, button_config_default(button_active_low), button_callback, NULL) == 0);
+        button_destroy(GPIO_B);
+}
+
+int main(void) {
+        test_batching();
+        test_acceleration();
+        test_delete_from_report();
+        test_button_encoder();
+
+        printf("encoder tests passed\n");
+        return 0;
+}
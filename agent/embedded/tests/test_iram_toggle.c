@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "stubs.h"
+
+#define TEST_GPIO 5
+
+static button_event_t events[8];
+static int event_count;
+
+static void record_event(button_event_t event, void *context) {
+        (void) context;
+        events[event_count++] = event;
+}
+
+static void test_press_during_flash_write(void) {
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, button_config_default(button_active_low), record_event, NULL) == 0);
+
+        // A complete, bouncy press while the timer task cannot run.
+        stub_flash_cache_set_enabled(false);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(40);
+        assert(!button_is_pressed(TEST_GPIO));
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(60);
+        assert(event_count == 0);
+
+        // Replayed once the cache is back: the bounce is dropped, the press is not.
+        stub_flash_cache_set_enabled(true);
+        stub_timers_advance(300);
+        assert(event_count == 1);
+        assert(events[0] == button_event_single_press);
+        assert(!button_is_pressed(TEST_GPIO));
+
+        button_capture_stats_t stats;
+        assert(button_get_capture_stats(TEST_GPIO, &stats, true) == 0);
+        assert(stats.captured == 4);
+        assert(stats.captured_during_flash == 4);
+        assert(stats.overflows == 0);
+        assert(stats.max_flash_latency_us >= 100000);
+        assert(stats.max_latency_us == stats.max_flash_latency_us);
+
+        assert(button_get_capture_stats(TEST_GPIO, &stats, false) == 0);
+        assert(stats.captured == 0 && stats.max_latency_us == 0);
+        assert(button_get_capture_stats(TEST_GPIO + 1, &stats, false) == -1);
+
+        // Outside flash operations edges are processed after the debounce window.
+        event_count = 0;
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(20);
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(300);
+        assert(event_count == 1);
+        assert(button_get_capture_stats(TEST_GPIO, &stats, true) == 0);
+        assert(stats.captured == 2 && stats.captured_during_flash == 0);
+        assert(stats.max_flash_latency_us == 0);
+        assert(stats.max_latency_us >= 10000 && stats.max_latency_us < 100000);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void test_ring_overflow(void) {
+        stub_gpio_set_level(TEST_GPIO, 1);
+        assert(button_create(TEST_GPIO, button_config_default(button_active_low), record_event, NULL) == 0);
+        event_count = 0;
+
+        // More edges than the ring holds: the surplus is counted, and the level
+        // is still resampled when the timer runs.
+        stub_flash_cache_set_enabled(false);
+        for (int i = 0; i < 6; i++) {
+                stub_gpio_edge(TEST_GPIO, 0);
+                stub_gpio_edge(TEST_GPIO, 1);
+        }
+        stub_gpio_edge(TEST_GPIO, 0);
+        stub_timers_advance(50);
+        stub_flash_cache_set_enabled(true);
+        stub_timers_advance(1);
+        assert(button_is_pressed(TEST_GPIO));
+
+        button_capture_stats_t stats;
+        assert(button_get_capture_stats(TEST_GPIO, &stats, false) == 0);
+        assert(stats.captured == 13);
+        assert(stats.overflows == 13 - 8);
+
+        stub_gpio_edge(TEST_GPIO, 1);
+        stub_timers_advance(300);
+        assert(event_count == 1);
+        assert(events[0] == button_event_single_press);
+
+        button_destroy(TEST_GPIO);
+}
+
+static void destroy_on_single_press(button_event_t event, void *context) {
+        record_event(event, context);
+        if (event == button_event_single_press)
+                button_destroy(TEST_GPIO);
+}
+
+static void test_destroy_during_replay(void) {
+        button_config_t config = button_config_default(button_active_high);
+        config.speculative_single_press = true;
+        stub_gpio_set_level(TEST_GPIO, 0);
+        assert(button_create(TEST_GPIO, config, destroy_on_single_press, NULL) == 0);
+        event_count = 0;
+
+        // Two presses while the timer task cannot run; the first one's release
+        // destroys the button, so the rest of the replay is dropped.
+        stub_flash_cache_set_enabled(false);
+        for (int i = 0; i < 2; i++) {
+                stub_gpio_edge(TEST_GPIO, 1);
+                stub_timers_advance(40);
+                stub_gpio_edge(TEST_GPIO, 0);
+                stub_timers_advance(40);
+        }
+        stub_flash_cache_set_enabled(true);
+        stub_timers_advance(300);
+        assert(event_count == 1);
+        assert(events[0] == button_event_single_press);
+
+        button_capture_stats_t stats;
+        assert(button_get_capture_stats(TEST_GPIO, &stats, false) == -1);
+}
+
+int main(void) {
+        test_press_during_flash_write();
+        test_ring_overflow();
+        test_destroy_during_replay();
+
+        printf("IRAM-safe toggle tests passed\n");
+        return 0;
+}
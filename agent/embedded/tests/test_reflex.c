@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "stubs.h"
+
+#define GPIO_BUTTON 4
+#define GPIO_LED 10
+#define GPIO_RELAY 11
+#define GPIO_PAD 3
+
+static int single_presses;
+static bool led_on_at_callback;
+
+static void record_event(button_event_t event, void *context) {
+        (void) context;
+        if (event == button_event_single_press) {
+                single_presses++;
+                led_on_at_callback = gpio_get_level(GPIO_LED) == 1;
+        }
+}
+
+static void press(gpio_num_t gpio, uint32_t held_ms) {
+        stub_gpio_edge(gpio, 0);
+        stub_timers_advance(held_ms);
+        stub_gpio_edge(gpio, 1);
+        stub_timers_advance(20);
+}
+
+static void create(gpio_num_t gpio) {
+        stub_gpio_set_level(gpio, 1);
+        button_config_t config = button_config_default(button_active_low);
+        config.repeat_press_timeout = 100;
+        config.long_press_time = 500;
+        assert(button_create(gpio, config, record_event, NULL) == 0);
+}
+
+static button_reflex_t output(button_reflex_action_t action, gpio_num_t gpio) {
+        return (button_reflex_t) { .action = action, .output = gpio };
+}
+
+static void test_event_reflexes(void) {
+        create(GPIO_BUTTON);
+        stub_gpio_set_level(GPIO_LED, 0);
+        stub_gpio_set_level(GPIO_RELAY, 0);
+
+        assert(button_reflex_bind(GPIO_BUTTON, BUTTON_EVENT_MASK(button_event_single_press),
+                                  output(button_reflex_output_high, GPIO_LED)) == 0);
+        assert(button_reflex_bind(GPIO_BUTTON, BUTTON_EVENT_MASK(button_event_long_press),
+                                  output(button_reflex_output_toggle, GPIO_RELAY)) == 0);
+        assert(stub_gpio_is_output(GPIO_LED) && stub_gpio_is_output(GPIO_RELAY));
+        assert(gpio_get_level(GPIO_LED) == 0);
+
+        // The output is driven before the callback runs.
+        press(GPIO_BUTTON, 50);
+        stub_timers_advance(200);
+        assert(single_presses == 1);
+        assert(led_on_at_callback);
+        assert(gpio_get_level(GPIO_RELAY) == 0);
+
+        press(GPIO_BUTTON, 600);
+        assert(gpio_get_level(GPIO_RELAY) == 1);
+        press(GPIO_BUTTON, 600);
+        assert(gpio_get_level(GPIO_RELAY) == 0);
+
+        // Destroying the button drops its reflexes.
+        button_destroy(GPIO_BUTTON);
+        create(GPIO_BUTTON);
+        press(GPIO_BUTTON, 600);
+        assert(gpio_get_level(GPIO_RELAY) == 0);
+        button_destroy(GPIO_BUTTON);
+}
+
+static void test_edge_reflex(void) {
+        create(GPIO_BUTTON);
+        stub_gpio_set_level(GPIO_LED, 0);
+        assert(button_reflex_bind_edge(GPIO_BUTTON, output(button_reflex_output_toggle, GPIO_LED)) == 0);
+
+        // Acted on in the interrupt, before any timer ran, once per press
+        // however much the contact bounces.
+        stub_gpio_edge(GPIO_BUTTON, 0);
+        assert(gpio_get_level(GPIO_LED) == 1);
+        stub_gpio_edge(GPIO_BUTTON, 1);
+        stub_gpio_edge(GPIO_BUTTON, 0);
+        assert(gpio_get_level(GPIO_LED) == 1);
+        stub_timers_advance(50);
+        assert(button_is_pressed(GPIO_BUTTON));
+
+        // Neither a release nor a bounce of the held contact is a leading edge.
+        stub_gpio_edge(GPIO_BUTTON, 1);
+        stub_gpio_edge(GPIO_BUTTON, 0);
+        stub_timers_advance(50);
+        stub_gpio_edge(GPIO_BUTTON, 1);
+        stub_timers_advance(50);
+        assert(gpio_get_level(GPIO_LED) == 1);
+
+        press(GPIO_BUTTON, 50);
+        assert(gpio_get_level(GPIO_LED) == 0);
+
+        assert(button_reflex_clear(GPIO_BUTTON) == 0);
+        press(GPIO_BUTTON, 50);
+        assert(gpio_get_level(GPIO_LED) == 0);
+
+        button_destroy(GPIO_BUTTON);
+}
+
+static void test_task_reflexes(void) {
+        create(GPIO_BUTTON);
+
+        SemaphoreHandle_t semaphore = xSemaphoreCreateCounting(4, 0);
+        const button_reflex_t give = {
+                .action = button_reflex_give_semaphore,
+                .semaphore = semaphore,
+        };
+        const button_reflex_t notify = {
+                .action = button_reflex_notify_task,
+                .task = xTaskGetCurrentTaskHandle(),
+                .notify_bits = 0x4,
+        };
+        assert(button_reflex_bind(GPIO_BUTTON, BUTTON_EVENT_MASK(button_event_single_press), give) == 0);
+        assert(button_reflex_bind_edge(GPIO_BUTTON, notify) == 0);
+
+        uint32_t value = 0;
+        stub_gpio_edge(GPIO_BUTTON, 0);
+        assert(xTaskNotifyWait(0, 0xffffffffu, &value, 0) == pdTRUE);
+        assert(value == 0x4);
+        assert(xSemaphoreTake(semaphore, 0) == pdFALSE);
+
+        stub_timers_advance(50);
+        stub_gpio_edge(GPIO_BUTTON, 1);
+        stub_timers_advance(200);
+        assert(xSemaphoreTake(semaphore, 0) == pdTRUE);
+        assert(xTaskNotifyWait(0, 0xffffffffu, &value, 0) == pdFALSE);
+
+        button_destroy(GPIO_BUTTON);
+        vSemaphoreDelete(semaphore);
+}
+
+static void test_errors(void) {
+        const button_reflex_t led = output(button_reflex_output_high, GPIO_LED);
+        const button_event_mask_t mask = BUTTON_EVENT_MASK(button_event_single_press);
+
+        assert(button_reflex_bind(GPIO_NUM_MAX, mask, led) == -5);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, led) == -1);
+        assert(button_reflex_clear(GPIO_BUTTON) == -1);
+
+        create(GPIO_BUTTON);
+        assert(button_reflex_bind(GPIO_BUTTON, 0, led) == -3);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, output(button_reflex_output_low, GPIO_BUTTON)) == -3);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, output(button_reflex_output_low, GPIO_NUM_MAX)) == -3);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, (button_reflex_t) { .action = button_reflex_give_semaphore }) == -3);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, (button_reflex_t) { .action = button_reflex_notify_task }) == -3);
+        assert(button_reflex_bind(GPIO_BUTTON, mask, (button_reflex_t) { .action = (button_reflex_action_t) 99 }) == -3);
+
+        for (int i = 0; i < BUTTON_MAX_REFLEXES; i++) {
+                assert(button_reflex_bind(GPIO_BUTTON, mask, led) == 0);
+        }
+        assert(button_reflex_bind(GPIO_BUTTON, mask, led) == -2);
+        assert(button_reflex_bind_edge(GPIO_BUTTON, led) == -2);
+        assert(button_reflex_clear(GPIO_BUTTON) == 0);
+        assert(button_reflex_bind_edge(GPIO_BUTTON, led) == 0);
+        button_destroy(GPIO_BUTTON);
+
+        // Touch pads have no interrupt to act on, but their events do.
+        stub_touch_set_raw(GPIO_PAD, 1000);
+        assert(button_touch_create(GPIO_PAD, button_config_default(button_active_high),
+                                   button_touch_config_default(), record_event, NULL) == 0);
+        assert(button_reflex_bind_edge(GPIO_PAD, led) == -4);
+        assert(button_reflex_bind(GPIO_PAD, mask, led) == 0);
+        button_destroy(GPIO_PAD);
+}
+
+int main(void) {
+        test_event_reflexes();
+        test_edge_reflex();
+        test_task_reflexes();
+        test_errors();
+
+        printf("reflex tests passed\n");
+        return 0;
+}
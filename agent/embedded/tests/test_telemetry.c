@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "button.h"
+#include "telemetry.h"
+#include "port.h"
+#include "stubs.h"
+
+#define GPIO_BUTTON 4
+#define GPIO_OTHER 5
+
+static char last_body[TELEMETRY_PAYLOAD_SIZE];
+static int posts;
+static int post_status = 200;
+static void (*during_post)(void);
+
+static int mock_post(const char *body, size_t length, void* context) {
+        assert(context == &posts);
+        assert(length < sizeof(last_body) && strlen(body) == length);
+        memcpy(last_body, body, length + 1);
+        posts++;
+        if (during_post)
+                during_post();
+        return post_status;
+}
+
+static void ignore_event(button_event_t event, void *context) {
+        (void) event;
+        (void) context;
+}
+
+static void create(gpio_num_t gpio) {
+        stub_gpio_set_level(gpio, 1);
+        button_config_t config = button_config_default(button_active_low);
+        config.repeat_press_timeout = 100;
+        config.long_press_time = 500;
+        assert(button_create(gpio, config, ignore_event, NULL) == 0);
+}
+
+static void press(gpio_num_t gpio) {
+        stub_gpio_edge(gpio, 0);
+        stub_timers_advance(50);
+        stub_gpio_edge(gpio, 1);
+        stub_timers_advance(200);
+}
+
+static void seconds(uint32_t count) {
+        stub_tick_advance(count * configTICK_RATE_HZ);
+}
+
+// Move to the start of the next bucket of the given length.
+static void align(uint32_t bucket_seconds) {
+        const TickType_t bucket = bucket_seconds * configTICK_RATE_HZ;
+        stub_tick_advance(bucket - xTaskGetTickCount() % bucket);
+}
+
+static telemetry_config_t mock_config(void) {
+        telemetry_config_t config = telemetry_config_default("AGENT-0042", NULL);
+        config.post = mock_post;
+        config.post_context = &posts;
+        config.flush_records = 8;
+        config.flush_interval = 120;
+        return config;
+}
+
+static void start(const telemetry_config_t *config) {
+        posts = 0;
+        post_status = 200;
+        during_post = NULL;
+        assert(telemetry_init(config) == 0);
+        create(GPIO_BUTTON);
+        assert(telemetry_track(GPIO_BUTTON, BUTTON_EVENT_MASK(button_event_single_press)
+                                            | BUTTON_EVENT_MASK(button_event_long_press)) == 0);
+}
+
+static void stop(void) {
+        telemetry_deinit();
+        button_destroy(GPIO_BUTTON);
+}
+
+static bool body_has_record(gpio_num_t gpio, const char *event, uint32_t count, uint32_t bucket_start) {
+        char record[128];
+        snprintf(record, sizeof(record), "{\"gpio\":%d,\"event\":\"%s\",\"count\":%lu,\"bucket_start\":%lu}",
+                 (int) gpio, event, (unsigned long) count, (unsigned long) bucket_start);
+        return strstr(last_body, record) != NULL;
+}
+
+static telemetry_stats_t stats(void) {
+        telemetry_stats_t result;
+        assert(telemetry_get_stats(&result) == 0);
+        return result;
+}
+
+static void test_aggregation(void) {
+        const telemetry_config_t config = mock_config();
+        align(config.bucket_seconds);
+        start(&config);
+        create(GPIO_OTHER);
+        assert(telemetry_track(GPIO_OTHER, BUTTON_EVENT_MASK_ALL) == 0);
+
+        // Events of a button within a bucket share one record.
+        const uint32_t bucket = my_uptime_seconds();
+        press(GPIO_BUTTON);
+        press(GPIO_BUTTON);
+        press(GPIO_BUTTON);
+        press(GPIO_OTHER);
+        assert(stats().pending == 2);
+
+        // Not due yet: neither enough records nor old enough.
+        assert(telemetry_poll(false) == 0);
+        assert(posts == 0);
+
+        seconds(config.flush_interval);
+        press(GPIO_BUTTON);
+        assert(telemetry_poll(false) == 1);
+        assert(posts == 1);
+        assert(strstr(last_body, "\"serial_number\":\"AGENT-0042\""));
+        assert(strstr(last_body, "\"bucket_seconds\":60"));
+        assert(body_has_record(GPIO_BUTTON, "single_press", 3, bucket));
+        assert(body_has_record(GPIO_OTHER, "single_press", 1, bucket));
+        assert(body_has_record(GPIO_BUTTON, "single_press", 1, bucket + config.flush_interval));
+        assert(strstr(last_body, "\"logs\":[{\"level\":\"info\",\"message\":\"button dispatch normal delivered="));
+
+        telemetry_stats_t sent = stats();
+        assert(sent.pending == 0 && sent.batches_sent == 1 && sent.records_sent == 3 && sent.dropped == 0);
+        assert(telemetry_poll(true) == 0);
+
+        // Untracked buttons are no longer counted.
+        assert(telemetry_untrack(GPIO_OTHER) == 0);
+        press(GPIO_OTHER);
+        assert(stats().pending == 0);
+        button_destroy(GPIO_OTHER);
+
+        stop();
+}
+
+static void test_size_threshold(void) {
+        telemetry_config_t config = mock_config();
+        config.bucket_seconds = 1;
+        config.flush_records = 4;
+        start(&config);
+
+        for (int i = 0; i < 3; i++) {
+                press(GPIO_BUTTON);
+                seconds(1);
+        }
+        assert(telemetry_poll(false) == 0);
+        press(GPIO_BUTTON);
+        assert(telemetry_poll(false) == 1);
+        assert(stats().records_sent == 4);
+
+        stop();
+}
+
+static void test_backoff(void) {
+        telemetry_config_t config = mock_config();
+        config.flush_records = 1;
+        config.backoff_min = 10;
+        config.backoff_max = 40;
+        start(&config);
+        post_status = 503;
+
+        align(config.bucket_seconds);
+        const uint32_t bucket = my_uptime_seconds();
+        press(GPIO_BUTTON);
+        align(1);
+        assert(telemetry_poll(false) == -2);
+        assert(posts == 1);
+
+        // The records are kept and counted into again.
+        press(GPIO_BUTTON);
+        assert(stats().pending == 1);
+
+        // Waits 10, 20, 40 and then 40 seconds again between attempts.
+        static const uint32_t waits[] = { 10, 20, 40, 40 };
+        for (size_t i = 0; i < sizeof(waits) / sizeof(waits[0]); i++) {
+                seconds(waits[i] - 1);
+                assert(telemetry_poll(false) == 0);
+                seconds(1);
+                assert(telemetry_poll(false) == -2);
+                assert(posts == (int) i + 2);
+        }
+
+        telemetry_stats_t failed = stats();
+        assert(failed.batches_failed == 5 && failed.batches_sent == 0);
+        assert(failed.pending == 1 && failed.dropped == 0);
+
+        seconds(40);
+        post_status = 200;
+        assert(telemetry_poll(false) == 1);
+        assert(body_has_record(GPIO_BUTTON, "single_press", 2, bucket));
+
+        // A success resets the backoff.
+        press(GPIO_BUTTON);
+        post_status = 503;
+        assert(telemetry_poll(false) == -2);
+        seconds(10);
+        post_status = 200;
+        assert(telemetry_poll(false) == 1);
+
+        stop();
+}
+
+static void test_offline_drops(void) {
+        telemetry_config_t config = mock_config();
+        config.bucket_seconds = 1;
+        config.flush_records = TELEMETRY_MAX_RECORDS;
+        start(&config);
+
+        // Offline: the oldest records make room for new ones and are counted.
+        for (int i = 0; i < TELEMETRY_MAX_RECORDS + 5; i++) {
+                press(GPIO_BUTTON);
+                seconds(1);
+        }
+        telemetry_stats_t offline = stats();
+        assert(offline.pending == TELEMETRY_MAX_RECORDS);
+        assert(offline.dropped == 5);
+
+        // The drop is reported with the first batch. A batch takes as many
+        // records as fit into the payload; the rest follow.
+        assert(telemetry_poll(false) == 1);
+        assert(strstr(last_body, "{\"level\":\"warning\",\"message\":\"telemetry dropped_records=5\"}"));
+        const uint32_t first_batch = stats().records_sent;
+        assert(first_batch > 0 && first_batch < TELEMETRY_MAX_RECORDS);
+
+        while (stats().pending)
+                assert(telemetry_poll(true) == 1);
+        assert(!strstr(last_body, "dropped_records"));
+        assert(stats().records_sent == TELEMETRY_MAX_RECORDS);
+
+        stop();
+}
+
+static void press_three_times(void) {
+        for (int i = 0; i < 3; i++) {
+                press(GPIO_BUTTON);
+                seconds(1);
+        }
+}
+
+static void test_drops_during_upload(void) {
+        telemetry_config_t config = mock_config();
+        config.bucket_seconds = 1;
+        config.flush_records = TELEMETRY_MAX_RECORDS;
+        start(&config);
+
+        for (int i = 0; i < TELEMETRY_MAX_RECORDS; i++) {
+                press(GPIO_BUTTON);
+                seconds(1);
+        }
+
+        // Records dropped while their batch is in flight are not lost when
+        // the upload succeeds.
+        during_post = press_three_times;
+        assert(telemetry_poll(false) == 1);
+        telemetry_stats_t sent = stats();
+        assert(sent.dropped == 0);
+        assert(sent.pending == TELEMETRY_MAX_RECORDS - sent.records_sent + 3);
+
+        during_post = NULL;
+        while (stats().pending < TELEMETRY_MAX_RECORDS) {
+                press(GPIO_BUTTON);
+                seconds(1);
+        }
+
+        // When it fails they are.
+        during_post = press_three_times;
+        post_status = 500;
+        assert(telemetry_poll(false) == -2);
+        telemetry_stats_t failed = stats();
+        assert(failed.dropped == 3);
+        assert(failed.pending == TELEMETRY_MAX_RECORDS);
+
+        during_post = NULL;
+        post_status = 200;
+        seconds(config.backoff_min);
+        assert(telemetry_poll(false) == 1);
+        assert(strstr(last_body, "telemetry dropped_records=3"));
+
+        stop();
+}
+
+// Minimal HTTP server on the loopback interface, answering a fixed number of
+// requests with the status in server_status.
+typedef struct {
+        int listener;
+        int requests;
+        int status;
+        char path[128];
+        char body[TELEMETRY_PAYLOAD_SIZE];
+} mock_server_t;
+
+static void *serve(void *arg) {
+        mock_server_t *server = arg;
+
+        for (int i = 0; i < server->requests; i++) {
+                const int fd = accept(server->listener, NULL, NULL);
+                assert(fd >= 0);
+
+                static char request[TELEMETRY_PAYLOAD_SIZE + 512];
+                size_t received = 0;
+                char *body = NULL;
+                size_t content_length = 0;
+                while (received < sizeof(request) - 1) {
+                        const ssize_t n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+                        assert(n > 0);
+                        received += (size_t) n;
+                        request[received] = '\0';
+                        if (!body && (body = strstr(request, "\r\n\r\n"))) {
+                                body += 4;
+                                const char *header = strstr(request, "Content-Length: ");
+                                assert(header);
+                                content_length = strtoul(header + 16, NULL, 10);
+                        }
+                        if (body && (size_t) (request + received - body) >= content_length)
+                                break;
+                }
+
+                assert(sscanf(request, "POST %127s HTTP/1.0", server->path) == 1);
+                assert(content_length < sizeof(server->body));
+                memcpy(server->body, body, content_length);
+                server->body[content_length] = '\0';
+
+                char response[64];
+                const int length = snprintf(response, sizeof(response),
+                                            "HTTP/1.0 %d Status\r\nContent-Length: 0\r\n\r\n", server->status);
+                assert(send(fd, response, (size_t) length, 0) == length);
+                close(fd);
+        }
+
+        return NULL;
+}
+
+static void test_http_uplink(void) {
+        static mock_server_t server = { .requests = 2, .status = 200 };
+        server.listener = socket(AF_INET, SOCK_STREAM, 0);
+        assert(server.listener >= 0);
+        struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = 0 };
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(server.listener, (struct sockaddr *) &address, sizeof(address)) == 0);
+        socklen_t address_length = sizeof(address);
+        assert(getsockname(server.listener, (struct sockaddr *) &address, &address_length) == 0);
+        assert(listen(server.listener, 1) == 0);
+
+        char url[64];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d", ntohs(address.sin_port));
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, serve, &server) == 0);
+
+        telemetry_config_t config = telemetry_config_default("AGENT-0042", url);
+        config.timeout = 2000;
+        start(&config);
+
+        // Rejected, and the uploads keep going to the first server.
+        telemetry_config_t other = telemetry_config_default("AGENT-0043", "http://127.0.0.1:1");
+        assert(telemetry_init(&other) == -1);
+
+        press(GPIO_BUTTON);
+        assert(telemetry_poll(true) == 1);
+        assert(strcmp(server.path, TELEMETRY_BATCH_PATH) == 0);
+        assert(strstr(server.body, "\"serial_number\":\"AGENT-0042\""));
+        assert(strstr(server.body, "\"event\":\"single_press\",\"count\":1"));
+
+        server.status = 500;
+        press(GPIO_BUTTON);
+        assert(telemetry_poll(true) == -2);
+
+        // Nobody listening any more.
+        assert(pthread_join(thread, NULL) == 0);
+        close(server.listener);
+        seconds(config.backoff_min);
+        assert(telemetry_poll(true) == -2);
+        assert(stats().batches_failed == 2 && stats().pending == 1);
+
+        stop();
+}
+
+static void test_errors(void) {
+        telemetry_stats_t result;
+        assert(telemetry_poll(true) == -1);
+        assert(telemetry_get_stats(&result) == -1);
+        assert(telemetry_track(GPIO_BUTTON, BUTTON_EVENT_MASK_ALL) == -4);
+        assert(telemetry_start(5, 4096) == -1);
+
+        assert(telemetry_init(NULL) == -3);
+        telemetry_config_t config = mock_config();
+        config.serial_number = "AGENT 42";
+        assert(telemetry_init(&config) == -3);
+        config = mock_config();
+        config.post = NULL;
+        assert(telemetry_init(&config) == -3);
+        config.server_url = "http://cms.example.com/a-path-that-is-much-too-long-to-be-a-base-url-"
+                            "for-the-batch-endpoint-of-the-device-protocol";
+        assert(telemetry_init(&config) == -3);
+        config = mock_config();
+        config.flush_records = TELEMETRY_MAX_RECORDS + 1;
+        assert(telemetry_init(&config) == -3);
+        config = mock_config();
+        config.backoff_min = config.backoff_max + 1;
+        assert(telemetry_init(&config) == -3);
+        config = mock_config();
+        config.bucket_seconds = 0;
+        assert(telemetry_init(&config) == -3);
+
+        config = mock_config();
+        assert(telemetry_init(&config) == 0);
+        assert(telemetry_init(&config) == -1);
+        assert(telemetry_track(GPIO_BUTTON, BUTTON_EVENT_MASK_ALL) == -1);
+        assert(telemetry_untrack(GPIO_BUTTON) == -1);
+        assert(telemetry_untrack(GPIO_NUM_MAX) == -5);
+        assert(telemetry_start(5, 4096) == 0);
+        telemetry_deinit();
+}
+
+int main(void) {
+        test_errors();
+        test_aggregation();
+        test_size_threshold();
+        test_backoff();
+        test_offline_drops();
+        test_drops_during_upload();
+        test_http_uplink();
+
+        printf("telemetry tests passed\n");
+        return 0;
+}
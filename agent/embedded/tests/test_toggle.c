@@ -3,10 +3,187 @@
 #include <stdio.h>
 
 #include "toggle.h"
+#include "stubs.h"
+
+static int reported_changes;
 
 static void test_callback(bool high, void *context) {
         (void) high;
         (void) context;
+        reported_changes++;
+}
+
+static void test_glitch_filter(void) {
+        const gpio_num_t gpio = 6;
+
+        // Software path: every glitch enters the ISR and restarts the debounce.
+        stub_gpio_set_glitch_filter_support(0);
+        stub_gpio_set_level(gpio, 1);
+        assert(toggle_create(gpio, test_callback, NULL) == 0);
+        assert(stub_gpio_glitch_filter_ns(gpio) == 0);
+
+        uint32_t isr_calls = stub_gpio_isr_calls(gpio);
+        stub_gpio_glitch(gpio, 500);
+        assert(stub_gpio_isr_calls(gpio) == isr_calls + 2);
+        stub_timers_run();
+        toggle_delete(gpio);
+
+        // Hardware path: short glitches never reach the ISR.
+        stub_gpio_set_glitch_filter_support(800);
+        assert(toggle_create(gpio, test_callback, NULL) == 0);
+        assert(stub_gpio_glitch_filter_ns(gpio) == toggle_config_default().glitch_filter_ns);
+
+        isr_calls = stub_gpio_isr_calls(gpio);
+        stub_gpio_glitch(gpio, 500);
+        assert(stub_gpio_isr_calls(gpio) == isr_calls);
+        assert(stub_timers_run() == 0);
+
+        toggle_delete(gpio);
+        assert(stub_gpio_glitch_filter_ns(gpio) == 0);
+
+        // Filter covering the whole window: edges are deferred once, bounces do
+        // not restart the timer.
+        toggle_config_t config = toggle_config_default();
+        config.debounce_ms = 0;
+        assert(toggle_create_with_config(gpio, &config, test_callback, NULL) == 0);
+
+        const uint32_t resets = stub_timer_resets();
+        reported_changes = 0;
+        stub_gpio_edge(gpio, 0);
+        stub_gpio_edge(gpio, 1);
+        stub_gpio_edge(gpio, 0);
+        assert(stub_timer_resets() == resets);
+        stub_timers_run();
+        assert(reported_changes == 1);
+
+        toggle_delete(gpio);
+        stub_gpio_set_glitch_filter_support(0);
+}
+
+static toggle_fault_t last_fault;
+static int fault_reports;
+
+static void test_fault_callback(toggle_fault_t fault, void *context) {
+        (void) context;
+        last_fault = fault;
+        fault_reports++;
+}
+
+static void test_interrupt_masking(void) {
+        const gpio_num_t gpio = 7;
+
+        toggle_config_t config = toggle_config_default();
+        config.mask_during_debounce = true;
+        stub_gpio_set_level(gpio, 1);
+        assert(toggle_create_with_config(gpio, &config, test_callback, NULL) == 0);
+
+        // A bouncing press costs a single interrupt.
+        const uint32_t isr_calls = stub_gpio_isr_calls(gpio);
+        reported_changes = 0;
+        for (int i = 0; i < 5; i++) {
+                stub_gpio_edge(gpio, 0);
+                stub_gpio_edge(gpio, 1);
+        }
+        stub_gpio_edge(gpio, 0);
+        assert(stub_gpio_isr_calls(gpio) == isr_calls + 1);
+        assert(!stub_gpio_intr_enabled(gpio));
+
+        stub_timers_run();
+        assert(stub_gpio_intr_enabled(gpio));
+        assert(reported_changes == 1);
+
+        toggle_delete(gpio);
+}
+
+static void test_storm_quarantine(void) {
+        const gpio_num_t gpio = 8;
+
+        toggle_config_t config = toggle_config_default();
+        config.storm_edge_limit = 4;
+        config.storm_window_ms = 100;
+        config.storm_recheck_ms = 1000;
+        config.fault_callback = test_fault_callback;
+        stub_gpio_set_level(gpio, 1);
+        assert(toggle_create_with_config(gpio, &config, test_callback, NULL) == 0);
+
+        fault_reports = 0;
+        for (int i = 0; i < 3; i++) {
+                stub_gpio_edge(gpio, 0);
+                stub_gpio_edge(gpio, 1);
+        }
+        assert(!stub_gpio_intr_enabled(gpio));
+        assert(fault_reports == 0);
+
+        // Report, then the recheck interval starts.
+        stub_timers_run();
+        assert(fault_reports == 1 && last_fault == toggle_fault_storm);
+        assert(toggle_get_fault(gpio) == toggle_fault_storm);
+        assert(!stub_gpio_intr_enabled(gpio));
+
+        // Recheck: the line is still noisy, so the pin goes straight back.
+        stub_timers_run();
+        assert(stub_gpio_intr_enabled(gpio));
+        for (int i = 0; i < 3; i++) {
+                stub_gpio_edge(gpio, 0);
+                stub_gpio_edge(gpio, 1);
+        }
+        assert(!stub_gpio_intr_enabled(gpio));
+        assert(fault_reports == 1);
+
+        // Next recheck: quiet for a whole window, so the pin is restored.
+        stub_timers_run();
+        stub_tick_advance(100);
+        stub_timers_run();
+        assert(fault_reports == 2 && last_fault == toggle_fault_none);
+        assert(toggle_get_fault(gpio) == toggle_fault_none);
+        assert(stub_gpio_intr_enabled(gpio));
+
+        reported_changes = 0;
+        stub_gpio_edge(gpio, 0);
+        stub_timers_run();
+        assert(reported_changes == 1);
+
+        toggle_delete(gpio);
+}
+
+static void delete_on_recovery(toggle_fault_t fault, void *context) {
+        test_fault_callback(fault, context);
+        if (fault == toggle_fault_none)
+                toggle_delete(*(gpio_num_t *) context);
+}
+
+static void test_delete_on_recovery(void) {
+        // On GPIO 0 the cleared slot still reads the pin under test.
+        gpio_num_t gpio = 0;
+
+        toggle_config_t config = toggle_config_default();
+        config.storm_edge_limit = 2;
+        config.storm_window_ms = 100;
+        config.storm_recheck_ms = 1000;
+        config.fault_callback = delete_on_recovery;
+        stub_gpio_set_level(gpio, 1);
+        assert(toggle_create_with_config(gpio, &config, test_callback, &gpio) == 0);
+
+        fault_reports = 0;
+        stub_gpio_edge(gpio, 0);
+        stub_gpio_edge(gpio, 1);
+        stub_gpio_edge(gpio, 0);
+        stub_gpio_edge(gpio, 1);
+        stub_timers_run();
+        assert(fault_reports == 1 && last_fault == toggle_fault_storm);
+
+        // The recovery deletes the toggle; its level is not reported after that.
+        reported_changes = 0;
+        stub_timers_run();
+        stub_tick_advance(100);
+        stub_timers_run();
+        assert(fault_reports == 2 && last_fault == toggle_fault_none);
+        assert(reported_changes == 0);
+        assert(toggle_get_fault(gpio) == toggle_fault_none);
+
+        assert(toggle_create(gpio, test_callback, NULL) == 0);
+        toggle_delete(gpio);
+        stub_gpio_set_level(gpio, 0);
 }
 
 int main(void) {
@@ -28,6 +205,11 @@ int main(void) {
 
         toggle_delete(gpio);
 
+        test_glitch_filter();
+        test_interrupt_masking();
+        test_storm_quarantine();
+        test_delete_on_recovery();
+
         puts("toggle_create NULL callback test passed");
         return 0;
 }
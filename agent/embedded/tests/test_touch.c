@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "button.h"
+#include "touch.h"
+#include "stubs.h"
+
+#define GPIO_PAD 3
+#define GPIO_OTHER_PAD 7
+
+static int events[button_event_held_since_boot + 1];
+
+static void record_event(button_event_t event, void *context) {
+        (void) context;
+        events[event]++;
+}
+
+static void reset_events(void) {
+        for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+                events[i] = 0;
+}
+
+static void samples(int count) {
+        stub_timers_advance(TOUCH_SAMPLE_INTERVAL_MS * count);
+}
+
+static void create(gpio_num_t gpio) {
+        stub_touch_set_raw(gpio, 1000);
+        button_config_t config = button_config_default(button_active_high);
+        config.repeat_press_timeout = 100;
+        config.long_press_time = 500;
+        assert(button_touch_create(gpio, config, button_touch_config_default(), record_event, NULL) == 0);
+        // The first sample becomes the baseline.
+        samples(1);
+}
+
+static void test_recorded_touch(void) {
+        // Recorded from a pad: noise and a little drift, then a finger.
+        static const uint32_t recording[] = {
+                1000, 1004, 998, 1006, 1003, 1009,
+                1150, 1180, 1190, 1185, 1170,
+                1020, 1008, 1010, 1012,
+        };
+
+        create(GPIO_PAD);
+        reset_events();
+        stub_touch_replay(GPIO_PAD, recording, sizeof(recording) / sizeof(recording[0]));
+
+        samples(8);
+        assert(button_is_pressed(GPIO_PAD));
+        samples(7);
+        assert(!button_is_pressed(GPIO_PAD));
+        samples(10);
+        assert(events[button_event_single_press] == 1);
+        assert(events[button_event_long_press] == 0);
+
+        uint32_t raw = 0;
+        uint32_t baseline = 0;
+        assert(button_touch_get_counts(GPIO_PAD, &raw, &baseline) == 0);
+        assert(raw == 1012);
+        assert(baseline >= 1000 && baseline <= 1012);
+
+        button_destroy(GPIO_PAD);
+        assert(button_touch_get_counts(GPIO_PAD, &raw, &baseline) == -1);
+}
+
+static void test_long_touch(void) {
+        create(GPIO_PAD);
+        reset_events();
+
+        stub_touch_set_raw(GPIO_PAD, 1200);
+        samples(40);
+        stub_touch_set_raw(GPIO_PAD, 1000);
+        samples(20);
+        assert(events[button_event_long_press] == 1);
+        assert(events[button_event_single_press] == 0);
+
+        button_destroy(GPIO_PAD);
+}
+
+static void test_hysteresis(void) {
+        create(GPIO_PAD);
+        reset_events();
+
+        // One sample past the threshold is not confirmed.
+        stub_touch_set_raw(GPIO_PAD, 1200);
+        samples(1);
+        stub_touch_set_raw(GPIO_PAD, 1000);
+        samples(1);
+        assert(!button_is_pressed(GPIO_PAD));
+
+        stub_touch_set_raw(GPIO_PAD, 1120);
+        samples(2);
+        assert(button_is_pressed(GPIO_PAD));
+
+        // Between the release and the touch threshold the pad stays touched,
+        // and the baseline does not move.
+        stub_touch_set_raw(GPIO_PAD, 1070);
+        samples(20);
+        assert(button_is_pressed(GPIO_PAD));
+        uint32_t baseline = 0;
+        assert(button_touch_get_counts(GPIO_PAD, NULL, &baseline) == 0);
+        assert(baseline == 1000);
+
+        stub_touch_set_raw(GPIO_PAD, 1040);
+        samples(2);
+        assert(!button_is_pressed(GPIO_PAD));
+
+        button_destroy(GPIO_PAD);
+}
+
+static void test_drift(void) {
+        create(GPIO_PAD);
+        reset_events();
+
+        // Humidity raising the count by 1 per sample is followed by the
+        // baseline and never reads as a touch.
+        for (uint32_t raw = 1000; raw <= 1400; raw++) {
+                stub_touch_set_raw(GPIO_PAD, raw);
+                samples(1);
+                assert(!button_is_pressed(GPIO_PAD));
+        }
+        uint32_t baseline = 0;
+        assert(button_touch_get_counts(GPIO_PAD, NULL, &baseline) == 0);
+        assert(baseline > 1350);
+
+        // A touch is still seen relative to the drifted baseline.
+        stub_touch_set_raw(GPIO_PAD, 1600);
+        samples(2);
+        assert(button_is_pressed(GPIO_PAD));
+        stub_touch_set_raw(GPIO_PAD, 1400);
+        samples(10);
+        assert(events[button_event_single_press] == 1);
+
+        button_destroy(GPIO_PAD);
+}
+
+static void test_batched_sampling(void) {
+        create(GPIO_PAD);
+        create(GPIO_OTHER_PAD);
+
+        // Both pads are read in one batch per interval.
+        uint32_t reads = stub_touch_reads();
+        samples(10);
+        assert(stub_touch_reads() - reads == 10);
+
+        button_destroy(GPIO_PAD);
+        reads = stub_touch_reads();
+        samples(10);
+        assert(stub_touch_reads() - reads == 10);
+
+        // Without pads the sampling timer stops.
+        button_destroy(GPIO_OTHER_PAD);
+        reads = stub_touch_reads();
+        samples(10);
+        assert(stub_touch_reads() == reads);
+}
+
+static int deleting_touches;
+static int other_touches;
+
+static void delete_both(bool touched, void *context) {
+        (void) touched;
+        (void) context;
+        deleting_touches++;
+        touch_delete(GPIO_PAD);
+        touch_delete(GPIO_OTHER_PAD);
+}
+
+static void count_other(bool touched, void *context) {
+        (void) touched;
+        (void) context;
+        other_touches++;
+}
+
+static void test_delete_from_callback(void) {
+        const touch_config_t config = touch_config_default();
+        stub_touch_set_raw(GPIO_PAD, 1000);
+        stub_touch_set_raw(GPIO_OTHER_PAD, 1000);
+        assert(touch_create(GPIO_PAD, &config, delete_both, NULL) == 0);
+        assert(touch_create(GPIO_OTHER_PAD, &config, count_other, NULL) == 0);
+        samples(1);
+
+        // Both change in the same sweep; the first callback deletes both
+        // pads, so the second one never reports, and sampling stops.
+        stub_touch_set_raw(GPIO_PAD, 1500);
+        stub_touch_set_raw(GPIO_OTHER_PAD, 1500);
+        samples(config.confirm_samples);
+        assert(deleting_touches == 1);
+        assert(other_touches == 0);
+
+        const uint32_t reads = stub_touch_reads();
+        samples(10);
+        assert(stub_touch_reads() == reads);
+}
+
+int main(void) {
+        button_config_t config = button_config_default(button_active_high);
+        button_touch_config_t touch = button_touch_config_default();
+        assert(button_touch_create(0, config, touch, record_event, NULL) == -5);
+        assert(button_touch_create(20, config, touch, record_event, NULL) == -5);
+        assert(button_touch_create(GPIO_PAD, config, touch, NULL, NULL) == -6);
+
+        touch.release_threshold_permille = touch.touch_threshold_permille;
+        assert(button_touch_create(GPIO_PAD, config, touch, record_event, NULL) == -4);
+        assert(button_touch_get_counts(GPIO_PAD, NULL, NULL) == -1);
+
+        test_recorded_touch();
+        test_long_touch();
+        test_hysteresis();
+        test_drift();
+        test_batched_sampling();
+        test_delete_from_callback();
+
+        printf("touch tests passed\n");
+        return 0;
+}
@@ -1,71 +1,488 @@
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <stdatomic.h>
 #include <stdio.h>
 
 #include <esp_attr.h>
 #include <esp_err.h>
 #include <esp_intr_alloc.h>
 #include <esp_log.h>
+#include <sdkconfig.h>
 
 #include "toggle.h"
 #include "port.h"
 
 
+typedef enum {
+        toggle_timer_mode_debounce = 0,
+        // The pin interrupt is masked; the timer either reports the fault
+        // (fault_reported false) or marks the end of the recheck interval.
+        toggle_timer_mode_quarantine,
+        // The pin interrupt is enabled again and edges are only counted until
+        // a full storm window passed without a storm, or a full unstable
+        // window without an edge.
+        toggle_timer_mode_probe,
+} toggle_timer_mode_t;
+
+typedef enum {
+        toggle_isr_action_none = 0,
+        toggle_isr_action_start,
+        toggle_isr_action_reset,
+        toggle_isr_action_quarantine,
+} toggle_isr_action_t;
+
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+// The ISR keeps working while the flash cache is disabled: it is installed
+// with ESP_INTR_FLAG_IRAM, only touches IRAM code and DRAM state, and captures
+// edges into a ring the timer task replays once it runs again.
+#define TOGGLE_INTR_FLAGS (ESP_INTR_FLAG_LOWMED | ESP_INTR_FLAG_IRAM)
+#define TOGGLE_STATE_ATTR DRAM_ATTR
+#define TOGGLE_EDGE_RING_SIZE CONFIG_BUTTON_EDGE_RING_SIZE
+
+typedef struct {
+        uint32_t time_us;
+        bool high;
+        bool during_flash;
+} toggle_edge_t;
+#else
+#define TOGGLE_INTR_FLAGS ESP_INTR_FLAG_LOWMED
+#define TOGGLE_STATE_ATTR
+#endif
+
+#ifdef CONFIG_BUTTON_DIRECT_GPIO_ISR
+// Handler of every pin routed through toggle_gpio_dispatch. handler is
+// published last, so the ISR never sees it with the argument of a previous
+// owner; a stale argument is a pool slot that checks its own state.
+typedef struct {
+        void *arg;
+        _Atomic(gpio_isr_t) handler;
+} toggle_isr_entry_t;
+
+static TOGGLE_STATE_ATTR toggle_isr_entry_t toggle_isr_table[GPIO_NUM_MAX];
+#endif
+
+// Locking protocol:
+// - toggles_lock only guards claiming and releasing a slot. Lookups read
+//   toggle_map with acquire semantics and never take it.
+// - lock guards the fields from active on, which the ISR shares with the
+//   timer task and API calls. No FreeRTOS call is made while holding it;
+//   decisions are taken under the lock and the timer is driven afterwards.
+// - busy counts timer task callbacks in flight, so toggle_delete can wait for
+//   them before it clears the slot.
 typedef struct _toggle {
+        // Initialised once and never cleared: an ISR may still hold it while
+        // the slot is cleared or reused.
+        portMUX_TYPE lock;
+
         gpio_num_t gpio_num;
         toggle_callback_fn callback;
+        toggle_fault_fn fault_callback;
+        toggle_edge_fn edge_callback;
         void* context;
 
+        // False when the hardware glitch filter covers the debounce window and
+        // the first edge only has to be deferred to the timer task.
+        bool restart_on_edge;
+        bool mask_during_debounce;
+        TimerHandle_t debounce_timer;
+        TickType_t debounce_ticks;
+        uint16_t storm_edge_limit;
+        TickType_t storm_window_ticks;
+        TickType_t storm_recheck_ticks;
+        TickType_t unstable_ticks;
+
+        bool active;
+        uint16_t busy;
         bool last_high;
         bool debounce_timer_armed;
-        TimerHandle_t debounce_timer;
+        toggle_timer_mode_t timer_mode;
+        toggle_fault_t fault;
+        bool fault_reported;
+        // What the current quarantine is for, and the level a stuck pin is
+        // stuck at.
+        toggle_fault_t quarantine_fault;
+        bool stuck_high;
+        uint16_t storm_edges;
+        TickType_t storm_window_start;
+        TickType_t debounce_start;
+
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+        // How long a captured level has to hold to count when replayed.
+        uint32_t debounce_us;
+        toggle_edge_t edges[TOGGLE_EDGE_RING_SIZE];
+        uint8_t edge_head;
+        uint8_t edge_count;
+        toggle_capture_stats_t capture_stats;
+#endif
 } toggle_t;
 
 
+// Software debounce window used when no hardware glitch filter is active and
+// the configuration does not specify one.
 #define TOGGLE_DEBOUNCE_MS 10
 
 
-static SemaphoreHandle_t toggles_lock = NULL;
-static toggle_t toggle_pool[GPIO_NUM_MAX];
+static SemaphoreHandle_t _Atomic toggles_lock;
+static TOGGLE_STATE_ATTR toggle_t toggle_pool[GPIO_NUM_MAX] = {
+        [0 ... GPIO_NUM_MAX - 1] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+};
 static StaticTimer_t toggle_timer_buffers[GPIO_NUM_MAX];
-static toggle_t *toggle_map[GPIO_NUM_MAX];
+static TOGGLE_STATE_ATTR toggle_t *_Atomic toggle_map[GPIO_NUM_MAX];
 static bool toggle_claimed[GPIO_NUM_MAX];
-static bool toggles_initialized = false;
+// Bumped each time a slot is activated, so a timer callback can tell whether
+// its toggle survived a user callback. Guarded by the slot lock.
+static uint32_t toggle_generations[GPIO_NUM_MAX];
+static atomic_bool toggles_initialized;
 static const char *TAG = "toggle";
 
 
+// Marks a timer task callback as in flight. Returns false once the toggle is
+// being deleted.
+static bool toggle_enter(toggle_t *toggle) {
+        portENTER_CRITICAL(&toggle->lock);
+        const bool active = toggle->active;
+        if (active)
+                toggle->busy++;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        return active;
+}
+
+
+static void toggle_leave(toggle_t *toggle) {
+        portENTER_CRITICAL(&toggle->lock);
+        // Zero when the callback deleted its own toggle.
+        if (toggle->busy)
+                toggle->busy--;
+        portEXIT_CRITICAL(&toggle->lock);
+}
+
+
+// False once the toggle was deleted, and maybe created again, by a callback.
+static bool toggle_alive(toggle_t *toggle, uint32_t generation) {
+        portENTER_CRITICAL(&toggle->lock);
+        const bool alive = toggle->active && toggle_generations[toggle - toggle_pool] == generation;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        return alive;
+}
+
+
+// Returns false when the callback deleted the toggle.
+static bool toggle_commit_level(toggle_t *toggle, bool high) {
+        portENTER_CRITICAL(&toggle->lock);
+        const bool changed = high != toggle->last_high;
+        const uint32_t generation = toggle_generations[toggle - toggle_pool];
+        toggle->last_high = high;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        if (!changed)
+                return true;
+
+        toggle->callback(high, toggle->context);
+        return toggle_alive(toggle, generation);
+}
+
+
+static bool toggle_report_level(toggle_t *toggle) {
+        return toggle_commit_level(toggle, my_gpio_read(toggle->gpio_num) == 1);
+}
+
+
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+static bool toggle_edge_pop(toggle_t *toggle, toggle_edge_t *edge) {
+        portENTER_CRITICAL(&toggle->lock);
+        const bool available = toggle->edge_count > 0;
+        if (available) {
+                *edge = toggle->edges[toggle->edge_head];
+                toggle->edge_head = (uint8_t) ((toggle->edge_head + 1) % TOGGLE_EDGE_RING_SIZE);
+                toggle->edge_count--;
+        }
+        portEXIT_CRITICAL(&toggle->lock);
+
+        return available;
+}
+
+
+// Commits every captured level that held for the debounce window, so presses
+// that started and ended while the timer task was stalled are not lost.
+// Returns false when a callback deleted the toggle.
+static bool toggle_replay_edges(toggle_t *toggle) {
+        toggle_edge_t edge;
+        if (!toggle_edge_pop(toggle, &edge))
+                return true;
+
+        for (;;) {
+                toggle_edge_t next;
+                const bool more = toggle_edge_pop(toggle, &next);
+                const uint32_t now_us = my_time_us_from_isr();
+                const uint32_t latency_us = now_us - edge.time_us;
+
+                portENTER_CRITICAL(&toggle->lock);
+                toggle_capture_stats_t *stats = &toggle->capture_stats;
+                if (latency_us > stats->max_latency_us)
+                        stats->max_latency_us = latency_us;
+                if (edge.during_flash && latency_us > stats->max_flash_latency_us)
+                        stats->max_flash_latency_us = latency_us;
+                portEXIT_CRITICAL(&toggle->lock);
+
+                const uint32_t stable_us = (more ? next.time_us : now_us) - edge.time_us;
+                if (stable_us >= toggle->debounce_us && !toggle_commit_level(toggle, edge.high))
+                        return false;
+
+                if (!more)
+                        return true;
+                edge = next;
+        }
+}
+
+
+// Called with the toggle lock held.
+static void IRAM_ATTR toggle_capture_edge(toggle_t *toggle, uint32_t time_us, bool high, bool during_flash) {
+        toggle_capture_stats_t *stats = &toggle->capture_stats;
+        stats->captured++;
+        if (during_flash)
+                stats->captured_during_flash++;
+
+        if (toggle->edge_count == TOGGLE_EDGE_RING_SIZE) {
+                stats->overflows++;
+                return;
+        }
+
+        toggle->edges[(toggle->edge_head + toggle->edge_count) % TOGGLE_EDGE_RING_SIZE] = (toggle_edge_t) {
+                .time_us = time_us,
+                .high = high,
+                .during_flash = during_flash,
+        };
+        toggle->edge_count++;
+}
+#endif
+
+
+// Returns false when the callback deleted the toggle.
+static bool toggle_report_fault(toggle_t *toggle, toggle_fault_t fault) {
+        portENTER_CRITICAL(&toggle->lock);
+        toggle->fault = fault;
+        const uint32_t generation = toggle_generations[toggle - toggle_pool];
+        portEXIT_CRITICAL(&toggle->lock);
+
+        if (!toggle->fault_callback)
+                return true;
+
+        toggle->fault_callback(fault, toggle->context);
+        return toggle_alive(toggle, generation);
+}
+
+
+static const char *toggle_fault_name(toggle_fault_t fault) {
+        switch (fault) {
+        case toggle_fault_storm: return "interrupt storm";
+        case toggle_fault_stuck: return "stuck level";
+        case toggle_fault_unstable: return "unstable level";
+        default: return "no fault";
+        }
+}
+
+
+// Back to debouncing after a quarantine.
+static void toggle_recover(toggle_t *toggle) {
+        xTimerChangePeriod(toggle->debounce_timer, toggle->debounce_ticks, 0);
+        xTimerStop(toggle->debounce_timer, 0);
+
+        portENTER_CRITICAL(&toggle->lock);
+        const toggle_fault_t fault = toggle->quarantine_fault;
+        toggle->timer_mode = toggle_timer_mode_debounce;
+        toggle->fault_reported = false;
+        toggle->quarantine_fault = toggle_fault_none;
+        toggle->debounce_timer_armed = false;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        ESP_LOGI(TAG, "GPIO %d recovered from %s", (int) toggle->gpio_num, toggle_fault_name(fault));
+        if (toggle_report_fault(toggle, toggle_fault_none))
+                toggle_report_level(toggle);
+}
+
+
+static void toggle_quarantine_timer_expired(toggle_t *toggle) {
+        const TickType_t now = xTaskGetTickCount();
+
+        portENTER_CRITICAL(&toggle->lock);
+        const bool report = !toggle->fault_reported;
+        const toggle_fault_t fault = toggle->quarantine_fault;
+        const bool stuck_high = toggle->stuck_high;
+        toggle->fault_reported = true;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        if (report) {
+                ESP_LOGE(TAG, "Quarantining GPIO %d: %s", (int) toggle->gpio_num, toggle_fault_name(fault));
+                xTimerChangePeriod(toggle->debounce_timer, toggle->storm_recheck_ticks, 0);
+                toggle_report_fault(toggle, fault);
+                return;
+        }
+
+        // A stuck pin stays masked; one read per recheck tells whether it let go.
+        if (fault == toggle_fault_stuck) {
+                if ((my_gpio_read(toggle->gpio_num) == 1) == stuck_high) {
+                        xTimerChangePeriod(toggle->debounce_timer, toggle->storm_recheck_ticks, 0);
+                } else {
+                        // Enable before sampling so an edge in between is not lost.
+                        gpio_intr_enable(toggle->gpio_num);
+                        toggle_recover(toggle);
+                }
+                return;
+        }
+
+        // Recheck: let edges in again, but only watch them for one window.
+        portENTER_CRITICAL(&toggle->lock);
+        toggle->timer_mode = toggle_timer_mode_probe;
+        toggle->storm_edges = 0;
+        toggle->storm_window_start = now;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        const TickType_t window = fault == toggle_fault_unstable ? toggle->unstable_ticks : toggle->storm_window_ticks;
+        xTimerChangePeriod(toggle->debounce_timer, window, 0);
+        gpio_intr_enable(toggle->gpio_num);
+}
+
+
+static void toggle_probe_timer_expired(toggle_t *toggle) {
+        // A full window passed without a storm or, for an unstable pin, without
+        // any edge.
+        toggle_recover(toggle);
+}
+
+
 static void toggle_debounce_timer_callback(TimerHandle_t timer) {
         toggle_t *toggle = (toggle_t*) pvTimerGetTimerID(timer);
-        if (!toggle)
+        if (!toggle || !toggle_enter(toggle))
                 return;
 
-        toggle->debounce_timer_armed = false;
+        portENTER_CRITICAL(&toggle->lock);
+        const toggle_timer_mode_t mode = toggle->timer_mode;
+        if (mode == toggle_timer_mode_debounce)
+                toggle->debounce_timer_armed = false;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        switch (mode) {
+        case toggle_timer_mode_quarantine:
+                toggle_quarantine_timer_expired(toggle);
+                break;
+        case toggle_timer_mode_probe:
+                toggle_probe_timer_expired(toggle);
+                break;
+        default:
+                // Enable before sampling so an edge in between raises a new
+                // interrupt instead of getting lost.
+                if (toggle->mask_during_debounce)
+                        gpio_intr_enable(toggle->gpio_num);
+
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+                if (!toggle_replay_edges(toggle))
+                        break;
+#endif
+                toggle_report_level(toggle);
+                break;
+        }
+
+        toggle_leave(toggle);
+}
+
 
-        bool high = my_gpio_read(toggle->gpio_num) == 1;
-        if (high != toggle->last_high) {
-                toggle->last_high = high;
-                toggle->callback(high, toggle->context);
+// Counts the interrupt against the storm window. Returns true when the pin
+// exceeded its edge budget. Called with the toggle lock held.
+static bool IRAM_ATTR toggle_storm_edge(toggle_t *toggle, TickType_t now) {
+        if (!toggle->storm_edge_limit)
+                return false;
+
+        if (now - toggle->storm_window_start >= toggle->storm_window_ticks) {
+                toggle->storm_window_start = now;
+                toggle->storm_edges = 0;
         }
+
+        return ++toggle->storm_edges > toggle->storm_edge_limit;
 }
 
 
 static void IRAM_ATTR toggle_gpio_isr_handler(void *arg) {
         toggle_t *toggle = (toggle_t*) arg;
-        if (!toggle || !toggle->debounce_timer)
+        if (!toggle)
                 return;
 
-        BaseType_t higher_task_woken = pdFALSE;
-        BaseType_t result;
-
-        if (!toggle->debounce_timer_armed) {
+        toggle_isr_action_t action = toggle_isr_action_none;
+        TickType_t quarantine_ticks = 1;
+        TimerHandle_t timer = NULL;
+        const TickType_t now = xTaskGetTickCountFromISR();
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+        const uint32_t now_us = my_time_us_from_isr();
+        const bool high = my_gpio_read_from_isr(toggle->gpio_num) == 1;
+        const bool during_flash = !my_flash_cache_enabled_from_isr();
+#endif
+
+        portENTER_CRITICAL_ISR(&toggle->lock);
+        timer = toggle->debounce_timer;
+        if (!toggle->active || toggle->timer_mode == toggle_timer_mode_quarantine) {
+                // Nothing to do.
+        } else if (toggle_storm_edge(toggle, now)
+                   || (toggle->timer_mode == toggle_timer_mode_probe
+                       && toggle->quarantine_fault == toggle_fault_unstable)) {
+                if (toggle->timer_mode != toggle_timer_mode_probe)
+                        toggle->quarantine_fault = toggle_fault_storm;
+                toggle->timer_mode = toggle_timer_mode_quarantine;
                 toggle->debounce_timer_armed = true;
-                result = xTimerStartFromISR(toggle->debounce_timer, &higher_task_woken);
+                // Report right away the first time; a failed probe just waits
+                // for the next recheck.
+                if (toggle->fault_reported)
+                        quarantine_ticks = toggle->storm_recheck_ticks;
+                action = toggle_isr_action_quarantine;
+        } else if (toggle->timer_mode == toggle_timer_mode_probe) {
+                // Only counting edges.
+        } else {
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+                toggle_capture_edge(toggle, now_us, high, during_flash);
+#endif
+                if (!toggle->debounce_timer_armed) {
+                        toggle->debounce_timer_armed = true;
+                        toggle->debounce_start = now;
+                        action = toggle_isr_action_start;
+                } else if (toggle->unstable_ticks && now - toggle->debounce_start >= toggle->unstable_ticks) {
+                        toggle->timer_mode = toggle_timer_mode_quarantine;
+                        toggle->quarantine_fault = toggle_fault_unstable;
+                        action = toggle_isr_action_quarantine;
+                } else if (toggle->restart_on_edge) {
+                        action = toggle_isr_action_reset;
+                }
+        }
+        portEXIT_CRITICAL_ISR(&toggle->lock);
+
+        // A new debounce window opens on the leading edge of a change.
+        if (action == toggle_isr_action_start && toggle->edge_callback)
+                toggle->edge_callback(toggle->context);
+
+        BaseType_t higher_task_woken = pdFALSE;
+        BaseType_t result = pdFAIL;
+
+        switch (action) {
+        case toggle_isr_action_quarantine:
+                my_gpio_intr_disable_from_isr(toggle->gpio_num);
+                result = xTimerChangePeriodFromISR(timer, quarantine_ticks, &higher_task_woken);
+                break;
+        case toggle_isr_action_start:
+                if (toggle->mask_during_debounce)
+                        my_gpio_intr_disable_from_isr(toggle->gpio_num);
+                result = xTimerStartFromISR(timer, &higher_task_woken);
                 if (result != pdPASS) {
+                        portENTER_CRITICAL_ISR(&toggle->lock);
                         toggle->debounce_timer_armed = false;
+                        portEXIT_CRITICAL_ISR(&toggle->lock);
                 }
-        } else {
-                result = xTimerResetFromISR(toggle->debounce_timer, &higher_task_woken);
+                break;
+        case toggle_isr_action_reset:
+                result = xTimerResetFromISR(timer, &higher_task_woken);
+                break;
+        default:
+                return;
         }
 
         if (result == pdPASS && higher_task_woken == pdTRUE) {
@@ -74,38 +491,201 @@ static void IRAM_ATTR toggle_gpio_isr_handler(void *arg) {
 }
 
 
+// Length of the software debounce window once the hardware filter removed
+// glitches up to filtered_ns.
+static TickType_t toggle_debounce_ticks(const toggle_config_t *config, uint32_t filtered_ns, bool *restart_on_edge) {
+        uint32_t debounce_ms = config->debounce_ms;
+        if (!debounce_ms && !filtered_ns)
+                debounce_ms = TOGGLE_DEBOUNCE_MS;
+
+        const uint64_t debounce_ns = (uint64_t) debounce_ms * 1000000u;
+        if (filtered_ns >= debounce_ns) {
+                *restart_on_edge = false;
+                return 1;
+        }
+
+        *restart_on_edge = true;
+
+        const uint32_t remaining_ms = (uint32_t) ((debounce_ns - filtered_ns + 999999u) / 1000000u);
+        TickType_t ticks = pdMS_TO_TICKS(remaining_ms);
+        return ticks ? ticks : 1;
+}
+
+
+static TickType_t toggle_ms_to_ticks(uint16_t duration_ms) {
+        TickType_t ticks = pdMS_TO_TICKS(duration_ms);
+        return ticks ? ticks : 1;
+}
+
+
+#ifdef CONFIG_BUTTON_DIRECT_GPIO_ISR
+// The only GPIO interrupt handler: acknowledges everything pending at once and
+// walks the set bits, so simultaneous edges share one interrupt entry.
+static void IRAM_ATTR toggle_gpio_dispatch(void *arg) {
+        (void) arg;
+
+        uint32_t status[MY_GPIO_STATUS_WORDS];
+        my_gpio_intr_status_take_from_isr(status);
+
+        for (size_t word = 0; word < MY_GPIO_STATUS_WORDS; word++) {
+                uint32_t pending = status[word];
+                while (pending) {
+                        const size_t gpio = word * 32 + (size_t) __builtin_ctz(pending);
+                        pending &= pending - 1;
+                        if (gpio >= GPIO_NUM_MAX)
+                                break;
+
+                        toggle_isr_entry_t *entry = &toggle_isr_table[gpio];
+                        gpio_isr_t handler = atomic_load_explicit(&entry->handler, memory_order_acquire);
+                        if (handler)
+                                handler(entry->arg);
+                }
+        }
+}
+
+
+static esp_err_t toggle_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *arg) {
+        toggle_isr_entry_t *entry = &toggle_isr_table[gpio_num];
+        entry->arg = arg;
+        atomic_store_explicit(&entry->handler, handler, memory_order_release);
+        return ESP_OK;
+}
+
+
+static esp_err_t toggle_isr_handler_remove(gpio_num_t gpio_num) {
+        atomic_store_explicit(&toggle_isr_table[gpio_num].handler, NULL, memory_order_release);
+        return ESP_OK;
+}
+#else
+#define toggle_isr_handler_add gpio_isr_handler_add
+#define toggle_isr_handler_remove gpio_isr_handler_remove
+#endif
+
+
+// Routes the interrupt of an input pin to handler, cleaning up after itself on
+// failure.
+static esp_err_t toggle_isr_install(gpio_num_t gpio_num, gpio_isr_t handler, void *arg) {
+        esp_err_t err = gpio_set_intr_type(gpio_num, GPIO_INTR_ANYEDGE);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to set interrupt type for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+                return err;
+        }
+
+        err = toggle_isr_handler_add(gpio_num, handler, arg);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to add ISR handler for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+                gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
+                return err;
+        }
+
+        err = gpio_intr_enable(gpio_num);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to enable interrupts for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+                toggle_isr_handler_remove(gpio_num);
+                gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
+                return err;
+        }
+
+        return ESP_OK;
+}
+
+
+static void toggle_isr_remove(gpio_num_t gpio_num) {
+        esp_err_t err = gpio_intr_disable(gpio_num);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to disable interrupts for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+        }
+
+        err = toggle_isr_handler_remove(gpio_num);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "Failed to remove ISR handler for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+        }
+        gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
+}
+
+
 static toggle_t *toggle_find_by_gpio(const gpio_num_t gpio_num) {
         if (!GPIO_IS_VALID_GPIO(gpio_num))
                 return NULL;
 
-        return toggle_map[(size_t) gpio_num];
+        return atomic_load_explicit(&toggle_map[(size_t) gpio_num], memory_order_acquire);
 }
 
 
-static int toggles_init() {
-        if (toggles_initialized)
-                return 0;
+static void toggle_slot_clear(toggle_t *toggle) {
+        portENTER_CRITICAL(&toggle->lock);
+        memset((char *) toggle + offsetof(toggle_t, gpio_num), 0,
+               sizeof(*toggle) - offsetof(toggle_t, gpio_num));
+        portEXIT_CRITICAL(&toggle->lock);
+}
 
-        toggles_lock = xSemaphoreCreateMutex();
-        if (!toggles_lock) {
-                ESP_LOGE(TAG, "Failed to create toggle lock");
+
+static int toggles_install_isr() {
+#ifdef CONFIG_BUTTON_DIRECT_GPIO_ISR
+        esp_err_t err = my_gpio_isr_register(toggle_gpio_dispatch, NULL, TOGGLE_INTR_FLAGS);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to allocate GPIO interrupt: %s", esp_err_to_name(err));
                 return -1;
         }
-
-        esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_LOWMED);
+#else
+        esp_err_t err = gpio_install_isr_service(TOGGLE_INTR_FLAGS);
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+        if (err == ESP_ERR_INVALID_STATE) {
+                ESP_LOGW(TAG, "GPIO ISR service was installed elsewhere; edges may be delayed while flash is written");
+        }
+#endif
         if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
                 ESP_LOGE(TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(err));
-                vSemaphoreDelete(toggles_lock);
-                toggles_lock = NULL;
                 return -1;
         }
+#endif
 
-        toggles_initialized = true;
         return 0;
 }
 
 
+// Safe to race: concurrent first callers publish one mutex and install the
+// interrupt under it once.
+static int toggles_init() {
+        if (atomic_load_explicit(&toggles_initialized, memory_order_acquire))
+                return 0;
+
+        if (!atomic_load_explicit(&toggles_lock, memory_order_acquire)) {
+                SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+                if (!lock) {
+                        ESP_LOGE(TAG, "Failed to create toggle lock");
+                        return -1;
+                }
+
+                SemaphoreHandle_t expected = NULL;
+                if (!atomic_compare_exchange_strong_explicit(&toggles_lock, &expected, lock,
+                                                             memory_order_acq_rel, memory_order_acquire))
+                        vSemaphoreDelete(lock);
+        }
+
+        xSemaphoreTake(toggles_lock, portMAX_DELAY);
+        int result = 0;
+        if (!atomic_load_explicit(&toggles_initialized, memory_order_relaxed)) {
+                result = toggles_install_isr();
+                if (result == 0)
+                        atomic_store_explicit(&toggles_initialized, true, memory_order_release);
+        }
+        xSemaphoreGive(toggles_lock);
+
+        return result;
+}
+
+
 int toggle_create(const gpio_num_t gpio_num, toggle_callback_fn callback, void* context) {
+        const toggle_config_t config = toggle_config_default();
+        return toggle_create_with_config(gpio_num, &config, callback, context);
+}
+
+
+int toggle_create_with_config(const gpio_num_t gpio_num,
+                              const toggle_config_t *config,
+                              toggle_callback_fn callback,
+                              void* context) {
         if (!toggles_initialized) {
                 if (toggles_init() != 0)
                         return -3;
@@ -133,14 +713,36 @@ int toggle_create(const gpio_num_t gpio_num, toggle_callback_fn callback, void*
         toggle_claimed[index] = true;
         xSemaphoreGive(toggles_lock);
 
-        memset(toggle, 0, sizeof(*toggle));
+        const toggle_config_t defaults = toggle_config_default();
+        if (!config)
+                config = &defaults;
+
+        // The slot is claimed and unpublished, so nothing else touches it until
+        // it is activated below.
+        toggle_slot_clear(toggle);
         toggle->gpio_num = gpio_num;
         toggle->callback = callback;
+        toggle->fault_callback = config->fault_callback;
+        toggle->edge_callback = config->edge_callback;
         toggle->context = context;
+        toggle->mask_during_debounce = config->mask_during_debounce;
+        toggle->storm_edge_limit = config->storm_edge_limit;
+        toggle->storm_window_ticks = toggle_ms_to_ticks(config->storm_window_ms);
+        toggle->storm_recheck_ticks = toggle_ms_to_ticks(config->storm_recheck_ms);
+        toggle->unstable_ticks = config->unstable_window_ms ? toggle_ms_to_ticks(config->unstable_window_ms) : 0;
+
+        const uint32_t filtered_ns = my_gpio_glitch_filter_enable(gpio_num, config->glitch_filter_ns);
+        toggle->debounce_ticks = toggle_debounce_ticks(config, filtered_ns, &toggle->restart_on_edge);
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+        // With the hardware filter covering the window every captured edge is real.
+        toggle->debounce_us = toggle->restart_on_edge
+                ? toggle->debounce_ticks * (1000000u / configTICK_RATE_HZ)
+                : 0;
+#endif
 
         toggle->debounce_timer = xTimerCreateStatic(
                 "Toggle debounce",
-                pdMS_TO_TICKS(TOGGLE_DEBOUNCE_MS),
+                toggle->debounce_ticks,
                 pdFALSE,
                 toggle,
                 toggle_debounce_timer_callback,
@@ -151,70 +753,41 @@ int toggle_create(const gpio_num_t gpio_num, toggle_callback_fn callback, void*
                 goto fail_no_timer;
         }
 
-        bool intr_type_set = false;
-        bool isr_registered = false;
-        bool intr_enabled = false;
-
         my_gpio_enable(toggle->gpio_num);
         toggle->last_high = my_gpio_read(toggle->gpio_num) == 1;
 
-        esp_err_t err = gpio_set_intr_type(toggle->gpio_num, GPIO_INTR_ANYEDGE);
-        if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to set interrupt type for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
-                goto fail;
-        }
-        intr_type_set = true;
-
-        err = gpio_isr_handler_add(toggle->gpio_num, toggle_gpio_isr_handler, toggle);
-        if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to add ISR handler for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
-                goto fail;
-        }
-        isr_registered = true;
+        portENTER_CRITICAL(&toggle->lock);
+        toggle_generations[index]++;
+        toggle->active = true;
+        portEXIT_CRITICAL(&toggle->lock);
 
-        err = gpio_intr_enable(toggle->gpio_num);
-        if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to enable interrupts for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+        if (toggle_isr_install(toggle->gpio_num, toggle_gpio_isr_handler, toggle) != ESP_OK)
                 goto fail;
-        }
-        intr_enabled = true;
 
-        xSemaphoreTake(toggles_lock, portMAX_DELAY);
-        toggle_map[index] = toggle;
-        toggle_claimed[index] = true;
-        xSemaphoreGive(toggles_lock);
+        atomic_store_explicit(&toggle_map[index], toggle, memory_order_release);
 
         return 0;
 
 fail:
-        if (intr_enabled) {
-                gpio_intr_disable(toggle->gpio_num);
-        }
-        if (isr_registered) {
-                esp_err_t remove_err = gpio_isr_handler_remove(toggle->gpio_num);
-                if (remove_err != ESP_OK && remove_err != ESP_ERR_INVALID_STATE) {
-                        ESP_LOGE(TAG, "Failed to remove ISR handler for GPIO %d: %s", (int) gpio_num, esp_err_to_name(remove_err));
-                }
-        }
-        if (intr_type_set) {
-                gpio_set_intr_type(toggle->gpio_num, GPIO_INTR_DISABLE);
-        }
+        portENTER_CRITICAL(&toggle->lock);
+        toggle->active = false;
+        portEXIT_CRITICAL(&toggle->lock);
 
         if (toggle->debounce_timer) {
-                toggle->debounce_timer_armed = false;
                 xTimerStop(toggle->debounce_timer, 0);
                 xTimerDelete(toggle->debounce_timer, 0);
                 toggle->debounce_timer = NULL;
         }
 
 fail_no_timer:
+        my_gpio_glitch_filter_disable(gpio_num);
+
+        toggle_slot_clear(toggle);
+
         xSemaphoreTake(toggles_lock, portMAX_DELAY);
-        toggle_map[index] = NULL;
         toggle_claimed[index] = false;
         xSemaphoreGive(toggles_lock);
 
-        memset(toggle, 0, sizeof(*toggle));
-
         return -4;
 }
 
@@ -228,63 +801,228 @@ void toggle_delete(const gpio_num_t gpio_num) {
                 return;
         }
 
-        toggle_t *toggle = NULL;
         const size_t index = (size_t) gpio_num;
 
+        // Unpublish under the registry lock so concurrent deletes of the same
+        // GPIO tear it down only once; the slot stays claimed until it is clear.
         xSemaphoreTake(toggles_lock, portMAX_DELAY);
+        toggle_t *toggle = atomic_load_explicit(&toggle_map[index], memory_order_relaxed);
+        if (toggle) {
+                atomic_store_explicit(&toggle_map[index], NULL, memory_order_release);
+        }
+        xSemaphoreGive(toggles_lock);
 
-        toggle = toggle_map[index];
         if (!toggle) {
                 // No active toggle to delete; leave the claimed state untouched in case
                 // a concurrent creation is still in progress for this GPIO.
-                xSemaphoreGive(toggles_lock);
                 return;
         }
 
-        toggle_map[index] = NULL;
+        portENTER_CRITICAL(&toggle->lock);
+        toggle->active = false;
+        portEXIT_CRITICAL(&toggle->lock);
 
-        esp_err_t err = gpio_intr_disable(gpio_num);
-        if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to disable interrupts for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+        toggle_isr_remove(gpio_num);
+        my_gpio_glitch_filter_disable(gpio_num);
+
+        // The timer task cannot wait for room in its own command queue.
+        const bool timer_task = xTaskGetCurrentTaskHandle() == xTimerGetTimerDaemonTaskHandle();
+        if (toggle->debounce_timer) {
+                const TickType_t block = timer_task ? 0 : portMAX_DELAY;
+                if (xTimerStop(toggle->debounce_timer, block) != pdPASS
+                    || xTimerDelete(toggle->debounce_timer, block) != pdPASS)
+                        ESP_LOGE(TAG, "Failed to delete debounce timer of GPIO %d", (int) gpio_num);
         }
 
-        err = gpio_isr_handler_remove(gpio_num);
-        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
-                ESP_LOGE(TAG, "Failed to remove ISR handler for GPIO %d: %s", (int) gpio_num, esp_err_to_name(err));
+        // A callback of this toggle may still be running in the timer task.
+        // When we are that callback, it does not touch the toggle after
+        // returning to us.
+        if (!timer_task) {
+                for (;;) {
+                        portENTER_CRITICAL(&toggle->lock);
+                        const uint16_t busy = toggle->busy;
+                        portEXIT_CRITICAL(&toggle->lock);
+
+                        if (!busy)
+                                break;
+                        vTaskDelay(1);
+                }
         }
-        gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
 
-        if (toggle->debounce_timer) {
+        toggle_slot_clear(toggle);
+
+        xSemaphoreTake(toggles_lock, portMAX_DELAY);
+        toggle_claimed[index] = false;
+        xSemaphoreGive(toggles_lock);
+}
+
+
+void toggle_sync_state(const gpio_num_t gpio_num) {
+        if (!toggles_initialized)
+                return;
+
+        toggle_t *toggle = toggle_find_by_gpio(gpio_num);
+        if (!toggle)
+                return;
+
+        portENTER_CRITICAL(&toggle->lock);
+        const bool debouncing = toggle->timer_mode == toggle_timer_mode_debounce;
+        const bool was_armed = debouncing && toggle->debounce_timer_armed;
+        if (debouncing)
                 toggle->debounce_timer_armed = false;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        if (!debouncing)
+                return;
+
+        if (was_armed) {
                 xTimerStop(toggle->debounce_timer, 0);
-                xTimerDelete(toggle->debounce_timer, 0);
-                toggle->debounce_timer = NULL;
+                if (toggle->mask_during_debounce)
+                        gpio_intr_enable(toggle->gpio_num);
         }
 
-        toggle_claimed[index] = false;
+        const bool high = my_gpio_read(toggle->gpio_num) == 1;
+
+        portENTER_CRITICAL(&toggle->lock);
+        toggle->last_high = high;
+        portEXIT_CRITICAL(&toggle->lock);
+}
 
-        memset(toggle, 0, sizeof(*toggle));
 
+int toggle_isr_attach(const gpio_num_t gpio_num, gpio_isr_t handler, void* arg) {
+        if (!toggles_initialized) {
+                if (toggles_init() != 0)
+                        return -3;
+        }
+
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return -2;
+        }
+
+        if (!handler) {
+                ESP_LOGE(TAG, "NULL ISR handler provided for GPIO %d", (int) gpio_num);
+                return -5;
+        }
+
+        const size_t index = (size_t) gpio_num;
+
+        xSemaphoreTake(toggles_lock, portMAX_DELAY);
+        if (toggle_claimed[index]) {
+                xSemaphoreGive(toggles_lock);
+                return -1;
+        }
+        toggle_claimed[index] = true;
         xSemaphoreGive(toggles_lock);
+
+        my_gpio_enable(gpio_num);
+
+        if (toggle_isr_install(gpio_num, handler, arg) != ESP_OK) {
+                xSemaphoreTake(toggles_lock, portMAX_DELAY);
+                toggle_claimed[index] = false;
+                xSemaphoreGive(toggles_lock);
+                return -4;
+        }
+
+        return 0;
 }
 
 
-void toggle_sync_state(const gpio_num_t gpio_num) {
-        if (!toggles_initialized)
+void toggle_isr_detach(const gpio_num_t gpio_num) {
+        if (!toggles_initialized || !GPIO_IS_VALID_GPIO(gpio_num))
                 return;
 
+        toggle_isr_remove(gpio_num);
+
         xSemaphoreTake(toggles_lock, portMAX_DELAY);
+        toggle_claimed[(size_t) gpio_num] = false;
+        xSemaphoreGive(toggles_lock);
+}
+
+
+bool toggle_is_high(const gpio_num_t gpio_num) {
+        if (!toggles_initialized)
+                return false;
 
         toggle_t *toggle = toggle_find_by_gpio(gpio_num);
-        if (toggle) {
-                if (toggle->debounce_timer && xTimerIsTimerActive(toggle->debounce_timer)) {
-                        xTimerStop(toggle->debounce_timer, 0);
-                }
+        if (!toggle)
+                return false;
 
-                toggle->debounce_timer_armed = false;
+        portENTER_CRITICAL(&toggle->lock);
+        const bool high = toggle->last_high;
+        portEXIT_CRITICAL(&toggle->lock);
 
-                toggle->last_high = my_gpio_read(toggle->gpio_num) == 1;
+        return high;
+}
+
+
+int toggle_get_capture_stats(const gpio_num_t gpio_num, toggle_capture_stats_t *stats, bool reset) {
+        if (!toggles_initialized)
+                return -1;
+
+        toggle_t *toggle = toggle_find_by_gpio(gpio_num);
+        if (!toggle)
+                return -1;
+
+#ifdef CONFIG_BUTTON_IRAM_SAFE
+        portENTER_CRITICAL(&toggle->lock);
+        if (stats)
+                *stats = toggle->capture_stats;
+        if (reset)
+                memset(&toggle->capture_stats, 0, sizeof(toggle->capture_stats));
+        portEXIT_CRITICAL(&toggle->lock);
+#else
+        (void) reset;
+        if (stats)
+                memset(stats, 0, sizeof(*stats));
+#endif
+
+        return 0;
+}
+
+
+toggle_fault_t toggle_get_fault(const gpio_num_t gpio_num) {
+        if (!toggles_initialized)
+                return toggle_fault_none;
+
+        toggle_t *toggle = toggle_find_by_gpio(gpio_num);
+        if (!toggle)
+                return toggle_fault_none;
+
+        portENTER_CRITICAL(&toggle->lock);
+        const toggle_fault_t fault = toggle->fault;
+        portEXIT_CRITICAL(&toggle->lock);
+
+        return fault;
+}
+
+
+int toggle_quarantine(const gpio_num_t gpio_num, toggle_fault_t fault) {
+        if (!toggles_initialized)
+                return -1;
+
+        if (fault == toggle_fault_none)
+                return -2;
+
+        toggle_t *toggle = toggle_find_by_gpio(gpio_num);
+        if (!toggle)
+                return -1;
+
+        portENTER_CRITICAL(&toggle->lock);
+        const bool quarantine = toggle->active && toggle->timer_mode == toggle_timer_mode_debounce;
+        if (quarantine) {
+                toggle->timer_mode = toggle_timer_mode_quarantine;
+                toggle->quarantine_fault = fault;
+                toggle->stuck_high = toggle->last_high;
+                toggle->debounce_timer_armed = true;
         }
+        portEXIT_CRITICAL(&toggle->lock);
 
-        xSemaphoreGive(toggles_lock);
+        if (!quarantine)
+                return -1;
+
+        // Reported from the timer task, like a storm detected in the ISR.
+        gpio_intr_disable(gpio_num);
+        xTimerChangePeriod(toggle->debounce_timer, 1, 0);
+        return 0;
 }
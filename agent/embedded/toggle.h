@@ -11,6 +11,70 @@
 // Callback function signature
 typedef void (*toggle_callback_fn)(bool high, void* context);
 
+typedef enum {
+        toggle_fault_none = 0,
+        // The pin exceeded the configured edge rate and was quarantined.
+        toggle_fault_storm,
+        // Quarantined with toggle_quarantine because the level stopped
+        // changing, e.g. a shorted or jammed contact.
+        toggle_fault_stuck,
+        // The level did not settle within unstable_window_ms.
+        toggle_fault_unstable,
+} toggle_fault_t;
+
+// Called from the timer task when the pin enters or leaves quarantine.
+typedef void (*toggle_fault_fn)(toggle_fault_t fault, void* context);
+
+// Called from the GPIO interrupt on the first edge of a debounce window.
+typedef void (*toggle_edge_fn)(void* context);
+
+typedef struct {
+        // Time in milliseconds the level has to be stable before it is reported.
+        uint16_t debounce_ms;
+        // Width of glitches to suppress with the hardware glitch filter of the
+        // target, in nanoseconds. 0 disables the hardware filter. Targets without
+        // a glitch filter ignore this and debounce purely in software.
+        uint32_t glitch_filter_ns;
+
+        // Disable the pin interrupt on the first edge and enable it again once
+        // the debounce window expired, so a press costs about one interrupt
+        // regardless of how much the contact bounces.
+        bool mask_during_debounce;
+        // Quarantine the pin when more than storm_edge_limit interrupts arrive
+        // within storm_window_ms. 0 disables storm detection.
+        uint16_t storm_edge_limit;
+        uint16_t storm_window_ms;
+        // Interval in milliseconds at which a quarantined pin is probed again.
+        // The pin is restored after a full storm window without a storm, a
+        // full unstable window without an edge, or once a stuck level changed.
+        uint16_t storm_recheck_ms;
+        // Quarantine the pin when edges keep restarting the debounce window
+        // for unstable_window_ms without the level settling. 0 disables it,
+        // and edges masked by mask_during_debounce are never seen.
+        uint16_t unstable_window_ms;
+        // Optional, receives the context passed to toggle_create_with_config.
+        toggle_fault_fn fault_callback;
+        // Optional, runs in interrupt context before the level is debounced,
+        // so it has to be IRAM-safe with CONFIG_BUTTON_IRAM_SAFE. Receives
+        // the context passed to toggle_create_with_config.
+        toggle_edge_fn edge_callback;
+} toggle_config_t;
+
+static inline toggle_config_t toggle_config_default(void)
+{
+        return (toggle_config_t) {
+                .debounce_ms = 10,
+                .glitch_filter_ns = 750,
+                .mask_during_debounce = false,
+                .storm_edge_limit = 0,
+                .storm_window_ms = 1000,
+                .storm_recheck_ms = 5000,
+                .unstable_window_ms = 0,
+                .fault_callback = NULL,
+                .edge_callback = NULL,
+        };
+}
+
 // Function to create a toggle. The callback parameter must be non-NULL; passing NULL
 // results in an error.
 // Returns 0 on success, -1 if the GPIO is already tracked, -2 if the GPIO is invalid,
@@ -18,9 +82,60 @@ typedef void (*toggle_callback_fn)(bool high, void* context);
 // configuration fails, and -5 if the callback is NULL.
 int toggle_create(gpio_num_t gpio_num, toggle_callback_fn callback, void* context);
 
+// Same as toggle_create, with explicit debounce settings. The part of the
+// debounce window covered by the hardware glitch filter is not repeated in
+// software; when the filter covers all of it (or debounce_ms is 0) edges are
+// only deferred to the timer task, not restarted on every bounce. Without a
+// hardware filter a debounce_ms of 0 falls back to the default window.
+int toggle_create_with_config(gpio_num_t gpio_num,
+                              const toggle_config_t *config,
+                              toggle_callback_fn callback,
+                              void* context);
+
 // Function to delete a toggle
 void toggle_delete(gpio_num_t gpio_num);
 
+// Route the interrupt of a raw input pin to handler, for inputs that decode
+// edges themselves instead of being debounced. The pin is configured as input,
+// interrupts on both edges and is claimed like a toggle until
+// toggle_isr_detach. handler runs in interrupt context.
+// Returns the same codes as toggle_create, with -5 for a NULL handler.
+int toggle_isr_attach(gpio_num_t gpio_num, gpio_isr_t handler, void* arg);
+void toggle_isr_detach(gpio_num_t gpio_num);
+
+typedef struct {
+        // Edges captured by the ISR, and how many of them while flash was
+        // being written.
+        uint32_t captured;
+        uint32_t captured_during_flash;
+        // Edges dropped because the ring was full before the timer task caught
+        // up. The level is still resampled afterwards.
+        uint32_t overflows;
+        // Worst time in microseconds from capturing an edge to processing it,
+        // overall and for edges captured during flash operations.
+        uint32_t max_latency_us;
+        uint32_t max_flash_latency_us;
+} toggle_capture_stats_t;
+
+// Edge capture statistics of the pin in IRAM-safe mode
+// (CONFIG_BUTTON_IRAM_SAFE); all zero otherwise. With reset set the counters
+// start over. Returns 0, or -1 if no toggle is registered on the pin.
+int toggle_get_capture_stats(gpio_num_t gpio_num, toggle_capture_stats_t *stats, bool reset);
+
+// Current quarantine state of the pin.
+toggle_fault_t toggle_get_fault(gpio_num_t gpio_num);
+
+// Quarantine the pin for a fault its owner detected, such as
+// toggle_fault_stuck for a contact that stays at its debounced level: the
+// interrupt is masked, the fault is reported from the timer task and the pin
+// is read once every storm_recheck_ms until the level changes. Returns 0,
+// -1 if no toggle is registered on the pin or it is already quarantined, and
+// -2 for toggle_fault_none.
+int toggle_quarantine(gpio_num_t gpio_num, toggle_fault_t fault);
+
+// Last debounced level of the pin; false if no toggle is registered on it.
+bool toggle_is_high(gpio_num_t gpio_num);
+
 // Force the toggle helper to resample and synchronise its state without
 // generating callbacks.
 void toggle_sync_state(gpio_num_t gpio_num);
@@ -0,0 +1,305 @@
+#include <stdatomic.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+
+#include "touch.h"
+#include "port.h"
+
+
+// Fractional bits of the baseline, so small IIR steps are not rounded away.
+#define TOUCH_BASELINE_FRACTION_BITS 4
+
+// Raw counts must leave room for the fraction bits.
+#define TOUCH_RAW_MAX (UINT32_MAX >> TOUCH_BASELINE_FRACTION_BITS)
+
+// One sampling timer serves every pad; it only runs while pads exist.
+// - touch_lock guards pad_count and the sampling timer.
+// - claimed, active and busy follow the encoder: the sampler enters a pad by
+//   bumping busy while it is active, so touch_delete can wait for it.
+// - baseline, touched and pending are only used by the timer task. raw and
+//   the published baseline are atomic for touch_get_counts.
+typedef struct _touch {
+        gpio_num_t gpio_num;
+        uint8_t channel;
+        touch_config_t config;
+        touch_callback_fn callback;
+        void* context;
+
+        atomic_bool claimed;
+        atomic_bool active;
+        atomic_uint_least16_t busy;
+
+        bool sampled;
+        bool touched;
+        uint8_t pending;
+        uint32_t baseline;
+        atomic_uint_least32_t raw;
+        atomic_uint_least32_t published_baseline;
+} touch_t;
+
+static touch_t touch_pool[MY_TOUCH_CHANNELS];
+static touch_t *_Atomic touch_map[GPIO_NUM_MAX];
+
+static SemaphoreHandle_t _Atomic touch_lock;
+static StaticTimer_t touch_timer_buffer;
+static TimerHandle_t touch_timer;
+static size_t pad_count;
+
+static const char *TAG = "touch";
+
+
+static bool touch_enter(touch_t *pad) {
+        atomic_fetch_add(&pad->busy, 1);
+        if (atomic_load(&pad->active))
+                return true;
+
+        atomic_fetch_sub(&pad->busy, 1);
+        return false;
+}
+
+
+static void touch_leave(touch_t *pad) {
+        // Zero when the callback deleted its own pad.
+        uint_least16_t busy = atomic_load(&pad->busy);
+        while (busy && !atomic_compare_exchange_weak(&pad->busy, &busy, busy - 1)) {
+        }
+}
+
+
+// Feed one raw count through the baseline tracker. Returns true when the
+// touch state changed.
+static bool touch_update(touch_t *pad, uint32_t raw) {
+        if (raw > TOUCH_RAW_MAX)
+                raw = TOUCH_RAW_MAX;
+        atomic_store_explicit(&pad->raw, raw, memory_order_relaxed);
+
+        if (!pad->sampled) {
+                pad->sampled = true;
+                pad->baseline = raw << TOUCH_BASELINE_FRACTION_BITS;
+                atomic_store_explicit(&pad->published_baseline, raw, memory_order_relaxed);
+                return false;
+        }
+
+        const uint32_t base = pad->baseline >> TOUCH_BASELINE_FRACTION_BITS;
+        uint32_t delta = 0;
+        if (my_touch_lowers_count()) {
+                delta = raw < base ? base - raw : 0;
+        } else {
+                delta = raw > base ? raw - base : 0;
+        }
+
+        const uint32_t touch_at = (uint32_t) ((uint64_t) base * pad->config.touch_threshold_permille / 1000);
+        const uint32_t release_at = (uint32_t) ((uint64_t) base * pad->config.release_threshold_permille / 1000);
+
+        bool changed = false;
+        const bool beyond = pad->touched ? delta <= release_at : delta >= touch_at;
+        if (beyond) {
+                if (++pad->pending >= pad->config.confirm_samples) {
+                        pad->pending = 0;
+                        pad->touched = !pad->touched;
+                        changed = true;
+                }
+        } else {
+                pad->pending = 0;
+        }
+
+        // Only clearly idle samples move the baseline, so neither a touch nor
+        // a slow approach is absorbed into it.
+        if (!pad->touched && !pad->pending && delta <= release_at) {
+                const int32_t difference = (int32_t) (raw << TOUCH_BASELINE_FRACTION_BITS) - (int32_t) pad->baseline;
+                pad->baseline = (uint32_t) ((int32_t) pad->baseline + (difference >> pad->config.baseline_shift));
+                atomic_store_explicit(&pad->published_baseline, pad->baseline >> TOUCH_BASELINE_FRACTION_BITS,
+                                      memory_order_relaxed);
+        }
+
+        return changed;
+}
+
+
+// Samples every active pad with one read of the touch sensor.
+static void touch_sample_timer_callback(TimerHandle_t timer) {
+        (void) timer;
+
+        touch_t *pads[MY_TOUCH_CHANNELS];
+        uint8_t channels[MY_TOUCH_CHANNELS];
+        uint32_t raw[MY_TOUCH_CHANNELS];
+        size_t count = 0;
+
+        for (size_t i = 0; i < MY_TOUCH_CHANNELS; i++) {
+                touch_t *pad = &touch_pool[i];
+                if (!touch_enter(pad))
+                        continue;
+                pads[count] = pad;
+                channels[count] = pad->channel;
+                count++;
+        }
+
+        if (!count)
+                return;
+
+        my_touch_read(channels, count, raw);
+
+        // A callback may delete a pad later in the sweep; that one is
+        // skipped, as touch_delete from the timer task does not wait for it.
+        for (size_t i = 0; i < count; i++) {
+                touch_t *pad = pads[i];
+                if (atomic_load(&pad->active) && touch_update(pad, raw[i]))
+                        pad->callback(pad->touched, pad->context);
+                touch_leave(pad);
+        }
+}
+
+
+static int touch_init() {
+        if (atomic_load_explicit(&touch_lock, memory_order_acquire))
+                return 0;
+
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+        if (!lock) {
+                ESP_LOGE(TAG, "Failed to create touch lock");
+                return -1;
+        }
+
+        SemaphoreHandle_t expected = NULL;
+        if (!atomic_compare_exchange_strong_explicit(&touch_lock, &expected, lock,
+                                                     memory_order_acq_rel, memory_order_acquire))
+                vSemaphoreDelete(lock);
+
+        return 0;
+}
+
+
+int touch_create(const gpio_num_t gpio_num,
+                 const touch_config_t *config,
+                 touch_callback_fn callback,
+                 void* context)
+{
+        if (!callback) {
+                ESP_LOGE(TAG, "Callback must not be NULL for GPIO %d", (int) gpio_num);
+                return -5;
+        }
+
+        const touch_config_t effective = config ? *config : touch_config_default();
+        const int channel = GPIO_IS_VALID_GPIO(gpio_num) ? my_touch_channel(gpio_num) : -1;
+        if (channel < 0 || channel >= MY_TOUCH_CHANNELS) {
+                ESP_LOGE(TAG, "GPIO %d has no touch channel", (int) gpio_num);
+                return -2;
+        }
+
+        if (!effective.touch_threshold_permille
+            || effective.release_threshold_permille >= effective.touch_threshold_permille
+            || effective.baseline_shift >= 16) {
+                ESP_LOGE(TAG, "Invalid touch thresholds for GPIO %d", (int) gpio_num);
+                return -2;
+        }
+
+        if (touch_init() != 0)
+                return -3;
+
+        touch_t *pad = &touch_pool[channel];
+        if (atomic_exchange(&pad->claimed, true))
+                return -1;
+
+        pad->gpio_num = gpio_num;
+        pad->channel = (uint8_t) channel;
+        pad->config = effective;
+        if (!pad->config.confirm_samples)
+                pad->config.confirm_samples = 1;
+        pad->callback = callback;
+        pad->context = context;
+        pad->sampled = false;
+        pad->touched = false;
+        pad->pending = 0;
+        pad->baseline = 0;
+        atomic_store(&pad->raw, 0);
+        atomic_store(&pad->published_baseline, 0);
+
+        esp_err_t err = my_touch_enable(channel);
+        if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to enable touch channel %d: %s", channel, esp_err_to_name(err));
+                atomic_store(&pad->claimed, false);
+                return -3;
+        }
+
+        int result = 0;
+        xSemaphoreTake(touch_lock, portMAX_DELAY);
+        if (!touch_timer) {
+                touch_timer = xTimerCreateStatic(
+                        "Touch Sample Timer",
+                        pdMS_TO_TICKS(TOUCH_SAMPLE_INTERVAL_MS) ? pdMS_TO_TICKS(TOUCH_SAMPLE_INTERVAL_MS) : 1,
+                        pdTRUE,
+                        NULL,
+                        touch_sample_timer_callback,
+                        &touch_timer_buffer
+                );
+        }
+        if (!touch_timer) {
+                ESP_LOGE(TAG, "Failed to create touch sample timer");
+                result = -3;
+        } else {
+                atomic_store(&touch_map[(size_t) gpio_num], pad);
+                atomic_store(&pad->active, true);
+                if (pad_count++ == 0)
+                        xTimerStart(touch_timer, portMAX_DELAY);
+        }
+        xSemaphoreGive(touch_lock);
+
+        if (result) {
+                my_touch_disable(channel);
+                atomic_store(&pad->claimed, false);
+        }
+
+        return result;
+}
+
+
+void touch_delete(const gpio_num_t gpio_num) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+                ESP_LOGE(TAG, "Invalid GPIO number: %d", (int) gpio_num);
+                return;
+        }
+
+        // Exactly one concurrent delete gets the pad; the slot stays claimed
+        // until it is clear.
+        touch_t *pad = atomic_exchange(&touch_map[(size_t) gpio_num], NULL);
+        if (!pad)
+                return;
+
+        // The timer task cannot wait for room in its own command queue.
+        const bool timer_task = xTaskGetCurrentTaskHandle() == xTimerGetTimerDaemonTaskHandle();
+
+        xSemaphoreTake(touch_lock, portMAX_DELAY);
+        atomic_store(&pad->active, false);
+        if (--pad_count == 0 && xTimerStop(touch_timer, timer_task ? 0 : portMAX_DELAY) != pdPASS)
+                ESP_LOGE(TAG, "Failed to stop the touch sampling timer");
+        xSemaphoreGive(touch_lock);
+
+        my_touch_disable(pad->channel);
+
+        // A sample of this pad may still be running in the timer task. When
+        // we are that sample, it does not touch the pad after returning to us.
+        if (!timer_task) {
+                while (atomic_load(&pad->busy)) {
+                        vTaskDelay(1);
+                }
+        }
+
+        atomic_store(&pad->claimed, false);
+}
+
+
+int touch_get_counts(const gpio_num_t gpio_num, uint32_t *raw, uint32_t *baseline) {
+        if (!GPIO_IS_VALID_GPIO(gpio_num))
+                return -1;
+
+        touch_t *pad = atomic_load(&touch_map[(size_t) gpio_num]);
+        if (!pad)
+                return -1;
+
+        if (raw)
+                *raw = atomic_load_explicit(&pad->raw, memory_order_relaxed);
+        if (baseline)
+                *baseline = atomic_load_explicit(&pad->published_baseline, memory_order_relaxed);
+        return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef TOUCH_H
+#define TOUCH_H
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <driver/gpio.h>
+
+// Called from the timer task when the pad is touched or released.
+typedef void (*touch_callback_fn)(bool touched, void* context);
+
+// Interval in milliseconds at which all pads are sampled, in one batch by one
+// timer shared by every pad.
+#ifndef TOUCH_SAMPLE_INTERVAL_MS
+#define TOUCH_SAMPLE_INTERVAL_MS 20
+#endif
+
+typedef struct {
+        // Deviation from the baseline at which the pad counts as touched, and
+        // below which it counts as released again, in permille of the
+        // baseline. The gap between the two is the hysteresis.
+        uint16_t touch_threshold_permille;
+        uint16_t release_threshold_permille;
+        // While released, the baseline follows the raw count by 1/2^n of the
+        // difference per sample, so temperature and humidity drift are
+        // tracked. It is frozen while the pad is touched.
+        uint8_t baseline_shift;
+        // Consecutive samples past a threshold before the state changes.
+        uint8_t confirm_samples;
+} touch_config_t;
+
+static inline touch_config_t touch_config_default(void)
+{
+        return (touch_config_t) {
+                .touch_threshold_permille = 100,
+                .release_threshold_permille = 50,
+                .baseline_shift = 4,
+                .confirm_samples = 2,
+        };
+}
+
+// Track the touch channel of gpio_num. The first sample becomes the baseline,
+// so the pad must not be touched while it is created. The pad is identified
+// by gpio_num afterwards.
+// Returns 0 on success, -1 if the pad is already tracked, -2 if the GPIO has
+// no touch channel or the thresholds are invalid, -3 if the touch sensor or
+// the sampling timer cannot be set up, and -5 if the callback is NULL.
+int touch_create(gpio_num_t gpio_num,
+                 const touch_config_t *config,
+                 touch_callback_fn callback,
+                 void* context);
+
+void touch_delete(gpio_num_t gpio_num);
+
+// Latest raw count and baseline of the pad, for tuning the thresholds.
+// Returns 0, or -1 if the pad is not tracked.
+int touch_get_counts(gpio_num_t gpio_num, uint32_t *raw, uint32_t *baseline);
+
+#endif // TOUCH_H
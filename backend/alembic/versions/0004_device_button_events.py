@@ -0,0 +1,41 @@
+"""device button events
+
+Revision ID: 0004_device_button_events
+Revises: 0003_device_protocol_columns
+Create Date: 2026-10-18
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+revision = "0004_device_button_events"
+down_revision = "0003_device_protocol_columns"
+branch_labels = None
+depends_on = None
+
+
+def add_common_cols(table: str) -> None:
+    op.add_column(table, sa.Column("created_at", sa.DateTime(timezone=True), server_default=sa.func.now(), nullable=False))
+    op.add_column(table, sa.Column("updated_at", sa.DateTime(timezone=True), server_default=sa.func.now(), nullable=False))
+    op.add_column(table, sa.Column("created_by", sa.String(), nullable=True))
+    op.add_column(table, sa.Column("deleted_at", sa.DateTime(timezone=True), nullable=True))
+
+
+def upgrade() -> None:
+    op.create_table(
+        "device_button_events",
+        sa.Column("id", sa.Integer(), primary_key=True),
+        sa.Column("device_id", sa.Integer(), sa.ForeignKey("devices.id"), nullable=False),
+        sa.Column("gpio", sa.Integer(), nullable=False),
+        sa.Column("event", sa.String(32), nullable=False),
+        sa.Column("count", sa.Integer(), nullable=False),
+        sa.Column("bucket_start", sa.DateTime(timezone=True), nullable=False),
+        sa.Column("bucket_seconds", sa.Integer(), nullable=False),
+    )
+    add_common_cols("device_button_events")
+    op.create_index("ix_device_button_events_device_bucket", "device_button_events", ["device_id", "bucket_start"])
+
+
+def downgrade() -> None:
+    op.drop_index("ix_device_button_events_device_bucket", table_name="device_button_events")
+    op.drop_table("device_button_events")
@@ -0,0 +1,26 @@
+"""device config version
+
+Revision ID: 0005_device_config_version
+Revises: 0004_device_button_events
+Create Date: 2026-10-18
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+revision = "0005_device_config_version"
+down_revision = "0004_device_button_events"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.add_column("devices", sa.Column("config_version", sa.Integer(), nullable=False, server_default="0"))
+    op.add_column("settings", sa.Column("device_config_version", sa.Integer(), nullable=True))
+    op.create_index("ix_settings_device_config_version", "settings", ["device_id", "device_config_version"])
+
+
+def downgrade() -> None:
+    op.drop_index("ix_settings_device_config_version", table_name="settings")
+    op.drop_column("settings", "device_config_version")
+    op.drop_column("devices", "config_version")
@@ -0,0 +1,25 @@
+"""device heartbeat error flag
+
+Revision ID: 0006_device_heartbeat_error
+Revises: 0005_device_config_version
+Create Date: 2026-10-18
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+revision = "0006_device_heartbeat_error"
+down_revision = "0005_device_config_version"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.add_column(
+        "devices", sa.Column("heartbeat_error", sa.Boolean(), nullable=False, server_default=sa.false())
+    )
+    op.execute("UPDATE devices SET heartbeat_error = true WHERE status = 'error'")
+
+
+def downgrade() -> None:
+    op.drop_column("devices", "heartbeat_error")
@@ -0,0 +1,29 @@
+"""drop the stored device status
+
+Revision ID: 0007_drop_device_status
+Revises: 0006_device_heartbeat_error
+Create Date: 2026-10-18
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+revision = "0007_drop_device_status"
+down_revision = "0006_device_heartbeat_error"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    # The status is derived from last_heartbeat_at and heartbeat_error when read;
+    # the column stopped being updated and only held stale values.
+    op.drop_index("ix_devices_org_status", table_name="devices")
+    op.drop_column("devices", "status")
+    op.create_index("ix_devices_organization_id", "devices", ["organization_id"])
+
+
+def downgrade() -> None:
+    op.drop_index("ix_devices_organization_id", table_name="devices")
+    op.add_column("devices", sa.Column("status", sa.String(30), nullable=False, server_default="offline"))
+    op.execute("UPDATE devices SET status = 'error' WHERE heartbeat_error")
+    op.create_index("ix_devices_org_status", "devices", ["organization_id", "status"])
@@ -1,8 +1,10 @@
-from fastapi import APIRouter, Depends, HTTPException
+from fastapi import APIRouter, Depends, Header, HTTPException, Response
 from sqlalchemy.orm import Session
 
 from app.db.session import get_db
 from app.schemas.device_protocol import (
+    DeviceBatchRequest,
+    DeviceBatchResponse,
     DeviceCommandAckRequest,
     DeviceCommandRequest,
     DeviceConfigRequest,
@@ -29,10 +31,10 @@ def register(payload: DeviceRegisterRequest, db: Session = Depends(get_db)) -> D
 def heartbeat(payload: DeviceHeartbeatRequest, db: Session = Depends(get_db)) -> DeviceResponse:
     service = DeviceProtocolService(db)
     try:
-        device = service.heartbeat(payload.serial_number, has_error=payload.has_error)
+        status = service.heartbeat(payload.serial_number, has_error=payload.has_error)
     except ValueError as exc:
         raise HTTPException(status_code=404, detail=str(exc)) from exc
-    return DeviceResponse(status=device.status)
+    return DeviceResponse(status=status)
 
 
 @router.post("/metrics", response_model=DeviceResponse)
@@ -49,16 +51,59 @@ def logs_push(payload: DeviceLogRequest, db: Session = Depends(get_db)) -> Devic
     return DeviceResponse(status="accepted")
 
 
+@router.post("/batch", response_model=DeviceBatchResponse)
+def batch_push(payload: DeviceBatchRequest, db: Session = Depends(get_db)) -> DeviceBatchResponse:
+    service = DeviceProtocolService(db)
+    try:
+        result = service.ingest_batch(
+            payload.serial_number,
+            payload.uptime,
+            payload.bucket_seconds,
+            payload.metrics,
+            payload.logs,
+            payload.button_events,
+        )
+    except ValueError as exc:
+        raise HTTPException(status_code=404, detail=str(exc)) from exc
+    return DeviceBatchResponse(**result)
+
+
 @router.post("/screenshot-upload", response_model=DeviceResponse)
 def screenshot_upload(payload: DeviceCommandRequest) -> DeviceResponse:
     _ = payload
     return DeviceResponse(status="accepted")
 
 
+def _etag_version(if_none_match: str | None) -> int | None:
+    if if_none_match is None:
+        return None
+    value = if_none_match.strip()
+    if value.startswith("W/"):
+        value = value[2:]
+    value = value.strip('"')
+    return int(value) if value.isdigit() else None
+
+
 @router.post("/config-fetch")
-def config_fetch(payload: DeviceConfigRequest, db: Session = Depends(get_db)) -> dict:
+def config_fetch(
+    payload: DeviceConfigRequest,
+    response: Response,
+    db: Session = Depends(get_db),
+    if_none_match: str | None = Header(default=None),
+) -> dict:
     service = DeviceProtocolService(db)
-    return {"settings": service.fetch_config(payload.serial_number)}
+    etag_version = _etag_version(if_none_match)
+    since_version = payload.since_version if payload.since_version is not None else etag_version
+    try:
+        config = service.fetch_config(payload.serial_number, since_version)
+    except ValueError as exc:
+        raise HTTPException(status_code=404, detail=str(exc)) from exc
+
+    etag = f'"{config["version"]}"'
+    if etag_version == config["version"]:
+        return Response(status_code=304, headers={"ETag": etag})
+    response.headers["ETag"] = etag
+    return config
 
 
 @router.post("/command-fetch")
@@ -0,0 +1,32 @@
+from fastapi import APIRouter, Depends, HTTPException
+from sqlalchemy.orm import Session
+
+from app.core.rbac import require_permission
+from app.db.session import get_db
+from app.schemas.devices import DeviceRead
+from app.services.device_protocol_service import DeviceProtocolService
+
+router = APIRouter(prefix="/v1/devices", tags=["devices"])
+
+
+@router.get("", response_model=list[DeviceRead])
+def list_devices(
+    organization_id: int | None = None,
+    db: Session = Depends(get_db),
+    _user_id: int = Depends(require_permission("devices.read")),
+) -> list[DeviceRead]:
+    service = DeviceProtocolService(db)
+    return [DeviceRead(**device) for device in service.list_devices(organization_id)]
+
+
+@router.get("/{device_id}", response_model=DeviceRead)
+def get_device(
+    device_id: int,
+    db: Session = Depends(get_db),
+    _user_id: int = Depends(require_permission("devices.read")),
+) -> DeviceRead:
+    service = DeviceProtocolService(db)
+    device = service.get_device(device_id)
+    if device is None:
+        raise HTTPException(status_code=404, detail="Device not found")
+    return DeviceRead(**device)
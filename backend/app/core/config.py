@@ -10,6 +10,7 @@ class Settings(BaseSettings):
     refresh_token_exp_minutes: int = 60 * 24 * 14
     jwt_algorithm: str = "HS256"
     bcrypt_rounds: int = 12
+    heartbeat_flush_seconds: float = 5.0
 
     model_config = SettingsConfigDict(env_file=".env", env_file_encoding="utf-8", extra="ignore")
 
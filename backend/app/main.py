@@ -1,11 +1,27 @@
+from contextlib import asynccontextmanager
+
 from fastapi import FastAPI
 from prometheus_client import CONTENT_TYPE_LATEST, Counter, Histogram, generate_latest
 from starlette.responses import Response
 
-from app.api.routes import auth, device_protocol, health, settings
+from app.api.routes import auth, device_protocol, devices, health, settings
+from app.core.config import settings as app_settings
 from app.core.logging import RequestContextMiddleware
+from app.db.session import SessionLocal
+from app.services.heartbeat_buffer import HeartbeatFlusher, heartbeats
+
+
+@asynccontextmanager
+async def lifespan(app: FastAPI):
+    flusher = HeartbeatFlusher(heartbeats, SessionLocal, app_settings.heartbeat_flush_seconds)
+    flusher.start()
+    try:
+        yield
+    finally:
+        flusher.stop()
+
 
-app = FastAPI(title="Enterprise Signage Platform API", version="0.2.0")
+app = FastAPI(title="Enterprise Signage Platform API", version="0.2.0", lifespan=lifespan)
 app.add_middleware(RequestContextMiddleware)
 
 REQUEST_COUNT = Counter("api_requests_total", "Total API request count", ["path", "method", "status"])
@@ -15,6 +31,7 @@ app.include_router(health.router, prefix="/api")
 app.include_router(auth.router, prefix="/api")
 app.include_router(settings.router, prefix="/api")
 app.include_router(device_protocol.router, prefix="/api")
+app.include_router(devices.router, prefix="/api")
 
 
 @app.get("/health")
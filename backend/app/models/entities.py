@@ -71,15 +71,19 @@ class DeviceGroup(Base, TimestampMixin):
 
 class Device(Base, TimestampMixin):
     __tablename__ = "devices"
-    __table_args__ = (Index("ix_devices_org_status", "organization_id", "status"),)
+    __table_args__ = (Index("ix_devices_organization_id", "organization_id"),)
     id: Mapped[int] = mapped_column(primary_key=True)
     organization_id: Mapped[int] = mapped_column(ForeignKey("organizations.id"), nullable=False)
     group_id: Mapped[int | None] = mapped_column(ForeignKey("device_groups.id"))
     serial_number: Mapped[str] = mapped_column(String(128), unique=True, nullable=False)
-    status: Mapped[str] = mapped_column(String(30), default="offline")
     agent_version: Mapped[str | None] = mapped_column(String(64))
+    # The status is not stored; it is derived from these two when read
+    # (DeviceProtocolService.current_status).
     last_heartbeat_at: Mapped[datetime | None] = mapped_column(DateTime(timezone=True))
+    heartbeat_error: Mapped[bool] = mapped_column(Boolean, nullable=False, default=False, server_default="false")
     capabilities: Mapped[dict] = mapped_column(JSONB, default=dict)
+    # Bumped whenever a device-scoped setting of the device changes.
+    config_version: Mapped[int] = mapped_column(Integer, nullable=False, default=0, server_default="0")
 
 
 class DeviceTag(Base, TimestampMixin):
@@ -144,7 +148,10 @@ class Zone(Base, TimestampMixin):
 
 class Setting(Base, TimestampMixin):
     __tablename__ = "settings"
-    __table_args__ = (Index("ix_settings_scope", "scope", "organization_id", "device_id"),)
+    __table_args__ = (
+        Index("ix_settings_scope", "scope", "organization_id", "device_id"),
+        Index("ix_settings_device_config_version", "device_id", "device_config_version"),
+    )
     id: Mapped[int] = mapped_column(primary_key=True)
     scope: Mapped[str] = mapped_column(String(32), nullable=False)
     organization_id: Mapped[int | None] = mapped_column(ForeignKey("organizations.id"))
@@ -152,6 +159,8 @@ class Setting(Base, TimestampMixin):
     key: Mapped[str] = mapped_column(String(128), nullable=False)
     value: Mapped[dict] = mapped_column(JSONB, nullable=False)
     version: Mapped[int] = mapped_column(Integer, nullable=False, default=1)
+    # config_version of the device this row was written at; device-scoped rows only.
+    device_config_version: Mapped[int | None] = mapped_column(Integer)
 
 
 class Alert(Base, TimestampMixin):
@@ -194,6 +203,18 @@ class DeviceLog(Base, TimestampMixin):
     message: Mapped[str] = mapped_column(Text)
 
 
+class DeviceButtonEvent(Base, TimestampMixin):
+    __tablename__ = "device_button_events"
+    __table_args__ = (Index("ix_device_button_events_device_bucket", "device_id", "bucket_start"),)
+    id: Mapped[int] = mapped_column(primary_key=True)
+    device_id: Mapped[int] = mapped_column(ForeignKey("devices.id"), nullable=False)
+    gpio: Mapped[int] = mapped_column(Integer, nullable=False)
+    event: Mapped[str] = mapped_column(String(32), nullable=False)
+    count: Mapped[int] = mapped_column(Integer, nullable=False)
+    bucket_start: Mapped[datetime] = mapped_column(DateTime(timezone=True), nullable=False)
+    bucket_seconds: Mapped[int] = mapped_column(Integer, nullable=False)
+
+
 class UpdateJob(Base, TimestampMixin):
     __tablename__ = "update_jobs"
     id: Mapped[int] = mapped_column(primary_key=True)
@@ -1,7 +1,7 @@
-from sqlalchemy import select
+from sqlalchemy import bindparam, insert, or_, select, update
 from sqlalchemy.orm import Session
 
-from app.models.entities import Device, DeviceLog, DeviceMetric, Setting
+from app.models.entities import Device, DeviceButtonEvent, DeviceLog, DeviceMetric, Setting
 
 
 class DeviceRepository:
@@ -11,6 +11,18 @@ class DeviceRepository:
     def get_by_serial(self, serial_number: str) -> Device | None:
         return self.db.scalar(select(Device).where(Device.serial_number == serial_number))
 
+    def get_id_by_serial(self, serial_number: str) -> int | None:
+        return self.db.scalar(select(Device.id).where(Device.serial_number == serial_number))
+
+    def get(self, device_id: int) -> Device | None:
+        return self.db.get(Device, device_id)
+
+    def list_devices(self, organization_id: int | None = None) -> list[Device]:
+        stmt = select(Device).order_by(Device.id)
+        if organization_id is not None:
+            stmt = stmt.where(Device.organization_id == organization_id)
+        return list(self.db.scalars(stmt).all())
+
     def create(self, device: Device) -> Device:
         self.db.add(device)
         self.db.commit()
@@ -23,6 +35,23 @@ class DeviceRepository:
         self.db.refresh(device)
         return device
 
+    def update_heartbeats(self, rows: list[dict]) -> None:
+        # rows: {"device_id", "at", "error"}. One executemany UPDATE for all devices; a
+        # heartbeat older than the stored one (flushed by another worker) is skipped.
+        stmt = (
+            update(Device.__table__)
+            .where(Device.__table__.c.id == bindparam("device_id"))
+            .where(
+                or_(
+                    Device.__table__.c.last_heartbeat_at.is_(None),
+                    Device.__table__.c.last_heartbeat_at <= bindparam("at"),
+                )
+            )
+            .values(last_heartbeat_at=bindparam("at"), heartbeat_error=bindparam("error"))
+        )
+        self.db.execute(stmt, rows)
+        self.db.commit()
+
     def add_metric(self, device_id: int, cpu: int, created_by: str) -> DeviceMetric:
         metric = DeviceMetric(device_id=device_id, cpu=cpu, created_by=created_by)
         self.db.add(metric)
@@ -37,6 +66,20 @@ class DeviceRepository:
         self.db.refresh(log)
         return log
 
-    def get_device_settings(self, device_id: int) -> list[Setting]:
+    def add_batch(self, metrics: list[dict], logs: list[dict], button_events: list[dict]) -> None:
+        # One executemany INSERT per table and a single commit for the whole batch.
+        for model, rows in ((DeviceMetric, metrics), (DeviceLog, logs), (DeviceButtonEvent, button_events)):
+            if rows:
+                self.db.execute(insert(model), rows)
+        self.db.commit()
+
+    def get_config_version(self, device_id: int) -> int | None:
+        return self.db.scalar(select(Device.config_version).where(Device.id == device_id))
+
+    def get_device_settings(self, device_id: int, since_config_version: int | None = None) -> list[Setting]:
+        # Oldest first, so the latest version of a key comes last.
         stmt = select(Setting).where(Setting.scope == "device", Setting.device_id == device_id)
+        if since_config_version is not None:
+            stmt = stmt.where(Setting.device_config_version > since_config_version)
+        stmt = stmt.order_by(Setting.version, Setting.id)
         return list(self.db.scalars(stmt).all())
@@ -1,7 +1,7 @@
-from sqlalchemy import select
+from sqlalchemy import select, update
 from sqlalchemy.orm import Session
 
-from app.models.entities import Setting
+from app.models.entities import Device, Setting
 
 
 class SettingsRepository:
@@ -21,3 +21,8 @@ class SettingsRepository:
     def get_by_key_and_version(self, key: str, version: int) -> Setting | None:
         stmt = select(Setting).where(Setting.key == key, Setting.version == version).limit(1)
         return self.db.scalar(stmt)
+
+    def bump_device_config_version(self, device_id: int) -> int | None:
+        # Not committed; goes out with the setting that caused it.
+        self.db.execute(update(Device).where(Device.id == device_id).values(config_version=Device.config_version + 1))
+        return self.db.scalar(select(Device.config_version).where(Device.id == device_id))
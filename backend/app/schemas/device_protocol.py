@@ -1,5 +1,9 @@
+from typing import Any
+
 from pydantic import BaseModel, Field
 
+MAX_BATCH_RECORDS = 1000
+
 
 class DeviceRegisterRequest(BaseModel):
     organization_id: int
@@ -24,8 +28,51 @@ class DeviceLogRequest(BaseModel):
     message: str
 
 
+class DeviceBatchMetric(BaseModel):
+    cpu: int = Field(ge=0)
+
+
+class DeviceBatchLog(BaseModel):
+    level: str = Field(min_length=1, max_length=20)
+    message: str
+
+
+class DeviceBatchButtonEvent(BaseModel):
+    gpio: int = Field(ge=0)
+    event: str = Field(min_length=1, max_length=32)
+    count: int = Field(ge=1)
+    # Seconds since boot of the device, like uptime in the batch.
+    bucket_start: int = Field(ge=0)
+
+
+class DeviceBatchRequest(BaseModel):
+    serial_number: str
+    uptime: int | None = Field(default=None, ge=0)
+    bucket_seconds: int = Field(default=60, ge=1)
+    # Records are validated one by one, so one bad record does not reject the batch.
+    metrics: list[dict[str, Any]] = Field(default_factory=list, max_length=MAX_BATCH_RECORDS)
+    logs: list[dict[str, Any]] = Field(default_factory=list, max_length=MAX_BATCH_RECORDS)
+    button_events: list[dict[str, Any]] = Field(default_factory=list, max_length=MAX_BATCH_RECORDS)
+
+
+class DeviceBatchRecordStatus(BaseModel):
+    status: str
+    detail: str | None = None
+
+
+class DeviceBatchResponse(BaseModel):
+    status: str
+    accepted: int
+    rejected: int
+    metrics: list[DeviceBatchRecordStatus]
+    logs: list[DeviceBatchRecordStatus]
+    button_events: list[DeviceBatchRecordStatus]
+
+
 class DeviceConfigRequest(BaseModel):
     serial_number: str
+    # config version the agent applied last; the ETag of that response works as well.
+    since_version: int | None = Field(default=None, ge=0)
 
 
 class DeviceCommandRequest(BaseModel):
@@ -0,0 +1,13 @@
+from datetime import datetime
+
+from pydantic import BaseModel
+
+
+class DeviceRead(BaseModel):
+    id: int
+    organization_id: int
+    serial_number: str
+    agent_version: str | None = None
+    # Derived from the last heartbeat when the device is read.
+    status: str
+    last_heartbeat_at: datetime | None = None
@@ -0,0 +1,36 @@
+import threading
+from collections import OrderedDict
+
+MAX_CACHED_DEVICES = 10_000
+
+
+# Settings of a device keyed by its config_version. The version is read on every
+# fetch, so an entry is only used while it is current; whatever worker bumped the
+# version, the next fetch misses and reloads.
+class DeviceConfigCache:
+    def __init__(self, max_devices: int = MAX_CACHED_DEVICES) -> None:
+        self._lock = threading.Lock()
+        self._configs: OrderedDict[int, tuple[int, dict]] = OrderedDict()
+        self.max_devices = max_devices
+
+    def get(self, device_id: int, config_version: int) -> dict | None:
+        with self._lock:
+            entry = self._configs.get(device_id)
+            if entry is None or entry[0] != config_version:
+                return None
+            self._configs.move_to_end(device_id)
+            return entry[1]
+
+    def set(self, device_id: int, config_version: int, settings: dict) -> None:
+        with self._lock:
+            self._configs[device_id] = (config_version, settings)
+            self._configs.move_to_end(device_id)
+            while len(self._configs) > self.max_devices:
+                self._configs.popitem(last=False)
+
+    def clear(self) -> None:
+        with self._lock:
+            self._configs.clear()
+
+
+device_configs = DeviceConfigCache()
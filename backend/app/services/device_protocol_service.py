@@ -1,13 +1,33 @@
 from datetime import datetime, timedelta, timezone
 
+from pydantic import BaseModel, ValidationError
+
 from app.models.entities import Device
 from app.repositories.device_repository import DeviceRepository
+from app.schemas.device_protocol import DeviceBatchButtonEvent, DeviceBatchLog, DeviceBatchMetric
+from app.services.config_cache import device_configs
+from app.services.heartbeat_buffer import device_ids, heartbeats
 
 
 HEARTBEAT_TIMEOUT_SECONDS = 120
 STALE_THRESHOLD_SECONDS = 300
 
 
+def _validate_records(model: type[BaseModel], records: list[dict]) -> tuple[list[BaseModel | None], list[dict]]:
+    parsed: list[BaseModel | None] = []
+    statuses: list[dict] = []
+    for record in records:
+        try:
+            parsed.append(model.model_validate(record))
+            statuses.append({"status": "accepted"})
+        except ValidationError as exc:
+            parsed.append(None)
+            error = exc.errors()[0]
+            field = ".".join(str(part) for part in error["loc"])
+            statuses.append({"status": "rejected", "detail": f"{field}: {error['msg']}"})
+    return parsed, statuses
+
+
 def derive_device_status(last_heartbeat_at: datetime | None, error: bool = False) -> str:
     if error:
         return "error"
@@ -34,40 +54,151 @@ class DeviceProtocolService:
                 serial_number=serial_number,
                 agent_version=agent_version,
                 capabilities=capabilities,
-                status="offline",
                 created_by=serial_number,
             )
-            return self.repo.create(device)
+            device = self.repo.create(device)
+            device_ids.set(serial_number, device.id)
+            return device
 
         device.agent_version = agent_version
         device.capabilities = capabilities
         device.updated_at = datetime.now(timezone.utc)
         return self.repo.save(device)
 
-    def heartbeat(self, serial_number: str, has_error: bool = False) -> Device:
-        device = self.repo.get_by_serial(serial_number)
-        if device is None:
-            raise ValueError("Unknown device")
+    def resolve_device_id(self, serial_number: str) -> int:
+        device_id = device_ids.get(serial_number)
+        if device_id is None:
+            device_id = self.repo.get_id_by_serial(serial_number)
+            if device_id is None:
+                raise ValueError("Unknown device")
+            device_ids.set(serial_number, device_id)
+        return device_id
 
-        device.last_heartbeat_at = datetime.now(timezone.utc)
-        device.status = derive_device_status(device.last_heartbeat_at, error=has_error)
-        return self.repo.save(device)
+    def heartbeat(self, serial_number: str, has_error: bool = False) -> str:
+        # Recorded in memory and written by the heartbeat flusher; no query once the
+        # device id is cached.
+        device_id = self.resolve_device_id(serial_number)
+        now = datetime.now(timezone.utc)
+        heartbeats.record(device_id, now, has_error)
+        return derive_device_status(now, error=has_error)
+
+    def last_heartbeat(self, device: Device) -> tuple[datetime | None, bool]:
+        # The stored heartbeat, or a newer one that is not flushed yet.
+        last_heartbeat_at = device.last_heartbeat_at
+        if last_heartbeat_at is not None and last_heartbeat_at.tzinfo is None:
+            last_heartbeat_at = last_heartbeat_at.replace(tzinfo=timezone.utc)
+        has_error = device.heartbeat_error
+
+        pending = heartbeats.pending(device.id)
+        if pending is not None and (last_heartbeat_at is None or pending[0] >= last_heartbeat_at):
+            last_heartbeat_at, has_error = pending
+        return last_heartbeat_at, has_error
+
+    def current_status(self, device: Device) -> str:
+        # Derived when read; heartbeats only store their time and error flag.
+        last_heartbeat_at, has_error = self.last_heartbeat(device)
+        return derive_device_status(last_heartbeat_at, error=has_error)
+
+    def describe(self, device: Device) -> dict:
+        last_heartbeat_at, has_error = self.last_heartbeat(device)
+        return {
+            "id": device.id,
+            "organization_id": device.organization_id,
+            "serial_number": device.serial_number,
+            "agent_version": device.agent_version,
+            "status": derive_device_status(last_heartbeat_at, error=has_error),
+            "last_heartbeat_at": last_heartbeat_at,
+        }
+
+    def list_devices(self, organization_id: int | None = None) -> list[dict]:
+        return [self.describe(device) for device in self.repo.list_devices(organization_id)]
+
+    def get_device(self, device_id: int) -> dict | None:
+        device = self.repo.get(device_id)
+        return None if device is None else self.describe(device)
 
     def push_metrics(self, serial_number: str, cpu: int) -> None:
-        device = self.repo.get_by_serial(serial_number)
-        if device is None:
-            raise ValueError("Unknown device")
-        self.repo.add_metric(device.id, cpu, serial_number)
+        self.repo.add_metric(self.resolve_device_id(serial_number), cpu, serial_number)
 
     def push_logs(self, serial_number: str, level: str, message: str) -> None:
-        device = self.repo.get_by_serial(serial_number)
-        if device is None:
-            raise ValueError("Unknown device")
-        self.repo.add_log(device.id, level, message, serial_number)
+        self.repo.add_log(self.resolve_device_id(serial_number), level, message, serial_number)
 
-    def fetch_config(self, serial_number: str) -> dict:
-        device = self.repo.get_by_serial(serial_number)
-        if device is None:
+    def ingest_batch(
+        self,
+        serial_number: str,
+        uptime: int | None,
+        bucket_seconds: int,
+        metrics: list[dict],
+        logs: list[dict],
+        button_events: list[dict],
+    ) -> dict:
+        device_id = self.resolve_device_id(serial_number)
+
+        received_at = datetime.now(timezone.utc)
+        metric_records, metric_statuses = _validate_records(DeviceBatchMetric, metrics)
+        log_records, log_statuses = _validate_records(DeviceBatchLog, logs)
+        event_records, event_statuses = _validate_records(DeviceBatchButtonEvent, button_events)
+
+        metric_rows = [
+            {"device_id": device_id, "cpu": record.cpu, "created_by": serial_number}
+            for record in metric_records
+            if record is not None
+        ]
+        log_rows = [
+            {"device_id": device_id, "level": record.level, "message": record.message, "created_by": serial_number}
+            for record in log_records
+            if record is not None
+        ]
+
+        # Buckets are stamped with the uptime of the device; the batch carries the
+        # uptime at which it was sent, which maps them onto the receive time.
+        event_rows = []
+        for index, record in enumerate(event_records):
+            if record is None:
+                continue
+            if uptime is None or record.bucket_start > uptime:
+                event_statuses[index] = {"status": "rejected", "detail": "bucket_start: not within uptime"}
+                continue
+            event_rows.append(
+                {
+                    "device_id": device_id,
+                    "gpio": record.gpio,
+                    "event": record.event,
+                    "count": record.count,
+                    "bucket_start": received_at - timedelta(seconds=uptime - record.bucket_start),
+                    "bucket_seconds": bucket_seconds,
+                    "created_by": serial_number,
+                }
+            )
+
+        self.repo.add_batch(metric_rows, log_rows, event_rows)
+
+        accepted = len(metric_rows) + len(log_rows) + len(event_rows)
+        rejected = len(metrics) + len(logs) + len(button_events) - accepted
+        return {
+            "status": "partial" if rejected else "accepted",
+            "accepted": accepted,
+            "rejected": rejected,
+            "metrics": metric_statuses,
+            "logs": log_statuses,
+            "button_events": event_statuses,
+        }
+
+    def fetch_config(self, serial_number: str, since_version: int | None = None) -> dict:
+        device_id = self.resolve_device_id(serial_number)
+        version = self.repo.get_config_version(device_id)
+        if version is None:
             raise ValueError("Unknown device")
-        settings = self.repo.get_device_settings(device.id)
-        return {setting.key: setting.value for setting in settings}
+
+        if since_version == version:
+            return {"version": version, "status": "not_modified", "settings": {}}
+        if since_version is not None and since_version < version:
+            changed = self.repo.get_device_settings(device_id, since_config_version=since_version)
+            return {"version": version, "status": "changed", "settings": {s.key: s.value for s in changed}}
+
+        # A version the server does not know, e.g. after a restore, gets the full config.
+        settings = device_configs.get(device_id, version)
+        if settings is None:
+            settings = {setting.key: setting.value for setting in self.repo.get_device_settings(device_id)}
+            device_configs.set(device_id, version, settings)
+        return {"version": version, "status": "full", "settings": settings}
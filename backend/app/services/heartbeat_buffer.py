@@ -0,0 +1,121 @@
+import threading
+from collections.abc import Callable
+from datetime import datetime
+
+from sqlalchemy.orm import Session
+
+from app.core.logging import get_logger
+from app.repositories.device_repository import DeviceRepository
+
+logger = get_logger(__name__)
+
+
+# Serial number to device id, so the hot device protocol paths skip the lookup query.
+# Serial numbers never move to another device row, so entries do not go stale. Unknown
+# serials are not cached; a device registered later is found on its next call.
+class DeviceIdCache:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._ids: dict[str, int] = {}
+
+    def get(self, serial_number: str) -> int | None:
+        with self._lock:
+            return self._ids.get(serial_number)
+
+    def set(self, serial_number: str, device_id: int) -> None:
+        with self._lock:
+            self._ids[serial_number] = device_id
+
+    def clear(self) -> None:
+        with self._lock:
+            self._ids.clear()
+
+
+# Latest heartbeat per device, held in memory until it is flushed in one batched UPDATE.
+# Only the newest heartbeat of a device matters, so a device heartbeating every few
+# seconds costs one row update per flush interval instead of one commit per call.
+class HeartbeatBuffer:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._pending: dict[int, tuple[datetime, bool]] = {}
+
+    def record(self, device_id: int, at: datetime, has_error: bool) -> None:
+        with self._lock:
+            current = self._pending.get(device_id)
+            if current is None or current[0] <= at:
+                self._pending[device_id] = (at, has_error)
+
+    def pending(self, device_id: int) -> tuple[datetime, bool] | None:
+        with self._lock:
+            return self._pending.get(device_id)
+
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._pending)
+
+    def clear(self) -> None:
+        with self._lock:
+            self._pending.clear()
+
+    def flush(self, db: Session) -> int:
+        with self._lock:
+            entries, self._pending = self._pending, {}
+        if not entries:
+            return 0
+
+        rows = [
+            {"device_id": device_id, "at": at, "error": has_error}
+            for device_id, (at, has_error) in entries.items()
+        ]
+        try:
+            DeviceRepository(db).update_heartbeats(rows)
+        except Exception:
+            db.rollback()
+            # Keep them for the next flush, unless a newer heartbeat arrived meanwhile.
+            for device_id, (at, has_error) in entries.items():
+                self.record(device_id, at, has_error)
+            logger.exception("Flushing %d heartbeats failed", len(rows))
+            raise
+        return len(rows)
+
+
+# Flushes a HeartbeatBuffer on an interval from a background thread, and once more on stop.
+class HeartbeatFlusher:
+    def __init__(self, buffer: HeartbeatBuffer, session_factory: Callable[[], Session], interval_seconds: float):
+        self.buffer = buffer
+        self.session_factory = session_factory
+        self.interval_seconds = interval_seconds
+        self._stop = threading.Event()
+        self._thread: threading.Thread | None = None
+
+    def flush(self) -> int:
+        db = self.session_factory()
+        try:
+            return self.buffer.flush(db)
+        except Exception:
+            return 0
+        finally:
+            db.close()
+
+    def _run(self) -> None:
+        while not self._stop.wait(self.interval_seconds):
+            self.flush()
+
+    def start(self) -> None:
+        if self._thread is not None:
+            return
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, name="heartbeat-flusher", daemon=True)
+        self._thread.start()
+
+    def stop(self) -> None:
+        if self._thread is None:
+            return
+        self._stop.set()
+        self._thread.join()
+        self._thread = None
+        self.flush()
+
+
+device_ids = DeviceIdCache()
+heartbeats = HeartbeatBuffer()
@@ -21,6 +21,7 @@ class SettingsService:
             device_id=payload.device_id,
             created_by=payload.actor_id,
         )
+        self._stamp_device_config(setting)
         created = self.repo.create(setting)
         self._log("settings.change", payload.actor_id, str(created.id), None, created.value)
         return created
@@ -39,10 +40,15 @@ class SettingsService:
             device_id=target.device_id,
             created_by=actor_id,
         )
+        self._stamp_device_config(setting)
         created = self.repo.create(setting)
         self._log("settings.rollback", actor_id, str(created.id), latest.value if latest else None, created.value)
         return created
 
+    def _stamp_device_config(self, setting: Setting) -> None:
+        if setting.scope == "device" and setting.device_id is not None:
+            setting.device_config_version = self.repo.bump_device_config_version(setting.device_id)
+
     def _log(self, action: str, actor_id: str, resource_id: str, before_state: dict | None, after_state: dict | None) -> None:
         log = AuditLog(
             actor_type="user",
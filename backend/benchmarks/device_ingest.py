@@ -0,0 +1,104 @@
+"""Compare device record ingest: one request per record against batches.
+
+Runs the service layer against a throwaway database and prints rows/sec for the
+per-record path (push_metrics/push_logs) and for ingest_batch.
+
+    cd backend
+    PYTHONPATH=. python benchmarks/device_ingest.py
+    PYTHONPATH=. python benchmarks/device_ingest.py --database-url postgresql+psycopg://...
+
+Against Postgres the tables are created and dropped again, so point it at a
+scratch database.
+"""
+
+import argparse
+import tempfile
+import time
+from pathlib import Path
+
+from sqlalchemy import create_engine
+from sqlalchemy.dialects.postgresql import JSONB
+from sqlalchemy.ext.compiler import compiles
+from sqlalchemy.orm import Session, sessionmaker
+
+from app.db.base import Base
+from app.models.entities import Device, DeviceButtonEvent, DeviceLog, DeviceMetric, Organization
+from app.services.device_protocol_service import DeviceProtocolService
+
+TABLES = [
+    Organization.__table__,
+    Device.__table__,
+    DeviceMetric.__table__,
+    DeviceLog.__table__,
+    DeviceButtonEvent.__table__,
+]
+
+
+@compiles(JSONB, "sqlite")
+def _compile_jsonb_sqlite(type_, compiler, **kw) -> str:
+    return "JSON"
+
+
+def per_record(service: DeviceProtocolService, serial_number: str, records: int) -> None:
+    for index in range(records):
+        if index % 2:
+            service.push_logs(serial_number, "info", f"record {index}")
+        else:
+            service.push_metrics(serial_number, index % 100)
+
+
+def batched(service: DeviceProtocolService, serial_number: str, records: int, batch_size: int) -> None:
+    for start in range(0, records, batch_size):
+        indexes = range(start, min(start + batch_size, records))
+        service.ingest_batch(
+            serial_number,
+            uptime=None,
+            bucket_seconds=60,
+            metrics=[{"cpu": index % 100} for index in indexes if not index % 2],
+            logs=[{"level": "info", "message": f"record {index}"} for index in indexes if index % 2],
+            button_events=[],
+        )
+
+
+def run(database_url: str, records: int, batch_size: int) -> None:
+    engine = create_engine(database_url, future=True)
+    Base.metadata.drop_all(engine, tables=TABLES)
+    Base.metadata.create_all(engine, tables=TABLES)
+    try:
+        with sessionmaker(bind=engine, autoflush=False, autocommit=False, class_=Session)() as db:
+            db.add(Organization(name="benchmark"))
+            db.flush()
+            organization_id = db.query(Organization.id).scalar()
+            db.add(Device(organization_id=organization_id, serial_number="BENCH-1", capabilities={}))
+            db.commit()
+
+            service = DeviceProtocolService(db)
+            for name, ingest in (
+                ("per-record", lambda: per_record(service, "BENCH-1", records)),
+                (f"batch of {batch_size}", lambda: batched(service, "BENCH-1", records, batch_size)),
+            ):
+                started = time.perf_counter()
+                ingest()
+                elapsed = time.perf_counter() - started
+                print(f"{name:>16}: {records} rows in {elapsed:.3f}s, {records / elapsed:,.0f} rows/sec")
+    finally:
+        Base.metadata.drop_all(engine, tables=TABLES)
+        engine.dispose()
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--database-url", help="SQLAlchemy URL; a temporary SQLite file by default")
+    parser.add_argument("--records", type=int, default=5000)
+    parser.add_argument("--batch-size", type=int, default=500)
+    args = parser.parse_args()
+
+    if args.database_url:
+        run(args.database_url, args.records, args.batch_size)
+        return
+    with tempfile.TemporaryDirectory() as directory:
+        run(f"sqlite:///{Path(directory) / 'ingest.db'}", args.records, args.batch_size)
+
+
+if __name__ == "__main__":
+    main()
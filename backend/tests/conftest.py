@@ -0,0 +1,54 @@
+from collections.abc import Generator
+
+import pytest
+from sqlalchemy import create_engine
+from sqlalchemy.dialects.postgresql import JSONB
+from sqlalchemy.ext.compiler import compiles
+from sqlalchemy.orm import Session, sessionmaker
+from sqlalchemy.pool import StaticPool
+
+from app.db.base import Base
+from app.models.entities import (
+    AuditLog,
+    Device,
+    DeviceButtonEvent,
+    DeviceLog,
+    DeviceMetric,
+    Organization,
+    Setting,
+)
+from app.services.config_cache import device_configs
+from app.services.heartbeat_buffer import device_ids, heartbeats
+
+
+# SQLite stands in for Postgres in the tests; JSONB columns become JSON there.
+@compiles(JSONB, "sqlite")
+def _compile_jsonb_sqlite(type_, compiler, **kw) -> str:
+    return "JSON"
+
+
+@pytest.fixture()
+def db() -> Generator[Session, None, None]:
+    engine = create_engine("sqlite://", connect_args={"check_same_thread": False}, poolclass=StaticPool)
+    Base.metadata.create_all(
+        engine,
+        tables=[
+            Organization.__table__,
+            Device.__table__,
+            DeviceMetric.__table__,
+            DeviceLog.__table__,
+            DeviceButtonEvent.__table__,
+            Setting.__table__,
+            AuditLog.__table__,
+        ],
+    )
+    session = sessionmaker(bind=engine, autoflush=False, autocommit=False, class_=Session)()
+    session.add(Organization(id=1, name="org"))
+    session.add(Device(id=1, organization_id=1, serial_number="AGENT-0042", capabilities={}))
+    session.commit()
+    device_ids.clear()
+    heartbeats.clear()
+    device_configs.clear()
+    yield session
+    session.close()
+    engine.dispose()
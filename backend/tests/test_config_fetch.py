@@ -0,0 +1,117 @@
+import pytest
+from fastapi.testclient import TestClient
+from sqlalchemy import event
+from sqlalchemy.orm import Session
+
+from app.db.session import get_db
+from app.main import app
+from app.models.entities import Device
+from app.schemas.settings import SettingCreate
+from app.services.device_protocol_service import DeviceProtocolService
+from app.services.settings_service import SettingsService
+
+
+def set_device_setting(db: Session, key: str, value: dict, device_id: int = 1) -> None:
+    SettingsService(db).create_setting(
+        SettingCreate(scope="device", key=key, value=value, device_id=device_id, actor_id="admin")
+    )
+
+
+def test_config_version_is_bumped_by_device_settings(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    assert service.fetch_config("AGENT-0042") == {"version": 0, "status": "full", "settings": {}}
+
+    set_device_setting(db, "button", {"long_press_time": 1000})
+    set_device_setting(db, "display", {"brightness": 80})
+    SettingsService(db).create_setting(
+        SettingCreate(scope="organization", key="locale", value={"lang": "nl"}, organization_id=1, actor_id="admin")
+    )
+
+    config = service.fetch_config("AGENT-0042")
+    assert config["version"] == 2
+    assert config["settings"] == {"button": {"long_press_time": 1000}, "display": {"brightness": 80}}
+
+
+def test_conditional_fetch_returns_only_changed_keys(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    set_device_setting(db, "button", {"long_press_time": 1000})
+    set_device_setting(db, "display", {"brightness": 80})
+    assert service.fetch_config("AGENT-0042", since_version=2) == {
+        "version": 2,
+        "status": "not_modified",
+        "settings": {},
+    }
+
+    set_device_setting(db, "button", {"long_press_time": 1500})
+    set_device_setting(db, "button", {"long_press_time": 2000})
+    assert service.fetch_config("AGENT-0042", since_version=2) == {
+        "version": 4,
+        "status": "changed",
+        "settings": {"button": {"long_press_time": 2000}},
+    }
+
+    # Rolling back is a change as well.
+    SettingsService(db).rollback("button", 1, "admin")
+    config = service.fetch_config("AGENT-0042", since_version=4)
+    assert config["settings"] == {"button": {"long_press_time": 1000}}
+
+    # Unknown, newer versions get the whole config.
+    assert service.fetch_config("AGENT-0042", since_version=99)["status"] == "full"
+
+
+def test_settings_of_other_devices_do_not_bump(db: Session) -> None:
+    db.add(Device(id=2, organization_id=1, serial_number="AGENT-0043", capabilities={}))
+    db.commit()
+    set_device_setting(db, "button", {"long_press_time": 1000}, device_id=2)
+
+    assert DeviceProtocolService(db).fetch_config("AGENT-0042", since_version=0)["status"] == "not_modified"
+    assert DeviceProtocolService(db).fetch_config("AGENT-0043", since_version=0)["status"] == "changed"
+
+
+def test_full_config_is_cached_per_version(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    set_device_setting(db, "button", {"long_press_time": 1000})
+    service.fetch_config("AGENT-0042")
+
+    statements: list[str] = []
+    event.listen(db.get_bind(), "before_cursor_execute", lambda *args: statements.append(args[2]))
+    assert service.fetch_config("AGENT-0042")["settings"] == {"button": {"long_press_time": 1000}}
+    assert len(statements) == 1
+
+    set_device_setting(db, "button", {"long_press_time": 2000})
+    assert service.fetch_config("AGENT-0042")["settings"] == {"button": {"long_press_time": 2000}}
+
+
+def test_unknown_device(db: Session) -> None:
+    with pytest.raises(ValueError):
+        DeviceProtocolService(db).fetch_config("UNKNOWN")
+
+
+def test_config_fetch_endpoint_etag(db: Session) -> None:
+    set_device_setting(db, "button", {"long_press_time": 1000})
+    app.dependency_overrides[get_db] = lambda: db
+    try:
+        client = TestClient(app)
+        url = "/api/v1/device-protocol/config-fetch"
+        response = client.post(url, json={"serial_number": "AGENT-0042"})
+        assert response.status_code == 200
+        assert response.headers["etag"] == '"1"'
+        assert response.json()["settings"] == {"button": {"long_press_time": 1000}}
+
+        response = client.post(url, json={"serial_number": "AGENT-0042"}, headers={"If-None-Match": '"1"'})
+        assert response.status_code == 304
+        assert response.headers["etag"] == '"1"'
+
+        set_device_setting(db, "display", {"brightness": 80})
+        response = client.post(url, json={"serial_number": "AGENT-0042"}, headers={"If-None-Match": 'W/"1"'})
+        assert response.status_code == 200
+        assert response.headers["etag"] == '"2"'
+        assert response.json() == {"version": 2, "status": "changed", "settings": {"display": {"brightness": 80}}}
+
+        response = client.post(url, json={"serial_number": "AGENT-0042", "since_version": 2})
+        assert response.json()["status"] == "not_modified"
+
+        response = client.post(url, json={"serial_number": "UNKNOWN"})
+        assert response.status_code == 404
+    finally:
+        app.dependency_overrides.pop(get_db, None)
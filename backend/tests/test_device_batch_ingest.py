@@ -0,0 +1,116 @@
+from datetime import datetime, timedelta, timezone
+
+import pytest
+from fastapi.testclient import TestClient
+from sqlalchemy import func, select
+from sqlalchemy.orm import Session
+
+from app.db.session import get_db
+from app.main import app
+from app.models.entities import DeviceButtonEvent, DeviceLog, DeviceMetric
+from app.services.device_protocol_service import DeviceProtocolService
+
+
+def count_rows(db: Session, model) -> int:
+    return db.scalar(select(func.count()).select_from(model))
+
+
+def test_ingest_batch_inserts_all_record_kinds(db: Session) -> None:
+    result = DeviceProtocolService(db).ingest_batch(
+        "AGENT-0042",
+        uptime=3725,
+        bucket_seconds=60,
+        metrics=[{"cpu": 12}, {"cpu": 15}],
+        logs=[{"level": "info", "message": "button dispatch normal delivered=3"}],
+        button_events=[{"gpio": 4, "event": "single_press", "count": 3, "bucket_start": 3660}],
+    )
+
+    assert result["status"] == "accepted"
+    assert result["accepted"] == 4
+    assert result["rejected"] == 0
+    assert count_rows(db, DeviceMetric) == 2
+    assert count_rows(db, DeviceLog) == 1
+
+    event = db.scalar(select(DeviceButtonEvent))
+    assert (event.device_id, event.gpio, event.event) == (1, 4, "single_press")
+    assert (event.count, event.bucket_seconds) == (3, 60)
+    bucket_start = event.bucket_start.replace(tzinfo=timezone.utc)
+    expected = datetime.now(timezone.utc) - timedelta(seconds=65)
+    assert abs(bucket_start - expected) < timedelta(seconds=5)
+    assert event.created_by == "AGENT-0042"
+
+
+def test_ingest_batch_reports_per_record_status(db: Session) -> None:
+    result = DeviceProtocolService(db).ingest_batch(
+        "AGENT-0042",
+        uptime=100,
+        bucket_seconds=60,
+        metrics=[{"cpu": 10}, {"cpu": -1}, {}],
+        logs=[{"level": "x" * 21, "message": "too long a level"}, {"level": "warning", "message": "ok"}],
+        button_events=[
+            {"gpio": 4, "event": "long_press", "count": 1, "bucket_start": 60},
+            {"gpio": 4, "event": "long_press", "count": 1, "bucket_start": 120},
+        ],
+    )
+
+    assert result["status"] == "partial"
+    assert (result["accepted"], result["rejected"]) == (3, 4)
+    assert [status["status"] for status in result["metrics"]] == ["accepted", "rejected", "rejected"]
+    assert result["metrics"][1]["detail"].startswith("cpu:")
+    assert result["metrics"][2]["detail"].startswith("cpu:")
+    assert [status["status"] for status in result["logs"]] == ["rejected", "accepted"]
+    assert result["button_events"][1] == {"status": "rejected", "detail": "bucket_start: not within uptime"}
+    assert count_rows(db, DeviceMetric) == 1
+    assert count_rows(db, DeviceLog) == 1
+    assert count_rows(db, DeviceButtonEvent) == 1
+
+
+def test_ingest_batch_rejects_button_events_without_uptime(db: Session) -> None:
+    result = DeviceProtocolService(db).ingest_batch(
+        "AGENT-0042",
+        uptime=None,
+        bucket_seconds=60,
+        metrics=[],
+        logs=[],
+        button_events=[{"gpio": 4, "event": "single_press", "count": 1, "bucket_start": 0}],
+    )
+    assert result["rejected"] == 1
+    assert count_rows(db, DeviceButtonEvent) == 0
+
+
+def test_ingest_batch_unknown_device(db: Session) -> None:
+    with pytest.raises(ValueError):
+        DeviceProtocolService(db).ingest_batch("UNKNOWN", None, 60, [{"cpu": 1}], [], [])
+    assert count_rows(db, DeviceMetric) == 0
+
+
+def test_batch_endpoint(db: Session) -> None:
+    app.dependency_overrides[get_db] = lambda: db
+    try:
+        client = TestClient(app)
+        response = client.post(
+            "/api/v1/device-protocol/batch",
+            json={
+                "serial_number": "AGENT-0042",
+                "uptime": 3725,
+                "bucket_seconds": 60,
+                "logs": [{"level": "warning", "message": "telemetry dropped_records=5"}],
+                "button_events": [{"gpio": 4, "event": "single_press", "count": 3, "bucket_start": 3660}],
+            },
+        )
+        assert response.status_code == 200
+        body = response.json()
+        assert body["status"] == "accepted"
+        assert body["logs"] == [{"status": "accepted", "detail": None}]
+        assert body["metrics"] == []
+
+        response = client.post("/api/v1/device-protocol/batch", json={"serial_number": "UNKNOWN"})
+        assert response.status_code == 404
+
+        response = client.post(
+            "/api/v1/device-protocol/batch",
+            json={"serial_number": "AGENT-0042", "metrics": [{"cpu": 1}] * 1001},
+        )
+        assert response.status_code == 422
+    finally:
+        app.dependency_overrides.pop(get_db, None)
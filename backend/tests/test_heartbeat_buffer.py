@@ -0,0 +1,188 @@
+from datetime import datetime, timedelta, timezone
+
+import pytest
+from fastapi.testclient import TestClient
+from sqlalchemy import event
+from sqlalchemy.orm import Session
+
+from app.core.rbac import get_current_user_id
+from app.db.session import get_db
+from app.main import app
+from app.models.entities import Device
+from app.repositories.user_repository import UserRepository
+from app.services.device_protocol_service import DeviceProtocolService
+from app.services.heartbeat_buffer import HeartbeatBuffer, HeartbeatFlusher, heartbeats
+
+
+def count_statements(db: Session) -> list[str]:
+    statements: list[str] = []
+    event.listen(db.get_bind(), "before_cursor_execute", lambda *args: statements.append(args[2]))
+    return statements
+
+
+def add_device(db: Session, device_id: int, serial_number: str) -> None:
+    db.add(Device(id=device_id, organization_id=1, serial_number=serial_number, capabilities={}))
+    db.commit()
+
+
+def stored_heartbeat(db: Session, device_id: int) -> tuple[datetime | None, bool]:
+    db.expire_all()
+    device = db.get(Device, device_id)
+    at = device.last_heartbeat_at
+    return (at.replace(tzinfo=timezone.utc) if at else None), device.heartbeat_error
+
+
+def test_heartbeat_needs_no_query_once_the_device_is_cached(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    statements = count_statements(db)
+
+    assert service.heartbeat("AGENT-0042") == "online"
+    assert len(statements) == 1
+
+    for _ in range(100):
+        assert service.heartbeat("AGENT-0042") == "online"
+    assert service.heartbeat("AGENT-0042", has_error=True) == "error"
+    assert len(statements) == 1
+    assert len(heartbeats) == 1
+    assert stored_heartbeat(db, 1) == (None, False)
+
+
+def test_unknown_serial_is_not_cached(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    with pytest.raises(ValueError):
+        service.heartbeat("AGENT-0043")
+
+    add_device(db, 2, "AGENT-0043")
+    assert service.heartbeat("AGENT-0043") == "online"
+
+
+def test_flush_writes_all_devices_in_one_update(db: Session) -> None:
+    add_device(db, 2, "AGENT-0043")
+    add_device(db, 3, "AGENT-0044")
+    service = DeviceProtocolService(db)
+    for serial_number in ("AGENT-0042", "AGENT-0043", "AGENT-0044"):
+        service.heartbeat(serial_number, has_error=serial_number == "AGENT-0044")
+
+    statements = count_statements(db)
+    assert heartbeats.flush(db) == 3
+    assert len([statement for statement in statements if statement.startswith("UPDATE")]) == 1
+    assert len(heartbeats) == 0
+
+    at, error = stored_heartbeat(db, 1)
+    assert not error
+    assert datetime.now(timezone.utc) - at < timedelta(seconds=5)
+    assert stored_heartbeat(db, 3)[1] is True
+    # The status is not stored; it is derived when read.
+    assert "status" not in Device.__table__.columns
+    assert heartbeats.flush(db) == 0
+
+
+def test_flush_keeps_the_newer_stored_heartbeat(db: Session) -> None:
+    now = datetime.now(timezone.utc)
+    newer = HeartbeatBuffer()
+    newer.record(1, now, False)
+    newer.flush(db)
+
+    # Another worker flushing an older heartbeat late does not move it back.
+    older = HeartbeatBuffer()
+    older.record(1, now - timedelta(seconds=30), True)
+    older.flush(db)
+    assert stored_heartbeat(db, 1) == (now, False)
+
+
+def test_failed_flush_keeps_the_heartbeats(db: Session) -> None:
+    buffer = HeartbeatBuffer()
+    buffer.record(1, datetime.now(timezone.utc), False)
+
+    def fail(*args) -> None:
+        raise RuntimeError("database unavailable")
+
+    event.listen(db.get_bind(), "before_cursor_execute", fail)
+    with pytest.raises(RuntimeError):
+        buffer.flush(db)
+    event.remove(db.get_bind(), "before_cursor_execute", fail)
+
+    assert len(buffer) == 1
+    assert buffer.flush(db) == 1
+
+
+def test_status_is_derived_when_read(db: Session) -> None:
+    service = DeviceProtocolService(db)
+    device = db.get(Device, 1)
+    device.last_heartbeat_at = datetime.now(timezone.utc) - timedelta(minutes=10)
+    db.commit()
+    assert service.current_status(device) == "offline"
+
+    device.last_heartbeat_at = datetime.now(timezone.utc) - timedelta(minutes=3)
+    db.commit()
+    assert service.current_status(device) == "stale"
+
+    device.heartbeat_error = True
+    db.commit()
+    assert service.current_status(device) == "error"
+    device.heartbeat_error = False
+    db.commit()
+
+    # A heartbeat that is not flushed yet counts.
+    service.heartbeat("AGENT-0042")
+    assert service.current_status(device) == "online"
+    service.heartbeat("AGENT-0042", has_error=True)
+    assert service.current_status(device) == "error"
+
+
+def test_flusher_flushes_on_stop(db: Session) -> None:
+    buffer = HeartbeatBuffer()
+    flusher = HeartbeatFlusher(buffer, lambda: db, interval_seconds=3600)
+    flusher.start()
+    buffer.record(1, datetime.now(timezone.utc), False)
+    flusher.stop()
+    assert len(buffer) == 0
+    assert stored_heartbeat(db, 1)[0] is not None
+
+
+def test_heartbeat_endpoint(db: Session) -> None:
+    app.dependency_overrides[get_db] = lambda: db
+    try:
+        client = TestClient(app)
+        response = client.post("/api/v1/device-protocol/heartbeat", json={"serial_number": "AGENT-0042"})
+        assert response.json() == {"status": "online"}
+        response = client.post("/api/v1/device-protocol/heartbeat", json={"serial_number": "UNKNOWN"})
+        assert response.status_code == 404
+    finally:
+        app.dependency_overrides.pop(get_db, None)
+    assert heartbeats.pending(1) is not None
+
+
+def test_device_reads_derive_the_status(db: Session, monkeypatch: pytest.MonkeyPatch) -> None:
+    add_device(db, 2, "AGENT-0043")
+    device = db.get(Device, 2)
+    device.last_heartbeat_at = datetime.now(timezone.utc) - timedelta(minutes=10)
+    db.commit()
+    DeviceProtocolService(db).heartbeat("AGENT-0042", has_error=True)
+
+    permissions = {"devices.read"}
+    monkeypatch.setattr(UserRepository, "list_permissions", lambda self, user_id: permissions)
+    app.dependency_overrides[get_db] = lambda: db
+    app.dependency_overrides[get_current_user_id] = lambda: 1
+    try:
+        client = TestClient(app)
+        response = client.get("/api/v1/devices", params={"organization_id": 1})
+        assert response.status_code == 200
+        assert [(device["serial_number"], device["status"]) for device in response.json()] == [
+            ("AGENT-0042", "error"),
+            ("AGENT-0043", "offline"),
+        ]
+        # The heartbeat not flushed yet is what the read reports.
+        assert response.json()[0]["last_heartbeat_at"] is not None
+
+        heartbeats.flush(db)
+        DeviceProtocolService(db).heartbeat("AGENT-0042")
+        response = client.get("/api/v1/devices/1")
+        assert response.json()["status"] == "online"
+        assert client.get("/api/v1/devices/99").status_code == 404
+
+        permissions.clear()
+        assert client.get("/api/v1/devices").status_code == 403
+    finally:
+        app.dependency_overrides.pop(get_db, None)
+        app.dependency_overrides.pop(get_current_user_id, None)